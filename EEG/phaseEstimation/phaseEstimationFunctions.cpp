@@ -50,103 +50,71 @@ Eigen::VectorXd oddExtension(const Eigen::VectorXd& x, int n) {
 }
 
 
-// Function to apply FIR filter using Eigen
+// Function to apply FIR filter using Eigen. Long filters and signals are convolved with FFTs, see math/fftConvolution.h
 Eigen::VectorXd applyLSFIRFilter(const Eigen::VectorXd& data, const Eigen::VectorXd& coeffs) {
-    int dataSize = data.size();
-    int filterSize = coeffs.size();
-    Eigen::VectorXd filteredData = Eigen::VectorXd::Zero(dataSize);
-
-    // Perform convolution
-    for (int i = 0; i < dataSize; ++i) {
-        for (int j = 0; j < filterSize; ++j) {
-            if (i - j >= 0) {
-                filteredData(i) += data(i - j) * coeffs(j);
-            }
-        }
-    }
-
+    Eigen::VectorXd filteredData(data.size());
+    convolveFIR(data, coeffs, 0, filteredData);
     return filteredData;
 }
 
-// Zero-phase filtering equivalent to MATLAB's filtfilt
+/*
+Zero-phase filtering equivalent to MATLAB's filtfilt with an odd extension of 3 * M - 1 samples. Inside the extension
+the forward and backward passes add up to one pass with the autocorrelation of the coefficients (2 * M - 1 taps,
+centred), and the outputs of the data only reach M - 1 samples into the extension, so a single pass over an
+extension of M - 1 samples gives the same result.
+*/
 Eigen::VectorXd zeroPhaseLSFIR(const Eigen::VectorXd& data, const Eigen::VectorXd& coeffs) {
-    int extensionSize = 3 * coeffs.size() - 1;
-    Eigen::VectorXd paddedData = oddExtension(data, extensionSize);
-
-    // Forward filter pass
-    Eigen::VectorXd forwardFiltered = applyLSFIRFilter(paddedData, coeffs);
-                 
-    // Reverse the data for the backward pass
-    Eigen::VectorXd reversedData = forwardFiltered.reverse();
-                  
-    // Backward filter pass
-    Eigen::VectorXd backwardFiltered = applyLSFIRFilter(reversedData, coeffs);
-                 
-    Eigen::VectorXd orderedData = backwardFiltered.reverse();
-    
-    // Reverse the result to get the final output
-    return orderedData.segment(extensionSize, data.size());
+    int M = coeffs.size();
+    if (M == 0 || data.size() == 0) return Eigen::VectorXd::Zero(data.size());
+
+    Eigen::VectorXd autocorrelation(2 * M - 1);
+    for (int lag = 0; lag < M; ++lag) {
+        double value = coeffs.head(M - lag).dot(coeffs.tail(M - lag));
+        autocorrelation(M - 1 - lag) = value;
+        autocorrelation(M - 1 + lag) = value;
+    }
+
+    Eigen::VectorXd paddedData = oddExtension(data, M - 1);
+    Eigen::VectorXd filteredData(data.size());
+    convolveFIR(paddedData, autocorrelation, 2 * (M - 1), filteredData);
+    return filteredData;
 }
 
 Eigen::MatrixXd applyLSFIRFilterMatrix_ret(const Eigen::MatrixXd& data, const Eigen::VectorXd& coeffs) {
-    int numRows = data.rows();
-    int numCols = data.cols();
-    int filterSize = coeffs.size();
-    Eigen::MatrixXd filteredData = Eigen::MatrixXd::Zero(numRows, numCols);
-
-    // Perform convolution for each row
-    #pragma omp parallel for
-    for (int row = 0; row < numRows; ++row) {
-        for (int i = 0; i < numCols; ++i) {
-            for (int j = 0; j < filterSize; ++j) {
-                if (i - j >= 0) {
-                    filteredData(row, i) += data(row, i - j) * coeffs(j);
-                }
-            }
-        }
-    }
-
+    Eigen::MatrixXd filteredData(data.rows(), data.cols());
+    applyLSFIRFilterMatrix(data, coeffs, filteredData);
     return filteredData;
 }
 
 void applyLSFIRFilterMatrix(const Eigen::MatrixXd& data, const Eigen::VectorXd& coeffs, Eigen::MatrixXd& filteredData) {
     int numRows = data.rows();
     int numCols = data.cols();
-    int filterSize = coeffs.size();
-    filteredData.setZero();
+    filteredData.resize(numRows, numCols);
 
     // Perform convolution for each row
     #pragma omp parallel for
     for (int row = 0; row < numRows; ++row) {
-        for (int i = 0; i < numCols; ++i) {
-            for (int j = 0; j < filterSize; ++j) {
-                if (i - j >= 0) {
-                    filteredData(row, i) += data(row, i - j) * coeffs(j);
-                }
-            }
-        }
+        Eigen::VectorXd rowData = data.row(row).transpose();
+        Eigen::VectorXd rowFiltered(numCols);
+        convolveFIR(rowData, coeffs, 0, rowFiltered);
+        filteredData.row(row) = rowFiltered.transpose();
     }
 }
 
 void zeroPhaseLSFIRMatrix(const Eigen::MatrixXd& data, const Eigen::VectorXd& coeffs, Eigen::MatrixXd& filteredData) {
-    // Forward filter pass
-    applyLSFIRFilterMatrix(data, coeffs, filteredData);
-
-    // Reverse the data for the backward pass
-    Eigen::MatrixXd reversedData = filteredData;
-    #pragma omp parallel for
-    for (int row = 0; row < reversedData.rows(); ++row) {
-        reversedData.row(row) = reversedData.row(row).reverse();
-    }
-
-    // Backward filter pass
-    Eigen::MatrixXd backwardFiltered = Eigen::MatrixXd::Zero(data.rows(), data.cols());
-    applyLSFIRFilterMatrix(reversedData, coeffs, backwardFiltered);
+    int numRows = data.rows();
+    int numCols = data.cols();
+    filteredData.resize(numRows, numCols);
 
-    // Reverse the result to get the final output
+    // Forward pass, then the backward pass on the reversed row
     #pragma omp parallel for
-    for (int row = 0; row < backwardFiltered.rows(); ++row) {
-        filteredData.row(row) = backwardFiltered.row(row).reverse();
+    for (int row = 0; row < numRows; ++row) {
+        Eigen::VectorXd rowData = data.row(row).transpose();
+        Eigen::VectorXd forwardFiltered(numCols);
+        convolveFIR(rowData, coeffs, 0, forwardFiltered);
+        rowData = forwardFiltered.reverse();
+        convolveFIR(rowData, coeffs, 0, forwardFiltered);
+        filteredData.row(row) = forwardFiltered.reverse().transpose();
     }
 }
 
@@ -15,6 +15,7 @@
 #include <tuple>
 
 #include "../../math/dsp.h"
+#include "../../math/fftConvolution.h"
 
 #include <fftw3.h>
 
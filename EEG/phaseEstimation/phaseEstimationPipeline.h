@@ -0,0 +1,254 @@
+#ifndef PHASEESTIMATIONPIPELINE_H
+#define PHASEESTIMATIONPIPELINE_H
+
+#include <csignal>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>    // For M_PI
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <limits>
+#include "dataHandler/dataHandler.h"
+#include "EEG/preprocessing/preprocessingFunctions.h"
+#include "EEG/preprocessing/removeBCG.h"
+#include "phaseEstimationFunctions.h"
+#include "math/dsp.h"
+#include "math/filterDesign.h"
+#include "math/coefficientExchange.h"
+
+struct phaseEstimateParameters {
+
+    // Number of samples to use for the processing
+    int numberOfSamples = 10000;
+
+    //  downsampling
+    int downsampling_factor = 10;
+
+    // Filter 9-13Hz. An LS FIR designed at the downsampled rate, the defaults give getLSFIRCoeffs_9_13Hz at 500 Hz.
+    int filter2_length = 250;
+    double filter2_low = 9;
+    double filter2_high = 13;
+    int filter2_taps = 71;
+    double filter2_transition = 3;
+    double SNR_threshold = 0.3;
+
+    // phase estimate
+    size_t edge = 35;
+    size_t modelOrder = 15;
+    size_t hilbertWinLength = 64;
+
+    // stimulation
+    double stimulation_target = 0;          //M_PI * 0.5;    [0, 2*pi]
+    int phase_shift = -40;                    // for 5000Hz
+
+    // Shutdown check interval while waiting for preprocessing output
+    int wait_timeout_ms = 100;
+};
+
+struct phaseEstimateStates {
+    bool performPreprocessing = true;
+    bool performPhaseEstimation = false;
+    bool performSNRcheck = false;
+    bool performRemoveBCG = false;
+    bool performFiltering = false;
+    bool performEstimation = true;
+    bool performHilbertTransform = true;
+    bool performPhaseTargeting = false;
+    bool performPhaseDifference = false;
+    bool phasEst_display_all_EEG_channels = false;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const phaseEstimateParameters& phaseEstParams) {
+    os << "Number of Samples: " << phaseEstParams.numberOfSamples
+       << "\nDownsampling Factor: " << phaseEstParams.downsampling_factor
+       << "\nEdge: " << phaseEstParams.edge
+       << "\nFilter Band: " << phaseEstParams.filter2_low << "-" << phaseEstParams.filter2_high << " Hz, " << phaseEstParams.filter2_taps << " taps"
+       << "\nModel Order: " << phaseEstParams.modelOrder
+       << "\nHilbert Window Length: " << phaseEstParams.hilbertWinLength
+       << "\nStimulation Target: " << phaseEstParams.stimulation_target
+       << "\nPhase Shift: " << phaseEstParams.phase_shift;
+    return os;
+}
+
+// Outputs of the phase estimation loop. Unset callbacks are skipped.
+typedef std::function<void(const Eigen::MatrixXd &newMatrix,
+                           const Eigen::VectorXi &triggers_A,
+                           const Eigen::VectorXi &triggers_B,
+                           const Eigen::VectorXi &triggers_out,
+                           const VectorXi64 &time_stamps,
+                           int numPastElements,
+                           int numFutureElements)> PhaseEstimationDisplayCallback;
+typedef std::function<void(std::vector<std::string> processing_channel_names)> PhaseEstimationNamesCallback;
+typedef std::function<void(int numSamples)> PhaseEstimationNumSamplesCallback;
+
+/*
+Phase estimation loop without Qt. handlePreprocessingOutput hands over the latest preprocessed window, run() estimates
+the phase of the spatially filtered channel and inserts stimulation triggers into the dataHandler.
+Used by phaseEstimationWorker and the headless pipeline.
+*/
+class phaseEstimationPipeline {
+public:
+    phaseEstimationPipeline(dataHandler &handler, 
+                volatile std::sig_atomic_t &processingWorkerRunning, 
+                   phaseEstimateParameters &phaseEstParams_in);
+
+    // Runs until processingWorkerRunning is cleared
+    void run();
+
+    // Latest preprocessing window. Called from the preprocessing thread.
+    void handlePreprocessingOutput(const Eigen::MatrixXd &output,
+                                   const Eigen::VectorXi &triggers_A_in,
+                                   const Eigen::VectorXi &triggers_B_in,
+                                   const Eigen::VectorXi &triggers_out_in,
+                                   const VectorXi64 &time_stamps_in,
+                                   int number_of_samples,
+                                   int seq_num);
+
+    void setParameters(phaseEstimateParameters newParams);
+    phaseEstimateParameters getParameters() { return currentPhaseEstParams; }
+
+    void setStates(phaseEstimateStates states) { phaseEstStates = states; }
+    phaseEstimateStates getStates() { return phaseEstStates; }
+
+    void setPhaseEstimationState(bool isChecked) { phaseEstStates.performPhaseEstimation = isChecked; }
+    void setFilterState(bool isChecked) { phaseEstStates.performFiltering = isChecked; }
+    void setEstimationState(bool isChecked) { phaseEstStates.performEstimation = isChecked; }
+    void setHilbertTransformState(bool isChecked) { phaseEstStates.performHilbertTransform = isChecked; }
+    void setPhaseTargetingState(bool isChecked) { phaseEstStates.performPhaseTargeting = isChecked; }
+    void setEEGViewState(bool isChecked) { phaseEstStates.phasEst_display_all_EEG_channels = isChecked; }
+    void setPhaseDifference(bool isChecked) { phaseEstStates.performPhaseDifference = isChecked; };
+    void setSpatilaTargetChannel(int index) { spatial_channel_index = index; }
+    // Retunes the 9-13 Hz filter, e.g. to the alpha peak of the subject. Taken into use by the next iteration
+    // without locking the estimation loop. Returns false if the band can not be designed.
+    bool setFilterBand(double low, double high, int taps, double transition = 0);
+    void outerElectrodesStateChanged(std::vector<bool> outerElectrodeCheckStates) { outerElectrodeCheckStates_ = outerElectrodeCheckStates; };
+    void setPhaseErrorType(int index) { phaseErrorType = index; };
+    void setPause(bool pause) { processing_pause = pause; }
+
+    Eigen::VectorXd getPhaseDifference_vector();
+
+    void setDisplayCallback(PhaseEstimationDisplayCallback callback) { display_callback = callback; }
+    void setWindowNamesCallback(PhaseEstimationNamesCallback callback) { window_names_callback = callback; }
+    void setSpatialNamesCallback(PhaseEstimationNamesCallback callback) { spatial_names_callback = callback; }
+    void setNumSamplesCallback(PhaseEstimationNumSamplesCallback callback) { num_samples_callback = callback; }
+
+    // Timing of the processing iterations (seconds) and the number of inserted triggers
+    int getIterationCount() { return process_call_count; }
+    double getAverageTime() { return process_call_count > 0 ? total_process_time.count() / process_call_count : 0; }
+    double getMinimumTime() { return min_process_time.count(); }
+    double getMaximumTime() { return max_process_time.count(); }
+    int getTriggerCount() { return trigger_count; }
+
+private:
+    // Designs the filter2 band of params at the downsampled sampling rate
+    bool designFilter2(const phaseEstimateParameters &params, Eigen::VectorXd &coeffs);
+
+    const bool debug = false;
+    void print_debug(std::string msg) {
+        if (debug) std::cout << msg << std::endl;
+    };
+
+    dataHandler &handler;
+    std::mutex dataMutex;
+    std::condition_variable data_condition;     // Signalled by handlePreprocessingOutput
+    volatile std::sig_atomic_t &processingWorkerRunning;
+
+    PhaseEstimationDisplayCallback display_callback;
+    PhaseEstimationNamesCallback window_names_callback;
+    PhaseEstimationNamesCallback spatial_names_callback;
+    PhaseEstimationNumSamplesCallback num_samples_callback;
+
+    int downsampled_cols;
+
+    bool processing_pause = false;
+    phaseEstimateParameters currentPhaseEstParams;
+    phaseEstimateStates phaseEstStates;
+
+    int spatial_channel_index = 0;
+    int numOuterElectrodes = 4;
+    std::vector<bool> outerElectrodeCheckStates_;
+
+    int sequence_number = 0;
+    int n_EEG_channels_to_use = 5;      
+    int n_CWL_channels_to_use = 7;
+    int n_channels;
+    int samples_to_process;
+    int downsampling_factor;
+    int delay;
+    
+    // TODO: SNR check
+
+    size_t edge;
+    int filter2_length;
+    int edge_cut_cols;
+    int estimationLength;
+    size_t modelOrder;
+    size_t hilbertWinLength; 
+    double stimulation_target;
+    int phase_shift;
+    int wait_timeout_ms;
+
+    // Memory preallocation for preprocessing matrices
+    Eigen::MatrixXd EEG_corrected;
+    Eigen::VectorXd EEG_spatial;
+
+    // Input triggers
+    Eigen::VectorXi triggers_A;
+    Eigen::VectorXi triggers_B;
+    Eigen::VectorXi triggers_out;
+    VectorXi64 time_stamps;
+
+    // Latest window from handlePreprocessingOutput. Guarded by dataMutex; run() swaps it with the working copies above
+    // and reads only those.
+    Eigen::MatrixXd pending_EEG_corrected;
+    Eigen::VectorXi pending_triggers_A;
+    Eigen::VectorXi pending_triggers_B;
+    Eigen::VectorXi pending_triggers_out;
+    VectorXi64 pending_time_stamps;
+    int pending_samples_to_process = 0;
+    int pending_sequence_number = 0;
+    bool has_new_output = false;
+
+    Eigen::VectorXd LSFIR_coeffs_2;
+    coefficientExchange<Eigen::VectorXd> filter2_exchange;      // From setFilterBand
+    Eigen::VectorXd EEG_filter2;
+    std::vector<double> EEG_predicted;
+    std::vector<std::complex<double>> EEG_hilbert;
+    Eigen::VectorXd phaseAngles;
+
+    // Phase difference/error
+    std::vector<std::complex<double>> phase_diff_hilbert;
+    Eigen::VectorXd phaseDifference;
+    int phaseDifference_current_index = 0;
+    double last_phase = 0.0;
+    int last_phase_seqnum = -1;
+
+    int phaseErrorType = 0;
+    int display_length;
+    Eigen::MatrixXd EEG_win_data_to_display;
+    Eigen::MatrixXd Data_to_display;
+
+    Eigen::VectorXd Pxx = Eigen::VectorXd::Zero(256);
+    Eigen::MatrixXd Pxx_save = Eigen::MatrixXd::Zero(100, 256);
+    int Pxx_save_index = 0;
+    bool Pxx_save_done = false;
+
+    // Timing variables
+    std::chrono::duration<double> total_process_time{0};
+    std::chrono::duration<double> min_process_time{std::numeric_limits<double>::max()};
+    std::chrono::duration<double> max_process_time{std::numeric_limits<double>::min()};
+    int process_call_count = 0;
+
+    // Individual step timing
+    std::chrono::duration<double> total_spatial_time{0};
+    std::chrono::duration<double> total_filter_time{0};
+    std::chrono::duration<double> total_phase_est_time{0};
+    int step_call_count = 0;
+
+    int trigger_count = 0;
+};
+
+#endif // PHASEESTIMATIONPIPELINE_H
@@ -8,13 +8,10 @@ Eigen::MatrixXd GACorrection::getTemplateCols(int template_index, int num_bundle
     return correction_template_.middleCols(template_index, cols_to_take); 
 }
 
-void GACorrection::update_template(int template_index, const Eigen::VectorXd &samples) {
+void GACorrection::update_template(int template_index, const Eigen::Ref<const Eigen::VectorXd> &samples) {
 
-    Eigen::VectorXd Old_avg = correction_template_.col(template_index);
-
-    Eigen::VectorXd New_avg = Old_avg + (samples - sample_data_.col(sample_data_index_)) / template_avg_length_;
-
-    correction_template_.col(template_index) = New_avg;
+    // Running average update, done in place to avoid temporaries on the acquisition thread
+    correction_template_.col(template_index) += (samples - sample_data_.col(sample_data_index_)) / template_avg_length_;
 
     sample_data_.col(sample_data_index_) = samples;
     sample_data_index_ = (sample_data_index_ + 1) % number_of_samples_;
@@ -23,10 +23,10 @@ public:
         correction_template_ = Eigen::MatrixXd::Zero(channel_count_, TA_length);
     }
 
-    void update_template(int template_index, const Eigen::VectorXd &samples);
+    void update_template(int template_index, const Eigen::Ref<const Eigen::VectorXd> &samples);
     void reset_index() { sample_data_index_ = 0; }
 
-    Eigen::VectorXd getTemplateCol(int template_index) { return correction_template_.col(template_index); }
+    Eigen::MatrixXd::ConstColXpr getTemplateCol(int template_index) const { return correction_template_.col(template_index); }
     Eigen::MatrixXd getTemplateCols(int template_index, int num_bundles);
     int getTemplateSize() { return correction_template_.cols(); }
 
@@ -1,26 +1,63 @@
 #include "preprocessingFunctions.h"
 
-void MultiChannelRealTimeFilter::reset_filter(int numChannels) {
-    getLSFIRCoeffs_0_80Hz(filterCoeffs);
-    M = filterCoeffs.size();
-    buffers = Eigen::MatrixXd::Zero(M, numChannels);
+void MultiChannelRealTimeFilter::reset_filter(int numChannels, double samplingRate) {
+    filterSpec design;
+    {
+        std::lock_guard<std::mutex> lock(spec_mutex);
+        spec.fs = samplingRate;
+        design = spec;
+    }
+    std::shared_ptr<const filterCoefficients> filter = designFilter(design);
+
+    Eigen::VectorXd filterCoeffs;
+    if (filter) {
+        filterCoeffs = filter->b;
+    } else {
+        std::cerr << "Real-time filter: using the fixed 0-80 Hz FIR" << '\n';
+        getLSFIRCoeffs_0_80Hz(filterCoeffs);
+    }
+    filterBank.reset(filterCoeffs, numChannels, RT_FILTER_MAX_TAPS);
     filteredSamples = Eigen::VectorXd::Zero(numChannels);
 }
 
-// Process a new sample vector where each element is the current sample for a channel
-Eigen::VectorXd MultiChannelRealTimeFilter::processSample(const Eigen::VectorXd& newSamples) {
-    for (int ch = 0; ch < newSamples.size(); ++ch) {
-        // Move existing buffer data up one row
-        buffers.col(ch).tail(M - 1) = buffers.col(ch).head(M - 1);
-        buffers.col(ch)(0) = newSamples(ch);
+bool MultiChannelRealTimeFilter::setBand(double low, double high, int taps, double transition) {
+    filterSpec band = getSpec();
+    band.low = low;
+    band.high = high;
+    band.order = taps;
+    band.transition = transition;
+    if (taps > RT_FILTER_MAX_TAPS) {
+        std::cerr << "Real-time filter: at most " << RT_FILTER_MAX_TAPS << " taps, got " << taps << '\n';
+        return false;
+    }
+    if (band.fs <= 0) {
+        std::lock_guard<std::mutex> lock(spec_mutex);
+        spec = band;
+        return true;
+    }
 
-        // Apply the filter using Eigen dot product
-        filteredSamples(ch) = buffers.col(ch).dot(filterCoeffs);
+    std::shared_ptr<const filterCoefficients> filter = designFilter(band);
+    if (!filter || !filterBank.setCoefficients(filter->b)) return false;
+    {
+        std::lock_guard<std::mutex> lock(spec_mutex);
+        spec = band;
     }
+    std::cout << "Real-time filter set to " << band << '\n';
+    return true;
+}
+
+// Process a new sample vector where each element is the current sample for a channel
+Eigen::VectorXd MultiChannelRealTimeFilter::processSample(const Eigen::VectorXd& newSamples) {
+    filterBank.processSample(newSamples, filteredSamples);
     return filteredSamples;
 }
 
-// Function that returns fixed butterworth coefficients for a band pass of 0-80Hz
+// Filter a channels x samples block in place
+void MultiChannelRealTimeFilter::processBlock(Eigen::Ref<Eigen::MatrixXd> samples) {
+    filterBank.processBlock(samples);
+}
+
+// Function that returns fixed LS FIR coefficients for a low pass of 0-80Hz at 5 kHz, the default design of MultiChannelRealTimeFilter
 void getLSFIRCoeffs_0_80Hz(Eigen::VectorXd& coeffs) {
     coeffs.resize(81);
 
@@ -55,4 +92,77 @@ void downsample(const Eigen::MatrixXd& input, Eigen::MatrixXd& output, int facto
     }
 }
 
+// The new columns may be float samples from the ring, the output is always double
+template <typename InputType>
+static int downsampleNewColumns(const InputType& new_columns, int64_t first_sample_index, int factor, Eigen::MatrixXd& output) {
+    if (factor <= 0) {
+        throw std::invalid_argument("Downsampling factor must be greater than zero.");
+    }
+
+    int first = static_cast<int>((factor - first_sample_index % factor) % factor);
+    int newCols = first < new_columns.cols() ? (static_cast<int>(new_columns.cols()) - first + factor - 1) / factor : 0;
+    if (output.rows() != new_columns.rows() || output.cols() < newCols) output.resize(new_columns.rows(), newCols);
 
+    for (int j = first, col = 0; col < newCols; j += factor, ++col) {
+        output.col(col) = new_columns.col(j).template cast<double>();
+    }
+    return newCols;
+}
+
+int downsampleNew(const Eigen::Ref<const Eigen::MatrixXd>& new_columns, int64_t first_sample_index, int factor, Eigen::MatrixXd& output) {
+    return downsampleNewColumns(new_columns, first_sample_index, factor, output);
+}
+
+int downsampleNew(const Eigen::Ref<const Eigen::MatrixXf>& new_columns, int64_t first_sample_index, int factor, Eigen::MatrixXd& output) {
+    return downsampleNewColumns(new_columns, first_sample_index, factor, output);
+}
+
+// The windows are contiguous in memory, so the shift is a single memmove
+template <typename WindowType, typename InputType>
+static void slideMatrixWindow(WindowType& window, const InputType& new_columns) {
+    typedef typename WindowType::Scalar Scalar;
+    Eigen::Index n = new_columns.cols();
+    if (n >= window.cols()) {
+        window = new_columns.rightCols(window.cols()).template cast<Scalar>();
+        return;
+    }
+    Eigen::Index keep = window.cols() - n;
+    std::memmove(window.data(), window.data() + n * window.rows(), keep * window.rows() * sizeof(Scalar));
+    window.rightCols(n) = new_columns.template cast<Scalar>();
+}
+
+void slideWindow(Eigen::MatrixXd& window, const Eigen::Ref<const Eigen::MatrixXd>& new_columns) {
+    slideMatrixWindow(window, new_columns);
+}
+
+void slideWindow(Eigen::MatrixXf& window, const Eigen::Ref<const Eigen::MatrixXf>& new_columns) {
+    slideMatrixWindow(window, new_columns);
+}
+
+void slideWindow(Eigen::MatrixXd& window, const Eigen::Ref<const Eigen::MatrixXf>& new_columns) {
+    slideMatrixWindow(window, new_columns);
+}
+
+template <typename VectorType>
+static void slideVectorWindow(VectorType& window, const Eigen::Ref<const VectorType>& new_values) {
+    Eigen::Index n = new_values.size();
+    if (n >= window.size()) {
+        window = new_values.tail(window.size());
+        return;
+    }
+    Eigen::Index keep = window.size() - n;
+    std::memmove(window.data(), window.data() + n, keep * sizeof(typename VectorType::Scalar));
+    window.tail(n) = new_values;
+}
+
+void slideWindow(Eigen::VectorXd& window, const Eigen::Ref<const Eigen::VectorXd>& new_values) {
+    slideVectorWindow(window, new_values);
+}
+
+void slideWindow(Eigen::VectorXi& window, const Eigen::Ref<const Eigen::VectorXi>& new_values) {
+    slideVectorWindow(window, new_values);
+}
+
+void slideWindow(Eigen::Matrix<int64_t, Eigen::Dynamic, 1>& window, const Eigen::Ref<const Eigen::Matrix<int64_t, Eigen::Dynamic, 1>>& new_values) {
+    slideVectorWindow(window, new_values);
+}
@@ -2,23 +2,47 @@
 #define PREPROCESSINGFUNCTIONS_H
 
 #include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
 #include <Eigen/Dense>
 
-// Real-time filter processor class for multiple channels
+#include "../../math/firFilterBank.h"
+#include "../../math/filterDesign.h"
+
+// Longest FIR that setBand can switch to without resetting the filter
+#define RT_FILTER_MAX_TAPS 255
+
+/*
+Real-time filter processor class for multiple channels, an LS FIR on a firFilterBank. The FIR is designed for the
+sampling rate of the session, by default 0-80 Hz with 81 taps and the stop band from 250 Hz, which at 5 kHz is the
+fixed getLSFIRCoeffs_0_80Hz.
+*/
 class MultiChannelRealTimeFilter {
 private:
-    Eigen::VectorXd filterCoeffs;
-    Eigen::MatrixXd buffers;  // Buffer for each channel
+    firFilterBank filterBank;
     Eigen::VectorXd filteredSamples;
-    int M;
+    filterSpec spec{FILTER_DESIGN_LS_FIR, 0, 0, 80, 81, 170};
+    mutable std::mutex spec_mutex;      // setBand runs on the control thread, getSpec on any thread
 
 public:
     MultiChannelRealTimeFilter() { }
 
-    void reset_filter(int numChannels);
+    void reset_filter(int numChannels, double samplingRate);
+
+    // Retunes the filter while it runs. The design is swapped in without blocking the acquisition thread; before
+    // reset_filter the band is only stored. Returns false if the band can not be designed or taps exceed RT_FILTER_MAX_TAPS.
+    bool setBand(double low, double high, int taps, double transition = 0);
+    filterSpec getSpec() const {
+        std::lock_guard<std::mutex> lock(spec_mutex);
+        return spec;
+    }
 
     // Process a new sample vector where each element is the current sample for a channel
     Eigen::VectorXd processSample(const Eigen::VectorXd& newSamples);
+
+    // Filter a channels x samples block in place
+    void processBlock(Eigen::Ref<Eigen::MatrixXd> samples);
 };
 
 void getLSFIRCoeffs_0_80Hz(Eigen::VectorXd& coeffs);
@@ -26,4 +50,18 @@ void getLSFIRCoeffs_0_80Hz(Eigen::VectorXd& coeffs);
 
 void downsample(const Eigen::MatrixXd& input, Eigen::MatrixXd& output, int factor);
 
+// Downsample only newly arrived columns. Keeps the columns whose absolute sample index is a multiple of the factor,
+// so consecutive calls pick the same samples as a single call over the whole stream.
+int downsampleNew(const Eigen::Ref<const Eigen::MatrixXd>& new_columns, int64_t first_sample_index, int factor, Eigen::MatrixXd& output);
+int downsampleNew(const Eigen::Ref<const Eigen::MatrixXf>& new_columns, int64_t first_sample_index, int factor, Eigen::MatrixXd& output);
+
+// Sliding windows: shift the window left by the number of new columns and append the new columns at the end.
+// Float sample columns can be appended to double windows.
+void slideWindow(Eigen::MatrixXd& window, const Eigen::Ref<const Eigen::MatrixXd>& new_columns);
+void slideWindow(Eigen::MatrixXf& window, const Eigen::Ref<const Eigen::MatrixXf>& new_columns);
+void slideWindow(Eigen::MatrixXd& window, const Eigen::Ref<const Eigen::MatrixXf>& new_columns);
+void slideWindow(Eigen::VectorXd& window, const Eigen::Ref<const Eigen::VectorXd>& new_values);
+void slideWindow(Eigen::VectorXi& window, const Eigen::Ref<const Eigen::VectorXi>& new_values);
+void slideWindow(Eigen::Matrix<int64_t, Eigen::Dynamic, 1>& window, const Eigen::Ref<const Eigen::Matrix<int64_t, Eigen::Dynamic, 1>>& new_values);
+
 #endif // PREPROCESSINGFUNCTIONS_H
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include "preprocessingPipeline.h"
+
+
+void signalHandlerPrep(int signal) {
+    std::cerr << "Error: Segmentation fault (signal " << signal << ")\n";
+    std::exit(signal);  // Exit the program
+}
+
+preprocessingPipeline::preprocessingPipeline(dataHandler &handler, 
+                    volatile std::sig_atomic_t &processingWorkerRunning, 
+                       preprocessingParameters &prepParams_in)
+    : handler(handler), 
+      processingWorkerRunning(processingWorkerRunning)
+{ 
+    setParameters(prepParams_in);
+}
+
+void preprocessingPipeline::setParameters(preprocessingParameters newParams) {
+    std::cout << "New preprocessingParameters Parameters: " << newParams << std::endl;
+    currentPrepParams = newParams;
+
+    // The reset count is read first, so a reset after it is detected by run()
+    handler_reset_count = handler.getResetCount();
+    n_channels = handler.get_channel_count();
+
+    samples_to_process = newParams.numberOfSamples;
+    downsampling_factor = newParams.downsampling_factor;
+    downsampled_cols = (samples_to_process + downsampling_factor - 1) / downsampling_factor;
+    delay = newParams.delay;
+    wait_timeout_ms = newParams.wait_timeout_ms;
+    handler.setWakeGranularity(newParams.wake_granularity);
+
+    print_debug("Params initialized");
+
+    // Memory preallocation for preprocessing matrices
+    all_channels = SampleMatrix::Zero(n_channels, samples_to_process);
+    EEG_downsampled = Eigen::MatrixXd::Zero(n_channels, downsampled_cols);
+    expCWL = Eigen::MatrixXd::Zero(n_CWL_channels_to_use * (1+2*delay), downsampled_cols);
+    pinvCWL = Eigen::MatrixXd::Zero(downsampled_cols, downsampled_cols);
+    EEG_corrected = Eigen::MatrixXd::Zero(n_EEG_channels_to_use, downsampled_cols);
+
+    // Input triggers
+    triggers_A = Eigen::VectorXi::Zero(samples_to_process);
+    triggers_B = Eigen::VectorXi::Zero(samples_to_process);
+    triggers_out = Eigen::VectorXi::Zero(samples_to_process);
+    time_stamps = VectorXi64::Zero(samples_to_process);
+    valid = Eigen::VectorXi::Ones(samples_to_process);
+    invalid_samples_in_window = 0;
+
+    // Samples appended since the previous iteration. The windows above are refilled from the latest samples.
+    read_cursor = 0;
+    new_channels = SampleMatrix::Zero(n_channels, samples_to_process);
+    new_triggers_A = Eigen::VectorXi::Zero(samples_to_process);
+    new_triggers_B = Eigen::VectorXi::Zero(samples_to_process);
+    new_triggers_out = Eigen::VectorXi::Zero(samples_to_process);
+    new_time_stamps = VectorXi64::Zero(samples_to_process);
+    new_arrival_times = VectorXi64::Zero(samples_to_process);
+    new_valid = Eigen::VectorXi::Ones(samples_to_process);
+    new_downsampled = Eigen::MatrixXd::Zero(n_channels, downsampled_cols);
+
+    EEG_win_data_to_display = Eigen::MatrixXd::Zero(n_channels, samples_to_process);
+
+    print_debug("Memory allocated");
+}
+
+void preprocessingPipeline::run()
+{
+    std::signal(SIGSEGV, signalHandlerPrep);
+
+    int number_of_threads = std::thread::hardware_concurrency() - 4;
+    Eigen::setNbThreads(number_of_threads);
+    omp_set_num_threads(number_of_threads);
+    
+    int eigen_threads = Eigen::nbThreads();
+    std::cout << "Eigen is using " << eigen_threads << " threads." << std::endl;
+
+    std::cout << "preProcessingWorker start" << '\n';
+
+    print_debug("Channel names set");
+
+    while(processingWorkerRunning) {
+        if (processing_pause) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+
+        // A new measurement may have a different channel count, and the read cursor refers to the previous ring
+        if (handler.getResetCount() != handler_reset_count) {
+            std::cout << "Data handler was reset, preprocessing buffers are reallocated" << '\n';
+            setParameters(currentPrepParams);
+        }
+
+        // Sleep until the acquisition thread publishes new samples
+        if (!handler.waitForNewData(read_cursor, wait_timeout_ms)) continue;
+
+        // Time the removeBCG function
+        auto start = std::chrono::high_resolution_clock::now();
+        
+        print_debug("Processing start");
+
+        // Only the samples published since the previous iteration are copied from the ring
+        int sequence_number;
+        int new_samples = handler.getNewDataAndTriggers(read_cursor, new_channels, new_triggers_A, new_triggers_B, new_triggers_out, new_time_stamps, new_arrival_times, new_valid, samples_to_process, sequence_number);
+
+        // Check if current sample is processed
+        if (new_samples == 0) {
+            print_debug("Sample is already processed");
+            continue;
+        }
+
+        // The handler was reset after the check above, the samples belong to the new measurement
+        if (new_channels.rows() != n_channels) continue;
+
+        print_debug("Checks passed");
+
+        slideWindow(all_channels, new_channels.leftCols(new_samples));
+        slideWindow(triggers_A, new_triggers_A.head(new_samples));
+        slideWindow(triggers_B, new_triggers_B.head(new_samples));
+        slideWindow(triggers_out, new_triggers_out.head(new_samples));
+        slideWindow(time_stamps, new_time_stamps.head(new_samples));
+        slideWindow(valid, new_valid.head(new_samples));
+        invalid_samples_in_window = samples_to_process - valid.sum();
+
+        // Downsampling of the new samples only
+        print_debug("Downsampling");
+        int new_downsampled_cols = new_samples;
+        if (downsampling_factor > 1) {
+            new_downsampled_cols = downsampleNew(new_channels.leftCols(new_samples), read_cursor - new_samples, downsampling_factor, new_downsampled);
+            if (new_downsampled_cols > 0) slideWindow(EEG_downsampled, new_downsampled.leftCols(new_downsampled_cols));
+        } else {
+            slideWindow(EEG_downsampled, new_channels.leftCols(new_samples));
+        }
+
+        // CWL
+        print_debug("Performing removeBCG");
+        if (performRemoveBCG) {
+        
+            print_debug("Delay Embedding");
+            if (delay > 0) { delayEmbed(EEG_downsampled.middleRows(n_EEG_channels_to_use, n_CWL_channels_to_use), expCWL, delay); } 
+            else { expCWL = EEG_downsampled.middleRows(n_EEG_channels_to_use, n_CWL_channels_to_use); }
+
+            print_debug("removeBCG");
+            removeBCG(EEG_downsampled.topRows(n_EEG_channels_to_use), expCWL, pinvCWL, EEG_corrected);
+
+            // Update the EEG window graph data
+            if (EEG_downsampled.cols() != EEG_win_data_to_display.cols()) EEG_win_data_to_display.resize(EEG_win_data_to_display.rows(), EEG_downsampled.cols());
+
+            EEG_win_data_to_display.topRows(EEG_corrected.rows()) = EEG_corrected;
+            EEG_win_data_to_display.bottomRows(EEG_downsampled.rows() - n_EEG_channels_to_use) = EEG_downsampled.bottomRows(EEG_downsampled.rows() - n_EEG_channels_to_use);
+
+
+        } else {
+            EEG_corrected = EEG_downsampled.topRows(n_EEG_channels_to_use);
+            EEG_win_data_to_display = EEG_downsampled;
+        }
+
+        int cols_to_save = new_downsampled_cols;
+        if (cols_to_save > 0 && cols_to_save <= EEG_corrected.cols()) {
+            // Eigen::MatrixXd output_matrix = EEG_corrected.rightCols(cols_to_save);
+            if (save_callback) save_callback(EEG_corrected.rightCols(cols_to_save));
+        } else {
+            print_debug("Skipping save - invalid column parameters");
+        }
+
+        // Phase estimation is not fed while placeholders of lost packets are inside the window
+        if (invalid_samples_in_window == 0) {
+            handler.getTracer().stamp(TRACE_PREPROCESSING, sequence_number);
+            if (output_callback) output_callback(EEG_corrected, triggers_A, triggers_B, triggers_out, time_stamps, samples_to_process, sequence_number);
+        } else {
+            print_debug("Window contains lost packets, phase estimation skipped");
+        }
+
+        if (display_callback) display_callback(EEG_win_data_to_display, triggers_A, triggers_B, time_stamps, handler.getChannelNames());
+
+        // Save C3
+        // if (save_seqnum_tracker + 10000 < sequence_number) {
+        //     C3_save.row(save_index) = EEG_corrected.row(0);
+        //     save_index++;
+        //     save_seqnum_tracker = sequence_number;
+        // }
+        
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> duration = end - start;  // Explicitly specify duration type
+        if(sequence_number > 100000) {
+            total_bcg_time += duration;
+            min_bcg_time = std::min(min_bcg_time, duration);
+            max_bcg_time = std::max(max_bcg_time, duration);
+            bcg_call_count++;
+
+            // The arrival times are CLOCK_REALTIME, 0 when the receive time was not available
+            int64_t arrival_time = new_arrival_times(new_samples - 1);
+            if (arrival_time > 0) {
+                int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                double latency = (now - arrival_time) * 1e-9;
+                total_arrival_latency += latency;
+                max_arrival_latency = std::max(max_arrival_latency, latency);
+                arrival_latency_count++;
+            }
+        }
+    }
+
+    // Print timing statistics when exiting the loop
+    if (bcg_call_count > 0) {
+        double avg_time = total_bcg_time.count() / bcg_call_count;
+        double min_time = min_bcg_time.count();
+        double max_time = max_bcg_time.count();
+        
+        std::cout << "removeBCG statistics:\n"
+                  << "Total calls: " << bcg_call_count << "\n"
+                  << "Average time: " << avg_time * 1000 << " ms\n"
+                  << "Minimum time: " << min_time * 1000 << " ms\n"
+                  << "Maximum time: " << max_time * 1000 << " ms\n";
+    }
+    if (arrival_latency_count > 0) {
+        std::cout << "Packet arrival to preprocessing output latency:\n"
+                  << "Average: " << getAverageArrivalLatency() * 1000 << " ms\n"
+                  << "Maximum: " << max_arrival_latency * 1000 << " ms\n";
+    }
+
+    // writeMatrixdToCSV("C3_save.csv", C3_save);
+}
+
+
+
+
+
+
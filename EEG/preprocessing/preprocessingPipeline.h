@@ -0,0 +1,159 @@
+#ifndef PREPROCESSINGPIPELINE_H
+#define PREPROCESSINGPIPELINE_H
+
+#include <csignal>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>    // For M_PI
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <limits>
+#include <omp.h>
+#include "dataHandler/dataHandler.h"
+#include "preprocessingFunctions.h"
+#include "removeBCG.h"
+#include "math/dsp.h"
+
+struct preprocessingParameters {
+
+    // Number of samples to use for the processing
+    int numberOfSamples = 10000;
+
+    //  downsampling
+    int downsampling_factor = 10;
+
+    // removeBCG
+    int delay = 5;
+
+    // Wakeups: the worker is woken every wake_granularity samples and checks for shutdown every wait_timeout_ms
+    int wake_granularity = 1;
+    int wait_timeout_ms = 100;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const preprocessingParameters& prepParams) {
+    os << "Number of Samples: " << prepParams.numberOfSamples
+       << "\nDownsampling Factor: " << prepParams.downsampling_factor
+       << "\nDelay: " << prepParams.delay
+       << "\nWake granularity: " << prepParams.wake_granularity
+       << "\nWait timeout: " << prepParams.wait_timeout_ms << " ms";
+    return os;
+}
+
+// Outputs of the preprocessing loop. Unset callbacks are skipped.
+typedef std::function<void(const Eigen::MatrixXd &output,
+                           const Eigen::VectorXi &triggers_A,
+                           const Eigen::VectorXi &triggers_B,
+                           const Eigen::VectorXi &triggers_out,
+                           const VectorXi64 &time_stamps,
+                           int number_of_samples,
+                           int seq_num)> PreprocessingOutputCallback;
+typedef std::function<void(const Eigen::MatrixXd &output)> PreprocessingSaveCallback;
+typedef std::function<void(const Eigen::MatrixXd &newMatrix,
+                           const Eigen::VectorXi &triggers_A,
+                           const Eigen::VectorXi &triggers_B,
+                           const VectorXi64 &time_stamps,
+                           std::vector<std::string> processing_channel_names)> PreprocessingDisplayCallback;
+
+/*
+Preprocessing loop without Qt. Reads new samples from the dataHandler ring, downsamples them, removes the BCG
+artifact and passes the window to the callbacks. Used by preProcessingWorker and the headless pipeline.
+*/
+class preprocessingPipeline {
+public:
+    preprocessingPipeline(dataHandler &handler, 
+                volatile std::sig_atomic_t &processingWorkerRunning, 
+                   preprocessingParameters &prepParams_in);
+
+    // Runs until processingWorkerRunning is cleared
+    void run();
+
+    void setParameters(preprocessingParameters newParams);
+    preprocessingParameters getParameters() { return currentPrepParams; }
+
+    void setRemoveBCG(bool isChecked) { performRemoveBCG = isChecked; }
+    bool getRemoveBCG() { return performRemoveBCG; }
+    void setPause(bool pause) { processing_pause = pause; }
+
+    void setOutputCallback(PreprocessingOutputCallback callback) { output_callback = callback; }
+    void setSaveCallback(PreprocessingSaveCallback callback) { save_callback = callback; }
+    void setDisplayCallback(PreprocessingDisplayCallback callback) { display_callback = callback; }
+
+    // Timing of the processing iterations (seconds)
+    int getIterationCount() { return bcg_call_count; }
+    double getAverageTime() { return bcg_call_count > 0 ? total_bcg_time.count() / bcg_call_count : 0; }
+    double getMinimumTime() { return min_bcg_time.count(); }
+    double getMaximumTime() { return max_bcg_time.count(); }
+    double getAverageArrivalLatency() { return arrival_latency_count > 0 ? total_arrival_latency / arrival_latency_count : 0; }
+    double getMaximumArrivalLatency() { return max_arrival_latency; }
+
+private:
+    const bool debug = false;
+    void print_debug(std::string msg) {
+        if (debug) std::cout << msg << std::endl;
+    };
+
+    dataHandler &handler;
+    volatile std::sig_atomic_t &processingWorkerRunning;
+
+    PreprocessingOutputCallback output_callback;
+    PreprocessingSaveCallback save_callback;
+    PreprocessingDisplayCallback display_callback;
+
+    bool performRemoveBCG = false;
+
+    bool processing_pause = false;
+    preprocessingParameters currentPrepParams;
+    int n_EEG_channels_to_use = 5;      
+    int n_CWL_channels_to_use = 7;
+    int n_channels;
+    int samples_to_process;
+    int downsampling_factor;
+    int downsampled_cols;
+    int delay;
+    int wait_timeout_ms;
+
+    // Memory preallocation for preprocessing matrices
+    SampleMatrix all_channels;
+    Eigen::MatrixXd EEG_downsampled;
+    Eigen::MatrixXd expCWL;
+    Eigen::MatrixXd pinvCWL;
+    Eigen::MatrixXd EEG_corrected;
+
+    // Input triggers
+    Eigen::VectorXi triggers_A;
+    Eigen::VectorXi triggers_B;
+    Eigen::VectorXi triggers_out;
+    VectorXi64 time_stamps;
+    Eigen::VectorXi valid;                      // 0 for placeholders of lost packets
+    int invalid_samples_in_window = 0;
+
+    Eigen::MatrixXd EEG_win_data_to_display;
+
+    // Incremental reads from the dataHandler ring
+    int64_t read_cursor = 0;
+    int handler_reset_count = 0;        // getResetCount() of the handler the buffers were sized for
+    SampleMatrix new_channels;
+    Eigen::VectorXi new_triggers_A;
+    Eigen::VectorXi new_triggers_B;
+    Eigen::VectorXi new_triggers_out;
+    VectorXi64 new_time_stamps;
+    VectorXi64 new_arrival_times;
+    Eigen::VectorXi new_valid;
+    Eigen::MatrixXd new_downsampled;
+
+    // Add timing variables for removeBCG
+    std::chrono::duration<double> total_bcg_time{0};
+    std::chrono::duration<double> min_bcg_time{std::numeric_limits<double>::max()};
+    std::chrono::duration<double> max_bcg_time{std::numeric_limits<double>::min()};
+    int bcg_call_count = 0;
+
+    // Time from the kernel receive time of the newest packet to the end of its processing (s)
+    double total_arrival_latency = 0;
+    double max_arrival_latency = 0;
+    int arrival_latency_count = 0;
+};
+
+#endif // PREPROCESSINGPIPELINE_H
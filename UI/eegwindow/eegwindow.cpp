@@ -95,7 +95,7 @@ void eegWindow::updateData()
         Eigen::VectorXi triggers_A;
         Eigen::VectorXi triggers_B;
         Eigen::VectorXi triggers_out;
-        Eigen::VectorXd time_stamps;
+        VectorXi64 time_stamps;
         handler.getLatestDataAndTriggers(data, triggers_A, triggers_B, triggers_out, time_stamps, samples_to_display);
         glWidget->updateMatrix(data, triggers_A, triggers_B, time_stamps, handler.getChannelNames());
     }
@@ -4,6 +4,7 @@
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
 #include <QTimer>
+#include <QDebug>
 #include <QLabel>
 #include <algorithm>
 #include "../dataHandler/dataHandler.h"
@@ -32,7 +33,7 @@ public slots:
     void updateMatrix(const Eigen::MatrixXd &newMatrix, 
                       const Eigen::VectorXi &triggers_A, 
                       const Eigen::VectorXi &triggers_B, 
-                      const Eigen::VectorXd &time_stamps,
+                      const VectorXi64 &time_stamps,
                    std::vector<std::string> processing_channel_names);
     
     void updateChannelDisplayState(std::vector<bool> channelCheckStates);
@@ -64,7 +65,7 @@ private:
     Eigen::MatrixXd dataMatrix_;
     Eigen::VectorXi triggers_A_;
     Eigen::VectorXi triggers_B_;
-    Eigen::VectorXd time_stamps_;
+    VectorXi64 time_stamps_;
     std::vector<bool> channelCheckStates_;
     bool draw_channel_scales = false;
     bool show_triggers_A = true;
@@ -0,0 +1,31 @@
+#include "dataHandlerSignals.h"
+
+DataHandlerSignals::DataHandlerSignals(dataHandler &handler, QObject *parent)
+    : QObject(parent),
+      handler(handler)
+{
+    handler.setChannelNamesCallback([this](const std::vector<std::string> &channel_names) {
+        emit channelNamesUpdated(channel_names);
+    });
+
+    handler.setChannelDataCallback([this](int channel, const Eigen::VectorXd &data,
+                                          const Eigen::VectorXi &triggers_A,
+                                          const Eigen::VectorXi &triggers_B,
+                                          const Eigen::VectorXi &triggers_out,
+                                          const VectorXi64 &time_stamps,
+                                          const size_t &data_index,
+                                          std::string source_name) {
+        emit channelDataUpdated(channel, data, triggers_A, triggers_B, triggers_out, time_stamps, data_index, source_name);
+    });
+
+    // Signal viewer refresh in the GUI thread
+    timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, [this]() { this->handler.updateSignalViewerData(); });
+    timer->start(16);
+}
+
+DataHandlerSignals::~DataHandlerSignals()
+{
+    handler.setChannelNamesCallback(nullptr);
+    handler.setChannelDataCallback(nullptr);
+}
@@ -0,0 +1,35 @@
+#ifndef DATAHANDLERSIGNALS_H
+#define DATAHANDLERSIGNALS_H
+
+#include <QObject>
+#include <QTimer>
+#include <Eigen/Dense>
+#include "../dataHandler/dataHandler.h"
+
+// Qt side of the dataHandler. Turns the handler callbacks into signals and refreshes the signal viewers.
+class DataHandlerSignals : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DataHandlerSignals(dataHandler &handler, QObject *parent = nullptr);
+    ~DataHandlerSignals();
+
+signals:
+    void channelNamesUpdated(const std::vector<std::string>& channelNames);
+    void channelDataUpdated(int channel, const Eigen::VectorXd &data, 
+                           const Eigen::VectorXi &triggers_A, 
+                           const Eigen::VectorXi &triggers_B, 
+                           const Eigen::VectorXi &triggers_out, 
+                           const VectorXi64 &time_stamps, 
+                                    const size_t &data_index,
+                                     std::string source_name);
+
+public slots:
+    void savePreprocessingOutput(const Eigen::MatrixXd &output) { handler.savePreprocessingOutput(output); }
+
+private:
+    dataHandler &handler;
+    QTimer *timer = nullptr;
+};
+
+#endif // DATAHANDLERSIGNALS_H
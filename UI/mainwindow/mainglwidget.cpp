@@ -275,7 +275,7 @@ void MainGlWidget::updateGraph()
 
 void MainGlWidget::setSignalSource(int sourceIndex)
 {
-    if (!dataHandler_) return;
+    if (!dataHandler_ || !dataHandlerSignals_) return;
 
     disconnectCurrentSource();
     
@@ -288,12 +288,12 @@ void MainGlWidget::setSignalSource(int sourceIndex)
 
     if (sourceIndex >= 0 && sourceIndex < numRawChannels + numROIChannels) {
         // Handle raw channels (0 to numRawChannels-1)
-        currentConnection = connect(dataHandler_, &dataHandler::channelDataUpdated,
+        currentConnection = connect(dataHandlerSignals_, &DataHandlerSignals::channelDataUpdated,
             this, [this, sourceIndex](int channel, const Eigen::VectorXd &data,
                                     const Eigen::VectorXi &triggersA,
                                     const Eigen::VectorXi &triggersB,
                                     const Eigen::VectorXi &triggersOut,
-                                    const Eigen::VectorXd &timeStamps,
+                                    const VectorXi64 &timeStamps,
                                     const size_t &data_index,
                                     std::string sourceName) {
                 if (channel == sourceIndex) {
@@ -315,7 +315,7 @@ void MainGlWidget::updateData(const Eigen::VectorXd &newData,
                             const Eigen::VectorXi &triggers_A, 
                             const Eigen::VectorXi &triggers_B, 
                             const Eigen::VectorXi &triggers_out, 
-                            const Eigen::VectorXd &time_stamps,
+                            const VectorXi64 &time_stamps,
                             const size_t &data_index,
                             std::string source_name)
 {
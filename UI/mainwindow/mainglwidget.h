@@ -13,6 +13,7 @@
 #include <QFont>
 
 #include "../dataHandler/dataHandler.h"
+#include "dataHandlerSignals.h"
 #include <image/image.h>
 #include <image/image_operators.h>
 #include <image/orientation.h>
@@ -29,7 +30,10 @@ public:
     };
 
     explicit MainGlWidget(QWidget *parent = nullptr);
-    void setDataHandler(dataHandler* handler) { dataHandler_ = handler; }
+    void setDataHandler(dataHandler* handler, DataHandlerSignals* handlerSignals) {
+        dataHandler_ = handler;
+        dataHandlerSignals_ = handlerSignals;
+    }
 
 protected:
     void initializeGL() override;
@@ -44,7 +48,7 @@ public slots:
                     const Eigen::VectorXi &triggers_A, 
                     const Eigen::VectorXi &triggers_B, 
                     const Eigen::VectorXi &triggers_out, 
-                    const Eigen::VectorXd &time_stamps,
+                    const VectorXi64 &time_stamps,
                              const size_t &data_index,
                               std::string source_name);
     void setTriggerAVisible(bool visible) { show_triggers_A = visible; }
@@ -62,7 +66,7 @@ private:
     Eigen::VectorXi triggers_A_;
     Eigen::VectorXi triggers_B_;
     Eigen::VectorXi triggers_out_;
-    Eigen::VectorXd time_stamps_;
+    VectorXi64 time_stamps_;
     int data_index_;
     bool draw_channel_scales = false;
     bool show_triggers_A = false;
@@ -89,6 +93,7 @@ private:
     void connectToSource(const QString &source);
     
     dataHandler* dataHandler_ = nullptr;
+    DataHandlerSignals* dataHandlerSignals_ = nullptr;
     QMetaObject::Connection currentConnection;
     QString currentSource;
 
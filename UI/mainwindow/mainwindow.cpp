@@ -72,7 +72,8 @@ MainWindow::MainWindow(dataHandler &handler, volatile std::sig_atomic_t &signal_
     setProperty("signalSources", QVariant::fromValue(signalSources));
 
     // Add this connection
-    connect(&handler, &dataHandler::channelNamesUpdated, this, &MainWindow::updateEEGChannels);
+    handlerSignals = new DataHandlerSignals(handler, this);
+    connect(handlerSignals, &DataHandlerSignals::channelNamesUpdated, this, &MainWindow::updateEEGChannels);
 
     // Add connection for MRI ROI updates
     if (MRIwin && MRIwin->getGlWidget()) {
@@ -323,7 +324,7 @@ void MainWindow::connect_EEG_Prepworker()
     QObject::connect(eegwindow, &eegWindow::sendPrepStates, preProcessingworker, &preProcessingWorker::setPreprocessingParameters);
     QObject::connect(eegwindow, &eegWindow::setRemoveBCG, preProcessingworker, &preProcessingWorker::setRemoveBCG);
     QObject::connect(eegwindow, &eegWindow::set_processing_pause, preProcessingworker, &preProcessingWorker::set_processing_pause);
-    QObject::connect(preProcessingworker, &preProcessingWorker::savePreprocessingOutput, &handler, &dataHandler::savePreprocessingOutput);
+    QObject::connect(preProcessingworker, &preProcessingWorker::savePreprocessingOutput, handlerSignals, &DataHandlerSignals::savePreprocessingOutput);
 }
 
 void MainWindow::resetProcessingWindowPointer() {
@@ -443,7 +444,7 @@ void MainWindow::addSignalViewer()
 
     // Create the content of the dock widget
     MainGlWidget* mainglWidget = new MainGlWidget(dockWidget);
-    mainglWidget->setDataHandler(&handler);
+    mainglWidget->setDataHandler(&handler, handlerSignals);
 
     // Set size policies to allow expansion
     dockWidget->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
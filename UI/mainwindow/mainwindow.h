@@ -24,6 +24,7 @@
 #include "mainglwidget.h"
 #include "customTitleBar.h"
 #include "../dataHandler/dataHandler.h"
+#include "dataHandlerSignals.h"
 #include "eegwindow/eegwindow.h"
 #include "phaseEstimationwindow/phaseEstwindow.h"
 #include "TMSwindow/TMSwindow.h"
@@ -147,6 +148,7 @@ private:
 
     // Handler parameters
     dataHandler &handler;
+    DataHandlerSignals *handlerSignals = nullptr;
 
     bool preprocessingWorkerRunning = false;
     bool phaseEstWorkerRunning = false;
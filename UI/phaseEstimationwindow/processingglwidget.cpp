@@ -238,7 +238,7 @@ void ProcessingGlWidget::updateMatrix(const Eigen::MatrixXd &newMatrix,
                                       const Eigen::VectorXi &triggers_A, 
                                       const Eigen::VectorXi &triggers_B, 
                                       const Eigen::VectorXi &triggers_out, 
-                                      const Eigen::VectorXd &time_stamps,
+                                      const VectorXi64 &time_stamps,
                                                         int numPastElements, 
                                                         int numFutureElements) 
 {
@@ -35,7 +35,7 @@ public slots:
                       const Eigen::VectorXi &triggers_A, 
                       const Eigen::VectorXi &triggers_B, 
                       const Eigen::VectorXi &triggers_out, 
-                      const Eigen::VectorXd &time_stamps,
+                      const VectorXi64 &time_stamps,
                                         int numPastElements, 
                                         int numFutureElements);
 
@@ -82,7 +82,7 @@ private:
     Eigen::VectorXi triggers_A_;
     Eigen::VectorXi triggers_B_;
     Eigen::VectorXi triggers_out_;
-    Eigen::VectorXd time_stamps_;
+    VectorXi64 time_stamps_;
     std::vector<bool> channelCheckStates_;
     bool draw_channel_scales = true;
     bool show_triggers_A = true;
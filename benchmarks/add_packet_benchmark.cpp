@@ -0,0 +1,162 @@
+/*
+Compares the ways the acquisition thread stores a NeurOne sample packet in the dataHandler (dataHandler/dataHandler.cpp):
+
+    per sample   the packet is decoded with deserializeSamplePacketEigen_pointer and every bundle is added with addData,
+                 as the receiver did before the block path
+    block        the decoded packet is added with addPacket
+    in place     addSamplePacket decodes the packet straight into the ring and runs the block path on the ring columns
+
+The stages of the handler are run in three configurations: no stages, FIR filter and geometric sum, and the same with
+the gradient artifact and baseline correction. The time is per bundle and includes the decoding. The last column is the
+largest difference between the rings of the per sample and block paths. It is zero without the FIR filter; the block
+FIR sums the taps in a different order, which changes the last bits.
+
+Usage: add_packet_benchmark [--channels 13,33,65] [--bundles 5] [--packets 40000]
+*/
+
+#include "dataHandler/dataHandler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const int SAMPLING_RATE = 5000;
+static const int TRIGGER_INTERVAL = 10000;      // Packets between the volume triggers of the GA correction
+static const double GAIN = 100;
+static const double DIVISOR = 1000;
+
+enum stageConfiguration {
+    STAGES_OFF,
+    STAGES_FILTER,
+    STAGES_GA
+};
+
+static const char *STAGE_NAMES[] = {"none", "filter", "GA + filter"};
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<int> parseList(const std::string &list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+// Sample packet with random samples and a volume trigger in the first bundle of every TRIGGER_INTERVAL packet
+static std::vector<uint8_t> samplePacketBuffer(uint32_t SeqNo, int num_channels, int num_bundles, std::mt19937 &generator) {
+    std::vector<uint8_t> buffer(28 + 3 * num_channels * num_bundles);
+    for (auto &byte : buffer) byte = static_cast<uint8_t>(generator());
+    std::memset(buffer.data(), 0, 28);
+    buffer[0] = 19;
+    buffer[4] = SeqNo >> 24;
+    buffer[5] = SeqNo >> 16;
+    buffer[6] = SeqNo >> 8;
+    buffer[7] = SeqNo;
+    buffer[9] = num_channels;
+    buffer[8] = num_channels >> 8;
+    buffer[11] = num_bundles;
+    buffer[10] = num_bundles >> 8;
+
+    for (int bundle = 0; bundle < num_bundles; bundle++) {
+        uint8_t *trigger = buffer.data() + 28 + 3 * (bundle * num_channels + num_channels - 1);
+        trigger[0] = trigger[1] = trigger[2] = 0;
+        if (SeqNo % TRIGGER_INTERVAL == 1 && bundle == 0) trigger[2] = 0x02;
+    }
+    return buffer;
+}
+
+static void configure(dataHandler &handler, int num_data_channels, stageConfiguration stages) {
+    handler.reset_handler(num_data_channels, SAMPLING_RATE);
+    handler.setFilterState(stages != STAGES_OFF);
+    handler.setGeometricSumState(stages != STAGES_OFF);
+    if (stages == STAGES_GA) {
+        handler.reset_GACorr(SAMPLING_RATE, 3);
+        handler.GACorr_on();
+        handler.setBaselineState(true);
+    } else {
+        handler.GACorr_off();
+        handler.setBaselineState(false);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> channel_counts = {13, 33, 65};
+    int num_bundles = 5;
+    int num_packets = 40000;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--channels") && i + 1 < argc) channel_counts = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--bundles") && i + 1 < argc) num_bundles = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--packets") && i + 1 < argc) num_packets = std::atoi(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--channels 13,33,65] [--bundles 5] [--packets 40000]" << '\n';
+            return 1;
+        }
+    }
+
+    printf("%8s %12s %14s %10s %11s %10s\n", "channels", "stages", "per sample us", "block us", "in place us", "max diff");
+    for (int num_channels : channel_counts) {
+        // The last channel is the trigger channel
+        if (num_channels < 2 || num_channels * num_bundles > static_cast<int>(MAX_PACKET_SAMPLES)) continue;
+        int num_data_channels = num_channels - 1;
+
+        std::mt19937 generator(1);
+        std::vector<std::vector<uint8_t>> packets;
+        for (int SeqNo = 1; SeqNo <= num_packets; SeqNo++) packets.push_back(samplePacketBuffer(SeqNo, num_channels, num_bundles, generator));
+
+        for (int stages = STAGES_OFF; stages <= STAGES_GA; stages++) {
+            dataHandler per_sample, block, in_place;
+            configure(per_sample, num_data_channels, static_cast<stageConfiguration>(stages));
+            configure(block, num_data_channels, static_cast<stageConfiguration>(stages));
+            configure(in_place, num_data_channels, static_cast<stageConfiguration>(stages));
+
+            sample_packet packet;
+            Eigen::MatrixXd decoded = Eigen::MatrixXd::Zero(num_data_channels, num_bundles);
+            Eigen::VectorXi triggers_A, triggers_B;
+            double per_sample_time = 0, block_time = 0, in_place_time = 0;
+
+            for (int SeqNo = 1; SeqNo <= num_packets; SeqNo++) {
+                const std::vector<uint8_t> &buffer = packets[SeqNo - 1];
+
+                auto start = std::chrono::steady_clock::now();
+                deserializeSamplePacketEigen_pointer(buffer.data(), buffer.size(), packet, decoded, triggers_A, triggers_B, true);
+                decoded = (decoded * GAIN) / DIVISOR;
+                for (int bundle = 0; bundle < num_bundles; bundle++) {
+                    per_sample.addData(decoded.col(bundle), packet.FirstSampleTime, triggers_A(bundle), triggers_B(bundle), SeqNo);
+                }
+                per_sample_time += secondsSince(start);
+
+                start = std::chrono::steady_clock::now();
+                deserializeSamplePacketEigen_pointer(buffer.data(), buffer.size(), packet, decoded, triggers_A, triggers_B, true);
+                decoded = (decoded * GAIN) / DIVISOR;
+                block.addPacket(decoded, packet.FirstSampleTime, triggers_A, triggers_B, SeqNo);
+                block_time += secondsSince(start);
+
+                start = std::chrono::steady_clock::now();
+                in_place.addSamplePacket(buffer.data(), buffer.size(), true, GAIN, DIVISOR);
+                in_place_time += secondsSince(start);
+            }
+
+            Eigen::MatrixXd per_sample_ring, block_ring;
+            Eigen::VectorXi A, B, out;
+            VectorXi64 time_stamps;
+            int ring_samples = std::min(num_packets * num_bundles, per_sample.get_buffer_capacity());
+            per_sample.getLatestDataAndTriggers(per_sample_ring, A, B, out, time_stamps, ring_samples);
+            block.getLatestDataAndTriggers(block_ring, A, B, out, time_stamps, ring_samples);
+            double difference = (per_sample_ring - block_ring).cwiseAbs().maxCoeff();
+
+            double bundles = static_cast<double>(num_packets) * num_bundles;
+            printf("%8d %12s %14.3f %10.3f %11.3f %10.2e\n", num_channels, STAGE_NAMES[stages],
+                   per_sample_time / bundles * 1e6, block_time / bundles * 1e6, in_place_time / bundles * 1e6, difference);
+        }
+    }
+    return 0;
+}
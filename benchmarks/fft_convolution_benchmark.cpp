@@ -0,0 +1,130 @@
+/*
+Compares the FIR convolutions of math/fftConvolution.h with the nested loops they replaced in
+EEG/phaseEstimation/phaseEstimationFunctions.cpp:
+
+    loop     the previous applyLSFIRFilter, a branch on i - j >= 0 in the inner loop
+    direct   directFIR, the valid taps of every output as one dot product
+    fft      overlapSaveFilter at the FFT size chosen for the taps
+    auto     convolveFIR, direct or FFT by the operation count
+
+for a set of tap counts and signal lengths. Prints us per call, the method convolveFIR picked and the largest
+difference to the loop. The last table compares the previous zeroPhaseLSFIR (3 * taps - 1 padding, two passes) with
+the current one on the window of the phase estimation.
+
+Usage: fft_convolution_benchmark [--taps 71,255,1001] [--lengths 250,2500,25000,250000]
+*/
+
+#include "math/fftConvolution.h"
+#include "EEG/phaseEstimation/phaseEstimationFunctions.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The previous applyLSFIRFilter
+static Eigen::VectorXd loopFilter(const Eigen::VectorXd& data, const Eigen::VectorXd& coeffs) {
+    int dataSize = data.size();
+    int filterSize = coeffs.size();
+    Eigen::VectorXd filteredData = Eigen::VectorXd::Zero(dataSize);
+    for (int i = 0; i < dataSize; ++i) {
+        for (int j = 0; j < filterSize; ++j) {
+            if (i - j >= 0) {
+                filteredData(i) += data(i - j) * coeffs(j);
+            }
+        }
+    }
+    return filteredData;
+}
+
+// The previous zeroPhaseLSFIR
+static Eigen::VectorXd loopZeroPhase(const Eigen::VectorXd& data, const Eigen::VectorXd& coeffs) {
+    int extensionSize = 3 * coeffs.size() - 1;
+    Eigen::VectorXd paddedData = oddExtension(data, extensionSize);
+    Eigen::VectorXd forwardFiltered = loopFilter(paddedData, coeffs);
+    Eigen::VectorXd backwardFiltered = loopFilter(forwardFiltered.reverse(), coeffs);
+    return backwardFiltered.reverse().segment(extensionSize, data.size());
+}
+
+// Fastest of the repetitions in us per call. The repetitions add up to at least about 50 ms.
+template <typename Function>
+static double fastest(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    double once = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int repetitions = std::max(3, std::min(1000, static_cast<int>(0.05 / std::max(once, 1e-9))));
+
+    double best = once;
+    for (int i = 0; i < repetitions; i++) {
+        start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best * 1e6;
+}
+
+static std::vector<int> parseList(const std::string &list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> tap_counts = {71, 255, 1001};
+    std::vector<int> lengths = {250, 2500, 25000, 250000};
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--taps") && i + 1 < argc) tap_counts = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--lengths") && i + 1 < argc) lengths = parseList(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--taps 71,255,1001] [--lengths 250,2500,25000,250000]" << '\n';
+            return 1;
+        }
+    }
+
+    printf("%6s %8s %6s %12s %12s %12s %12s %6s %10s\n", "taps", "length", "fft", "loop us", "direct us", "fft us", "auto us", "auto", "max diff");
+    for (int taps : tap_counts) {
+        for (int length : lengths) {
+            if (taps <= 0 || length <= 0) continue;
+            Eigen::VectorXd coefficients = Eigen::VectorXd::Random(taps) / taps;
+            Eigen::VectorXd input = Eigen::VectorXd::Random(length) * 100;
+            Eigen::VectorXd reference, direct(length), fft(length), automatic(length);
+
+            overlapSaveFilter filter;
+            filter.reset(coefficients);
+
+            // The loop is quadratic, it is skipped where it would take seconds
+            bool run_loop = static_cast<double>(taps) * length <= 3e7;
+            double loop_us = run_loop ? fastest([&]() { reference = loopFilter(input, coefficients); }) : 0;
+            double direct_us = fastest([&]() { directFIR(input, coefficients, 0, direct); });
+            double fft_us = fastest([&]() { filter.filter(input, 0, fft); });
+            double auto_us = fastest([&]() { convolveFIR(input, coefficients, 0, automatic); });
+            if (!run_loop) reference = direct;
+
+            // convolveFIR picks the method by the operation count; identical results to directFIR mean it went direct
+            const char *picked = (automatic - direct).cwiseAbs().maxCoeff() == 0 ? "direct" : "fft";
+            double difference = std::max({(direct - reference).cwiseAbs().maxCoeff(), (fft - reference).cwiseAbs().maxCoeff(),
+                                          (automatic - reference).cwiseAbs().maxCoeff()});
+            if (run_loop) printf("%6d %8d %6d %12.1f %12.1f %12.1f %12.1f %6s %10.2e\n", taps, length, filter.getFFTSize(), loop_us, direct_us, fft_us, auto_us, picked, difference);
+            else printf("%6d %8d %6d %12s %12.1f %12.1f %12.1f %6s %10.2e\n", taps, length, filter.getFFTSize(), "-", direct_us, fft_us, auto_us, picked, difference);
+        }
+    }
+
+    // Zero-phase filtering of the phase estimation window with the 9-13 Hz FIR
+    Eigen::VectorXd coefficients;
+    getLSFIRCoeffs_9_13Hz(coefficients);
+    printf("\nzeroPhaseLSFIR, %d taps\n%8s %12s %12s %10s\n", static_cast<int>(coefficients.size()), "length", "previous us", "current us", "max diff");
+    for (int length : {250, 1000, 10000}) {
+        Eigen::VectorXd input = Eigen::VectorXd::Random(length) * 100;
+        Eigen::VectorXd previous, current;
+        double previous_us = fastest([&]() { previous = loopZeroPhase(input, coefficients); });
+        double current_us = fastest([&]() { current = zeroPhaseLSFIR(input, coefficients); });
+        printf("%8d %12.1f %12.1f %10.2e\n", length, previous_us, current_us, (current - previous).cwiseAbs().maxCoeff());
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+Compares the FFT paths of math/dsp.cpp before and after the plan cache (math/fftPlanCache.h):
+
+    per call   fftw_malloc, an FFTW_ESTIMATE plan, the transform, fftw_destroy_plan and fftw_free on every call,
+               as performFFT did before
+    cached     performFFT through the cached plan and the thread's workspace
+
+and prints the time the cache spent planning each size with the chosen effort. With --wisdom the wisdom file is
+loaded first and saved at the end, so a second run shows the planning time with wisdom.
+
+The second table compares the Hilbert transform through a complex FFT and IFFT with the analytic signal from the
+real FFT (analyticSignal) written into a preallocated vector.
+
+Usage: fft_plan_benchmark [--sizes 67,256,512,4096] [--planning estimate|measure|patient] [--wisdom file]
+*/
+
+#include "math/dsp.h"
+#include "math/fftPlanCache.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The previous performFFT
+static std::vector<std::complex<double>> perCallFFT(const Eigen::VectorXd& data) {
+    int N = data.size();
+    std::vector<std::complex<double>> out(N);
+    fftw_complex *in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
+    fftw_complex *out_fftw = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
+    for (int i = 0; i < N; ++i) {
+        in[i][0] = data(i);
+        in[i][1] = 0;
+    }
+    fftw_plan plan = fftw_plan_dft_1d(N, in, out_fftw, FFTW_FORWARD, FFTW_ESTIMATE);
+    fftw_execute(plan);
+    fftw_destroy_plan(plan);
+    for (int i = 0; i < N; ++i) out[i] = std::complex<double>(out_fftw[i][0], out_fftw[i][1]);
+    fftw_free(in);
+    fftw_free(out_fftw);
+    return out;
+}
+
+// The previous hilbertTransform on the cached complex plans
+static std::vector<std::complex<double>> complexHilbert(const Eigen::VectorXd& signal) {
+    size_t N = signal.size();
+    auto fft_signal = performFFT(signal);
+    fft_signal[0] = 0;
+    for (size_t k = 1; k < N / 2; ++k) fft_signal[k] *= 2;
+    if (N % 2 == 0) fft_signal[N / 2] = 0;
+    for (size_t k = N / 2 + 1; k < N; ++k) fft_signal[k] = 0;
+    return performIFFT(fft_signal);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Fastest of the repetitions in us per call
+template <typename Function>
+static double fastest(int calls, Function function) {
+    double best = 1e30;
+    for (int i = 0; i < 5; i++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int call = 0; call < calls; call++) function();
+        best = std::min(best, secondsSince(start));
+    }
+    return best * 1e6 / calls;
+}
+
+static std::vector<int> parseList(const std::string &list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> sizes = {67, 256, 512, 4096};
+    std::string planning = "measure";
+    std::string wisdom;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--sizes") && i + 1 < argc) sizes = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--planning") && i + 1 < argc) planning = argv[++i];
+        else if (!std::strcmp(argv[i], "--wisdom") && i + 1 < argc) wisdom = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--sizes 67,256,512,4096] [--planning estimate|measure|patient] [--wisdom file]" << '\n';
+            return 1;
+        }
+    }
+
+    FFTPlanningEffort effort;
+    if (!parseFFTPlanningEffort(planning, effort)) {
+        std::cerr << "Unknown planning effort " << planning << '\n';
+        return 1;
+    }
+    setFFTPlanningEffort(effort);
+    if (!wisdom.empty()) loadFFTWisdom(wisdom);
+
+    printf("%8s %12s %14s %12s %10s\n", "size", "plan ms", "per call us", "cached us", "max diff");
+    for (int size : sizes) {
+        if (size <= 0) continue;
+        Eigen::VectorXd input = Eigen::VectorXd::Random(size);
+
+        auto start = std::chrono::steady_clock::now();
+        getFFTWorkspace(size, FFT_PLAN_FORWARD);
+        double plan_ms = secondsSince(start) * 1e3;
+
+        std::vector<std::complex<double>> previous, current;
+        int calls = std::max(10, 200000 / size);
+        double per_call_us = fastest(calls, [&]() { previous = perCallFFT(input); });
+        double cached_us = fastest(calls, [&]() { current = performFFT(input); });
+
+        double difference = 0;
+        for (int i = 0; i < size; i++) difference = std::max(difference, std::abs(previous[i] - current[i]));
+        printf("%8d %12.2f %14.2f %12.2f %10.2e\n", size, plan_ms, per_call_us, cached_us, difference);
+    }
+
+    printf("\n%8s %14s %14s %10s\n", "size", "complex us", "analytic us", "max diff");
+    for (int size : sizes) {
+        if (size <= 0) continue;
+        Eigen::VectorXd input = Eigen::VectorXd::Random(size);
+        std::vector<std::complex<double>> previous, current(size);
+        int calls = std::max(10, 200000 / size);
+        double complex_us = fastest(calls, [&]() { previous = complexHilbert(input); });
+        double analytic_us = fastest(calls, [&]() { hilbertTransform(input, current); });
+
+        // The previous version does not double the highest positive bin of an odd size, compare even sizes only
+        double difference = 0;
+        if (size % 2 == 0) for (int i = 0; i < size; i++) difference = std::max(difference, std::abs(previous[i] - current[i]));
+        printf("%8d %14.2f %14.2f %10.2e\n", size, complex_us, analytic_us, difference);
+    }
+
+    if (!wisdom.empty()) saveFFTWisdom(wisdom);
+    return 0;
+}
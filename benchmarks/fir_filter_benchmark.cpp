@@ -0,0 +1,135 @@
+/*
+Compares firFilterBank (math/firFilterBank.h) with the shifting per-channel FIR it replaced in
+MultiChannelRealTimeFilter, using the 81-tap 0-80 Hz LS FIR of the acquisition:
+
+    shift    every channel history moved one place per sample, then a dot product (the previous implementation,
+             with its overlapping Eigen assignment replaced by a memmove, as the assignment aliased)
+    sample   firFilterBank::processSample, one bundle at a time
+    packet   firFilterBank::processBlock on packets of 5 bundles
+    block    firFilterBank::processBlock on blocks of 64 bundles
+
+Prints ns per bundle (all channels) and the largest difference to the shifting filter.
+
+Usage: fir_filter_benchmark [--channels 32,64,128] [--samples 50000]
+*/
+
+#include "EEG/preprocessing/preprocessingFunctions.h"
+#include "math/firFilterBank.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const int REPETITIONS = 5;
+
+// The per-channel shift register of the previous MultiChannelRealTimeFilter
+class shiftingFilter {
+public:
+    void reset(const Eigen::VectorXd &coefficients, int channels) {
+        filterCoeffs = coefficients;
+        M = coefficients.size();
+        buffers = Eigen::MatrixXd::Zero(M, channels);
+    }
+
+    void processBlock(Eigen::Ref<Eigen::MatrixXd> samples) {
+        for (int i = 0; i < samples.cols(); ++i) {
+            for (int ch = 0; ch < samples.rows(); ++ch) {
+                std::memmove(buffers.col(ch).data() + 1, buffers.col(ch).data(), (M - 1) * sizeof(double));
+                buffers.col(ch)(0) = samples(ch, i);
+                samples(ch, i) = buffers.col(ch).dot(filterCoeffs);
+            }
+        }
+    }
+
+private:
+    Eigen::VectorXd filterCoeffs;
+    Eigen::MatrixXd buffers;
+    int M = 0;
+};
+
+// Fastest of the repetitions in ns per bundle. The filter is reset before each repetition.
+template <typename Reset, typename Function>
+static double fastest(int samples, Reset reset, Function function) {
+    double best = 1e30;
+    for (int i = 0; i < REPETITIONS; i++) {
+        reset();
+        auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best * 1e9 / samples;
+}
+
+static std::vector<int> parseList(const std::string &list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> channel_counts = {32, 64, 128};
+    int samples = 50000;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--channels") && i + 1 < argc) channel_counts = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "--samples") && i + 1 < argc) samples = std::atoi(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--channels 32,64,128] [--samples 50000]" << '\n';
+            return 1;
+        }
+    }
+
+    Eigen::VectorXd coefficients;
+    getLSFIRCoeffs_0_80Hz(coefficients);
+
+#if defined(__AVX2__) && defined(__FMA__)
+    const char *kernel = "AVX2/FMA";
+#else
+    const char *kernel = "scalar";
+#endif
+    printf("%d taps, %d bundles, %s kernel\n", static_cast<int>(coefficients.size()), samples, kernel);
+    printf("%8s %12s %12s %12s %12s %10s %12s\n", "channels", "shift ns/b", "sample ns/b", "packet ns/b", "block ns/b", "speedup", "max diff");
+
+    for (int channels : channel_counts) {
+        if (channels <= 0 || samples <= 0) continue;
+        Eigen::MatrixXd input = Eigen::MatrixXd::Random(channels, samples) * 1000;
+        Eigen::MatrixXd reference = input, output = input;
+
+        shiftingFilter shifting;
+        firFilterBank bank;
+        Eigen::VectorXd sample_output(channels);
+
+        double shift_ns = fastest(samples, [&]() { shifting.reset(coefficients, channels); reference = input; },
+                                  [&]() { shifting.processBlock(reference); });
+
+        double sample_ns = fastest(samples, [&]() { bank.reset(coefficients, channels); },
+                                   [&]() {
+                                       for (int i = 0; i < samples; i++) {
+                                           bank.processSample(input.col(i), sample_output);
+                                           output(0, i) = sample_output(0);
+                                       }
+                                   });
+
+        double packet_ns = fastest(samples, [&]() { bank.reset(coefficients, channels); output = input; },
+                                   [&]() {
+                                       for (int i = 0; i < samples; i += 5) bank.processBlock(output.middleCols(i, std::min(5, samples - i)));
+                                   });
+        double difference = (output - reference).cwiseAbs().maxCoeff();
+
+        double block_ns = fastest(samples, [&]() { bank.reset(coefficients, channels); output = input; },
+                                  [&]() {
+                                      for (int i = 0; i < samples; i += 64) bank.processBlock(output.middleCols(i, std::min(64, samples - i)));
+                                  });
+        difference = std::max(difference, (output - reference).cwiseAbs().maxCoeff());
+
+        printf("%8d %12.1f %12.1f %12.1f %12.1f %9.1fx %12.2e\n", channels, shift_ns, sample_ns, packet_ns, block_ns,
+               shift_ns / packet_ns, difference);
+    }
+    return 0;
+}
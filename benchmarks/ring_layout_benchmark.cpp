@@ -0,0 +1,150 @@
+/*
+Compares the storage layouts of the sample ring (dataHandler/sampleRing.h) on the access patterns of the application:
+
+    write   the acquisition thread stores a packet of bundles (5 bundles = 1 ms at 5 kHz)
+    block   the preprocessing worker copies the newest samples (10 ms per wake)
+    window  the EEG window copies the latest 10000 samples of all channels
+    viewer  the signal viewer copies 12 whole channels of the ring (every 16 ms)
+
+For every channel count the cost of one second of acquisition is estimated for the headless pipeline (write + block)
+and for the GUI (write + block + viewer at 60 Hz), and the cheaper layout is printed.
+
+Usage: ring_layout_benchmark [--rate 5000] [--seconds 30] [--channels 13,32,64,128]
+*/
+
+#include "dataHandler/sampleRing.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct patternTimes {
+    double write_ns = 0;        // Per bundle
+    double block_ns = 0;        // Per sample copied
+    double window_us = 0;       // Per copy
+    double viewer_us = 0;       // Per refresh of the 12 channels
+};
+
+static const int PACKET_BUNDLES = 5;
+static const int WINDOW_SAMPLES = 10000;
+static const int VIEWER_CHANNELS = 12;
+static const int VIEWER_RATE = 60;
+static const int REPETITIONS = 5;
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Fastest of the repetitions, so that interruptions of the benchmark do not count
+template <typename Function>
+static double fastest(Function function) {
+    double best = 1e30;
+    for (int i = 0; i < REPETITIONS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, secondsSince(start));
+    }
+    return best;
+}
+
+static patternTimes measure(RingLayout layout, int channels, int capacity, int block_samples) {
+    sampleRing ring;
+    ring.reset(channels, capacity, layout);
+    patternTimes times;
+
+    // Acquisition: every position of the ring once
+    Eigen::MatrixXd packet = Eigen::MatrixXd::Random(channels, PACKET_BUNDLES);
+    int packets = capacity / PACKET_BUNDLES;
+    times.write_ns = fastest([&]() {
+        for (int i = 0; i < packets; i++) {
+            packet(0, 0) = i;
+            ring.writeColumns(i * PACKET_BUNDLES, packet);
+        }
+    }) * 1e9 / (static_cast<double>(packets) * PACKET_BUNDLES);
+
+    // Worker reads, walking the ring like a reader that follows the writer
+    SampleMatrix block(channels, block_samples);
+    int blocks = capacity / block_samples;
+    double checksum = 0;
+    times.block_ns = fastest([&]() {
+        for (int i = 0; i < blocks; i++) {
+            ring.readColumns(i * block_samples, block_samples, block);
+            checksum += block(0, 0);
+        }
+    }) * 1e9 / (static_cast<double>(blocks) * block_samples);
+
+    int window_samples = std::min(WINDOW_SAMPLES, capacity);
+    Eigen::MatrixXd window(channels, window_samples);
+    int windows = 50;
+    times.window_us = fastest([&]() {
+        for (int i = 0; i < windows; i++) {
+            ring.readColumns((i * 997) % (capacity - window_samples + 1), window_samples, window);
+            checksum += window(0, 0);
+        }
+    }) * 1e6 / windows;
+
+    int viewer_channels = std::min(VIEWER_CHANNELS, channels);
+    Eigen::VectorXd row(capacity);
+    int refreshes = 10;
+    times.viewer_us = fastest([&]() {
+        for (int i = 0; i < refreshes; i++) {
+            for (int channel = 0; channel < viewer_channels; channel++) {
+                ring.readChannel(channel, row);
+                checksum += row(i);
+            }
+        }
+    }) * 1e6 / refreshes;
+
+    // Keeps the reads from being optimized away
+    if (checksum == 0.123456789) std::cout << checksum << '\n';
+    return times;
+}
+
+static std::vector<int> parseList(const std::string &list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+int main(int argc, char **argv) {
+    int rate = 5000;
+    int seconds = 30;
+    std::vector<int> channel_counts = {13, 32, 64, 128};
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--rate") && i + 1 < argc) rate = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--channels") && i + 1 < argc) channel_counts = parseList(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--rate 5000] [--seconds 30] [--channels 13,32,64,128]" << '\n';
+            return 1;
+        }
+    }
+
+    int capacity = rate * seconds;
+    int block_samples = std::max(1, rate / 100);
+    const char *names[] = {"columns", "tiled"};
+
+    printf("Ring of %d s at %d Hz, %zu-byte samples, tiles of %d samples\n", seconds, rate, sizeof(SampleScalar), RING_TILE_SAMPLES);
+    printf("%8s %8s %12s %12s %12s %12s %14s %14s\n", "channels", "layout", "write ns/b", "block ns/s", "window us", "viewer us", "headless us/s", "gui us/s");
+
+    for (int channels : channel_counts) {
+        if (channels <= 0) continue;
+        double headless[2], gui[2];
+        for (int layout = 0; layout < 2; layout++) {
+            patternTimes times = measure(static_cast<RingLayout>(layout), channels, capacity, block_samples);
+            headless[layout] = (times.write_ns + times.block_ns) * rate / 1000;
+            gui[layout] = headless[layout] + times.viewer_us * VIEWER_RATE;
+            printf("%8d %8s %12.2f %12.2f %12.1f %12.1f %14.1f %14.1f\n", channels, names[layout], times.write_ns, times.block_ns,
+                   times.window_us, times.viewer_us, headless[layout], gui[layout]);
+        }
+        printf("%8d best: headless %s, gui %s\n", channels, names[headless[1] < headless[0]], names[gui[1] < gui[0]]);
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+Bit-exact check of the 24-bit sample decoder (devices/EEG/eeg_bridge/samplePacket.cpp). The decoder is compiled into
+this program with the instruction set of the target (sample_decoder_check_avx2, _ssse3 and _scalar), and
+
+    decodeInt24BE              is compared with a byte by byte conversion
+    decodeSamplePacketScaled   is compared with deserializeSamplePacketEigen_pointer (samples and trigger bits)
+
+on random samples and on the edge values 0x800000, 0x7FFFFF, 0xFFFFFF and 0x000000, for every channel count from 1
+to 40 with and without a trigger channel and every sample count that fits in a packet. The packets are stored in
+buffers of their exact size, so a vector load past the end is caught by the address sanitizer.
+
+Returns 0 if all outputs match, 1 otherwise.
+*/
+
+#include "devices/EEG/eeg_bridge/samplePacket.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if defined(__AVX2__)
+static const char *DECODER_PATH = "avx2";
+#elif defined(__SSSE3__)
+static const char *DECODER_PATH = "ssse3";
+#else
+static const char *DECODER_PATH = "scalar";
+#endif
+
+static const size_t HEADER_SIZE = 28;
+static const uint32_t EDGE_VALUES[] = {0x800000, 0x7FFFFF, 0xFFFFFF, 0x000000, 0x800001, 0x7FFFFE};
+
+static void putSample(uint8_t *destination, uint32_t sample) {
+    destination[0] = static_cast<uint8_t>(sample >> 16);
+    destination[1] = static_cast<uint8_t>(sample >> 8);
+    destination[2] = static_cast<uint8_t>(sample);
+}
+
+// Random samples with an edge value in every fourth sample
+static std::vector<uint8_t> randomSamples(size_t count, std::mt19937 &generator) {
+    std::uniform_int_distribution<uint32_t> distribution(0, 0xFFFFFF);
+    std::vector<uint8_t> bytes(3 * count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t sample = (i % 4 == 3) ? EDGE_VALUES[(i / 4) % 6] : distribution(generator);
+        putSample(bytes.data() + 3 * i, sample);
+    }
+    return bytes;
+}
+
+static std::vector<uint8_t> samplePacketBuffer(uint16_t num_channels, uint16_t num_bundles, const std::vector<uint8_t> &samples) {
+    std::vector<uint8_t> buffer(HEADER_SIZE, 0);
+    buffer[0] = 19;     // Sample packet frame type
+    buffer[8] = static_cast<uint8_t>(num_channels >> 8);
+    buffer[9] = static_cast<uint8_t>(num_channels);
+    buffer[10] = static_cast<uint8_t>(num_bundles >> 8);
+    buffer[11] = static_cast<uint8_t>(num_bundles);
+    buffer.insert(buffer.end(), samples.begin(), samples.end());
+    return buffer;
+}
+
+static int checkDecodeInt24BE(std::mt19937 &generator) {
+    int failures = 0;
+    for (size_t count = 0; count <= MAX_PACKET_SAMPLES; count++) {
+        // Exact size copy, nothing readable past the last sample
+        std::vector<uint8_t> bytes = randomSamples(count, generator);
+        std::vector<int32_t> decoded(count);
+        decodeInt24BE(bytes.data(), decoded.data(), count);
+
+        for (size_t i = 0; i < count; i++) {
+            uint32_t raw = (static_cast<uint32_t>(bytes[3 * i]) << 16) | (static_cast<uint32_t>(bytes[3 * i + 1]) << 8) | bytes[3 * i + 2];
+            int32_t expected = (raw & 0x800000) ? static_cast<int32_t>(raw) - 0x1000000 : static_cast<int32_t>(raw);
+            if (decoded[i] != expected) {
+                if (failures < 10) printf("decodeInt24BE count %zu sample %zu: %d, expected %d\n", count, i, decoded[i], expected);
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+static int checkPacketDecoders(std::mt19937 &generator) {
+    int failures = 0;
+    for (int num_channels = 1; num_channels <= 40; num_channels++) {
+        for (int trigger = 0; trigger <= 1; trigger++) {
+            bool contains_trigger_channel = trigger == 1;
+            int num_data_channels = num_channels - trigger;
+            if (num_data_channels < 1) continue;
+
+            for (int num_bundles = 1; num_bundles * num_channels <= static_cast<int>(MAX_PACKET_SAMPLES); num_bundles++) {
+                std::vector<uint8_t> samples = randomSamples(static_cast<size_t>(num_channels) * num_bundles, generator);
+                std::vector<uint8_t> buffer = samplePacketBuffer(num_channels, num_bundles, samples);
+                if (buffer.size() < sizeof(sample_packet)) continue;   // Rejected by both decoders
+
+                sample_packet reference_packet;
+                Eigen::MatrixXd reference = Eigen::MatrixXd::Zero(num_channels, num_bundles);
+                Eigen::VectorXi reference_A, reference_B;
+                deserializeSamplePacketEigen_pointer(buffer.data(), buffer.size(), reference_packet, reference, reference_A, reference_B, contains_trigger_channel);
+
+                sample_packet packet;
+                size_t offset = deserializeSamplePacketHeader(buffer.data(), buffer.size(), packet);
+                Eigen::MatrixXd decoded = Eigen::MatrixXd::Zero(num_data_channels, num_bundles);
+                Eigen::VectorXi triggers_A, triggers_B;
+                decodeSamplePacketScaled(buffer.data(), buffer.size(), offset, packet, decoded.data(), num_data_channels, 1.0, 1.0, triggers_A, triggers_B, contains_trigger_channel);
+
+                bool match = decoded == reference.topRows(num_data_channels) && triggers_A == reference_A && triggers_B == reference_B;
+                if (!match) {
+                    if (failures < 10) printf("Packet of %d channels (trigger channel %d) and %d bundles differs from deserializeSamplePacketEigen_pointer\n", num_channels, trigger, num_bundles);
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+int main() {
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("The CPU does not support AVX2, the avx2 decoder is not checked\n");
+        return 0;
+    }
+#elif defined(__SSSE3__)
+    if (!__builtin_cpu_supports("ssse3")) {
+        printf("The CPU does not support SSSE3, the ssse3 decoder is not checked\n");
+        return 0;
+    }
+#endif
+
+    std::mt19937 generator(1);
+    int sample_failures = checkDecodeInt24BE(generator);
+    int packet_failures = checkPacketDecoders(generator);
+
+    printf("%s decoder: %d sample and %d packet mismatches\n", DECODER_PATH, sample_failures, packet_failures);
+    return (sample_failures == 0 && packet_failures == 0) ? 0 : 1;
+}
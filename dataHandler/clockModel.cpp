@@ -0,0 +1,233 @@
+#include "clockModel.h"
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+
+void clockModel::reset(int sampling_rate) {
+    nominal_period_ns = sampling_rate > 0 ? 1e9 / sampling_rate : 0;
+    bin_samples = std::max<int64_t>(1, static_cast<int64_t>(sampling_rate) * CLOCK_BIN_MS / 1000);
+    window_start = 0;
+    window_count = 0;
+    points_since_fit = 0;
+    bin_index = -1;
+    newest_sample = -1;
+    current = {0, 0, nominal_period_ns};
+
+    packet_count = 0;
+    jitter_sum = 0;
+    jitter_sum_squares = 0;
+    jitter_max = 0;
+
+    version.store(0, std::memory_order_relaxed);
+    reference_sample.store(0, std::memory_order_relaxed);
+    reference_ns.store(0, std::memory_order_relaxed);
+    period_ns.store(nominal_period_ns, std::memory_order_relaxed);
+    valid.store(false, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        report = clock_report();
+    }
+
+    for (int i = 0; i < CLOCK_PACKET_CAPACITY; i++) {
+        packets[i].seq_num.store(-1, std::memory_order_relaxed);
+        packets[i].last_sample.store(-1, std::memory_order_relaxed);
+    }
+}
+
+int64_t clockModel::realtimeToMonotonic(int64_t realtime_ns) {
+    struct timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    int64_t difference = (static_cast<int64_t>(realtime.tv_sec) - monotonic.tv_sec) * 1000000000LL + (realtime.tv_nsec - monotonic.tv_nsec);
+    return realtime_ns - difference;
+}
+
+void clockModel::addPacket(int SeqNo, int64_t first_sample_index, int num_samples, int64_t arrival_ns) {
+    int64_t last_sample = first_sample_index + num_samples - 1;
+
+    packet_slot &slot = packets[static_cast<uint32_t>(SeqNo) % CLOCK_PACKET_CAPACITY];
+    slot.seq_num.store(-1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.last_sample.store(last_sample, std::memory_order_relaxed);
+    slot.seq_num.store(SeqNo, std::memory_order_release);
+
+    if (arrival_ns <= 0 || nominal_period_ns <= 0) return;
+    int64_t host_ns = realtimeToMonotonic(arrival_ns);
+
+    // The sample numbering restarted, the old points no longer apply
+    if (last_sample <= newest_sample) {
+        window_start = 0;
+        window_count = 0;
+        bin_index = -1;
+        valid.store(false, std::memory_order_release);
+    }
+    newest_sample = last_sample;
+
+    // Every bin contributes its earliest arrival relative to the nominal period
+    int64_t bin = last_sample / bin_samples;
+    if (bin != bin_index) {
+        if (bin_index >= 0) addPoint(bin_point);
+        bin_index = bin;
+        bin_point = {last_sample, host_ns};
+    } else if (host_ns - bin_point.host_ns < (last_sample - bin_point.sample) * nominal_period_ns) {
+        bin_point = {last_sample, host_ns};
+    }
+
+    if (!isValid()) {
+        current = {last_sample, host_ns, nominal_period_ns};
+        publish(current);
+        return;
+    }
+
+    // Arrival after the prediction is jitter, a packet below the envelope lowers it before the next refit
+    int64_t predicted = current.reference_ns + static_cast<int64_t>(std::llround((last_sample - current.reference_sample) * current.period_ns));
+    double jitter = 0;
+    if (host_ns < predicted) {
+        current.reference_ns += host_ns - predicted;
+        publish(current);
+    } else {
+        jitter = (host_ns - predicted) / 1000.0;
+    }
+    packet_count++;
+    jitter_sum += jitter;
+    jitter_sum_squares += jitter * jitter;
+    jitter_max = std::max(jitter_max, jitter);
+}
+
+void clockModel::addPoint(const fit_point &point) {
+    if (window_count == CLOCK_FIT_WINDOW) {
+        window[window_start] = point;
+        window_start = (window_start + 1) % CLOCK_FIT_WINDOW;
+    } else {
+        window[(window_start + window_count) % CLOCK_FIT_WINDOW] = point;
+        window_count++;
+    }
+
+    if (++points_since_fit >= CLOCK_FIT_INTERVAL || window_count < FIT_MINIMUM_POINTS) refit();
+}
+
+/*
+Least squares slope over the window of bin points, then the intercept as the lowest arrival relative to that slope,
+including the bin in progress.
+*/
+void clockModel::refit() {
+    points_since_fit = 0;
+    const fit_point &oldest = window[window_start];
+
+    double slope = nominal_period_ns;
+    if (window_count >= FIT_MINIMUM_POINTS) {
+        // Relative to the oldest point, so that the sums keep their precision
+        double mean_x = 0, mean_y = 0;
+        for (int i = 0; i < window_count; i++) {
+            const fit_point &point = window[(window_start + i) % CLOCK_FIT_WINDOW];
+            mean_x += point.sample - oldest.sample;
+            mean_y += point.host_ns - oldest.host_ns;
+        }
+        mean_x /= window_count;
+        mean_y /= window_count;
+
+        double sxx = 0, sxy = 0;
+        for (int i = 0; i < window_count; i++) {
+            const fit_point &point = window[(window_start + i) % CLOCK_FIT_WINDOW];
+            double dx = (point.sample - oldest.sample) - mean_x;
+            double dy = (point.host_ns - oldest.host_ns) - mean_y;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+
+        // Implausible drifts (e.g. a stalled host) fall back to the nominal period
+        if (sxx > 0) {
+            double fitted = sxy / sxx;
+            if (std::abs(fitted / nominal_period_ns - 1) * 1e6 <= MAX_DRIFT_PPM) slope = fitted;
+        }
+    }
+
+    // Lower envelope at the newest point
+    int64_t envelope = bin_point.host_ns;
+    for (int i = 0; i < window_count; i++) {
+        const fit_point &point = window[(window_start + i) % CLOCK_FIT_WINDOW];
+        envelope = std::min(envelope, point.host_ns - static_cast<int64_t>(std::llround((point.sample - bin_point.sample) * slope)));
+    }
+
+    current = {bin_point.sample, envelope, slope};
+    publish(current);
+
+    // The report is only refreshed when no reader holds it
+    std::unique_lock<std::mutex> lock(report_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) return;
+
+    report.packets = packet_count;
+    report.window_s = (bin_point.sample - oldest.sample) * nominal_period_ns / 1e9;
+    report.period_ns = slope;
+    report.drift_ppm = (slope / nominal_period_ns - 1) * 1e6;
+    if (packet_count > 0) {
+        double mean = jitter_sum / packet_count;
+        report.jitter_mean_us = mean;
+        report.jitter_std_us = std::sqrt(std::max(0.0, jitter_sum_squares / packet_count - mean * mean));
+        report.jitter_max_us = jitter_max;
+    }
+}
+
+void clockModel::publish(const fit_parameters &parameters) {
+    version.fetch_add(1, std::memory_order_acq_rel);
+    reference_sample.store(parameters.reference_sample, std::memory_order_relaxed);
+    reference_ns.store(parameters.reference_ns, std::memory_order_relaxed);
+    period_ns.store(parameters.period_ns, std::memory_order_relaxed);
+    version.fetch_add(1, std::memory_order_release);
+    valid.store(true, std::memory_order_release);
+}
+
+clockModel::fit_parameters clockModel::readParameters() const {
+    fit_parameters parameters;
+    uint32_t before, after;
+    do {
+        before = version.load(std::memory_order_acquire);
+        parameters.reference_sample = reference_sample.load(std::memory_order_relaxed);
+        parameters.reference_ns = reference_ns.load(std::memory_order_relaxed);
+        parameters.period_ns = period_ns.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = version.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    return parameters;
+}
+
+int64_t clockModel::sampleToHost(int64_t sample_index) const {
+    if (!isValid()) return 0;
+    fit_parameters parameters = readParameters();
+    return parameters.reference_ns + static_cast<int64_t>(std::llround((sample_index - parameters.reference_sample) * parameters.period_ns));
+}
+
+int64_t clockModel::hostToSample(int64_t host_ns) const {
+    if (!isValid()) return -1;
+    fit_parameters parameters = readParameters();
+    if (parameters.period_ns <= 0) return -1;
+    return parameters.reference_sample + static_cast<int64_t>(std::llround((host_ns - parameters.reference_ns) / parameters.period_ns));
+}
+
+int64_t clockModel::lastSampleOfPacket(int SeqNo) const {
+    const packet_slot &slot = packets[static_cast<uint32_t>(SeqNo) % CLOCK_PACKET_CAPACITY];
+    if (slot.seq_num.load(std::memory_order_acquire) != SeqNo) return -1;
+    int64_t last_sample = slot.last_sample.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq_num.load(std::memory_order_relaxed) != SeqNo) return -1;
+    return last_sample;
+}
+
+clock_report clockModel::getReport() {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    return report;
+}
+
+void clockModel::printReport(std::ostream &os) {
+    clock_report current_report = getReport();
+    if (current_report.packets == 0) return;
+
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(2) << "Amplifier clock: drift " << current_report.drift_ppm << " ppm over "
+       << current_report.window_s << " s (period " << std::setprecision(3) << current_report.period_ns << " ns), "
+       << std::setprecision(1) << "arrival jitter mean " << current_report.jitter_mean_us << " us, std "
+       << current_report.jitter_std_us << " us, max " << current_report.jitter_max_us << " us" << '\n';
+    os << std::defaultfloat << std::setprecision(precision);
+}
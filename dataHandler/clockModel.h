@@ -0,0 +1,128 @@
+#ifndef CLOCKMODEL_H
+#define CLOCKMODEL_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <time.h>
+
+/*
+Relation between the amplifier sample index (NeurOne FirstSampleIndex numbering) and the host CLOCK_MONOTONIC time.
+The acquisition thread feeds every sample packet with its kernel arrival time, paired with the last sample of the
+packet. The packets are reduced to the earliest arrival of every bin of amplifier time, and over a sliding window of
+bins the host time is fitted as a linear function of the sample index: the slope (the sample period in host time,
+which captures the drift between the amplifier and host clocks) by least squares, and the intercept as the lower
+envelope of the arrivals, so that network and scheduling jitter do not push the estimates late. Between refits a
+packet arriving below the envelope lowers it right away. Readers on other threads get consistent parameters through
+a sequence lock.
+*/
+
+// Number of packets whose sample indices can be looked up by sequence number
+#define CLOCK_PACKET_CAPACITY 8192
+// Amplifier time per fit point, points in the fit window (about 20 s) and points between refits
+#define CLOCK_BIN_MS 10
+#define CLOCK_FIT_WINDOW 2048
+#define CLOCK_FIT_INTERVAL 8
+
+// Drift over the fit window and arrival jitter since the reset
+struct clock_report {
+    uint64_t packets = 0;           // Packets since the reset
+    double window_s = 0;            // Amplifier time covered by the fit window
+    double period_ns = 0;           // Fitted sample period in host time
+    double drift_ppm = 0;           // Fitted period relative to the nominal, positive when the amplifier clock is slow
+    double jitter_mean_us = 0;      // Packet arrival after its predicted time
+    double jitter_std_us = 0;
+    double jitter_max_us = 0;
+};
+
+class clockModel {
+public:
+    clockModel() { reset(0); }
+
+    void reset(int sampling_rate);
+
+    // Called by the acquisition thread for every sample packet. arrival_ns is CLOCK_REALTIME (kernel timestamp).
+    void addPacket(int SeqNo, int64_t first_sample_index, int num_samples, int64_t arrival_ns);
+
+    bool isValid() const { return valid.load(std::memory_order_acquire); }
+
+    // Estimated CLOCK_MONOTONIC time (ns) of a sample, 0 before the first packet
+    int64_t sampleToHost(int64_t sample_index) const;
+    // Sample index at a CLOCK_MONOTONIC time (ns), -1 before the first packet
+    int64_t hostToSample(int64_t host_ns) const;
+
+    // Amplifier index of the last sample of a packet, -1 if the packet is no longer known
+    int64_t lastSampleOfPacket(int SeqNo) const;
+
+    clock_report getReport();
+    void printReport(std::ostream &os);
+
+    static int64_t monotonicNow() {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return static_cast<int64_t>(time.tv_sec) * 1000000000LL + time.tv_nsec;
+    }
+
+    // CLOCK_REALTIME kernel timestamps to CLOCK_MONOTONIC
+    static int64_t realtimeToMonotonic(int64_t realtime_ns);
+
+private:
+    struct packet_slot {
+        std::atomic<int64_t> seq_num;
+        std::atomic<int64_t> last_sample;
+    };
+
+    struct fit_point {
+        int64_t sample;
+        int64_t host_ns;
+    };
+
+    struct fit_parameters {
+        int64_t reference_sample;
+        int64_t reference_ns;       // Host time of the reference sample
+        double period_ns;           // Host ns per sample
+    };
+
+    // Points needed before the slope is fitted, and the largest accepted drift
+    static const int FIT_MINIMUM_POINTS = 16;
+    static constexpr double MAX_DRIFT_PPM = 1000;
+
+    void addPoint(const fit_point &point);
+    void refit();
+    void publish(const fit_parameters &parameters);
+    fit_parameters readParameters() const;
+
+    double nominal_period_ns = 0;
+    int64_t bin_samples = 1;
+
+    // Fit state, owned by the acquisition thread
+    fit_point window[CLOCK_FIT_WINDOW];
+    int window_start = 0;
+    int window_count = 0;
+    int points_since_fit = 0;
+    fit_point bin_point = {0, 0};           // Earliest arrival of the current bin
+    int64_t bin_index = -1;
+    int64_t newest_sample = -1;
+    fit_parameters current = {0, 0, 0};
+
+    // Arrival jitter, owned by the acquisition thread
+    uint64_t packet_count = 0;
+    double jitter_sum = 0;
+    double jitter_sum_squares = 0;
+    double jitter_max = 0;
+
+    // Published model parameters
+    std::atomic<uint32_t> version{0};
+    std::atomic<int64_t> reference_sample{0};
+    std::atomic<int64_t> reference_ns{0};
+    std::atomic<double> period_ns{0};
+    std::atomic<bool> valid{false};
+
+    std::mutex report_mutex;
+    clock_report report;
+
+    packet_slot packets[CLOCK_PACKET_CAPACITY];
+};
+
+#endif // CLOCKMODEL_H
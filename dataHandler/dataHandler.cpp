@@ -1,4 +1,8 @@
 #include "dataHandler.h"
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 // Resets the buffers for new channelcount and sampling rates
 void dataHandler::reset_handler(int channel_count, int sampling_rate, int simulation_delivery_rate) {
@@ -7,24 +11,59 @@ void dataHandler::reset_handler(int channel_count, int sampling_rate, int simula
     sampling_rate_ = sampling_rate;
     simulation_delivery_rate_ = simulation_delivery_rate;
 
-    buffer_capacity_ = buffer_length_in_seconds_ * sampling_rate;
-    current_data_index_ = 0;
-
+    // Readers are kept out while the ring is reallocated. This is the only place where the acquisition thread
+    // waits for the readers.
+    handler_state = WAITING_FOR_START;
     {
-        std::lock_guard<std::mutex> lock(this->dataMutex);
-        sample_buffer_ = Eigen::MatrixXd::Zero(channel_count, buffer_capacity_);
-        time_stamp_buffer_ = Eigen::VectorXd::Zero(buffer_capacity_);
+        std::unique_lock<std::shared_mutex> ring_lock(ring_mutex);
+        buffer_capacity_ = buffer_length_in_seconds_ * sampling_rate;
+        current_data_index_ = 0;
+        samples_claimed_.store(0, std::memory_order_relaxed);
+        samples_written_.store(0, std::memory_order_relaxed);
+        current_sequence_number_.store(0, std::memory_order_relaxed);
+        next_wake_ = 0;
+
+        sample_ring_.reset(channel_count, buffer_capacity_, ring_layout_);
+        viewer_channel_ = Eigen::VectorXd::Zero(buffer_capacity_);
+        time_stamp_buffer_ = VectorXi64::Zero(buffer_capacity_);
+        arrival_time_buffer_ = VectorXi64::Zero(buffer_capacity_);
+        seqnum_buffer_ = Eigen::VectorXi::Zero(buffer_capacity_);
+        valid_buffer_ = Eigen::VectorXi::Ones(buffer_capacity_);
+        last_packet_sequence_number_ = -1;
+        pending_gap_length_ = 0;
+        first_sample_index_ = -1;
+        time_anchor_index_ = -1;
+        trigger_events_written_.store(0, std::memory_order_relaxed);
+        gap_count_ = 0;
+        gap_samples_filled_ = 0;
+        late_packet_count_ = 0;
+        invalid_packet_count_ = 0;
+        tracer_.reset();
+        clock_model_.reset(sampling_rate);
+        trigger_scheduler_.clear();
+        trigger_scheduler_.resetTimings();
+        scheduled_pulses_read_ = scheduled_pulses_written_.load(std::memory_order_acquire);
+        pending_scheduled_pulses_.clear();
+        pending_scheduled_pulses_.reserve(SCHEDULED_PULSE_CAPACITY);
+        trigger_wheel_.reset();
         trigger_buffer_A = Eigen::VectorXi::Zero(buffer_capacity_);
         trigger_buffer_B = Eigen::VectorXi::Zero(buffer_capacity_);
         trigger_buffer_out = Eigen::VectorXi::Zero(buffer_capacity_);
         
         PreProcessing_output_save = Eigen::MatrixXd::Zero(number_of_EEG_channels, buffer_capacity_);
+
+        std::lock_guard<std::mutex> ROI_lock(ROI_mutex);
+        if (ROI_means_save.rows() > 0) ROI_means_save = Eigen::MatrixXd::Zero(ROI_means_save.rows(), buffer_capacity_);
+
         for (int i = 0; i < channel_count; i++) {
             channel_names_.push_back("unknown_channel_" + std::to_string(i + 1));
         }
     }
 
     sample_buffer_save = Eigen::MatrixXd::Zero(20, buffer_capacity_);
+    sample_buffer_save_index = 0;
+
+    packet_staging_ = Eigen::MatrixXd::Zero(channel_count, 64);
 
     processing_sample_vector = Eigen::VectorXd::Zero(channel_count);
 
@@ -35,8 +74,9 @@ void dataHandler::reset_handler(int channel_count, int sampling_rate, int simula
 
     GACorr_ = GACorrection(channel_count, GA_average_length, GA_shift_front + TA_length + GA_shift_back);
 
-    RTfilter_.reset_filter(channel_count);
+    RTfilter_.reset_filter(channel_count, sampling_rate);
 
+    reset_count_.fetch_add(1, std::memory_order_release);
     handler_state = WAITING_FOR_STOP;
 }
     
@@ -77,7 +117,7 @@ void dataHandler::reset_GACorr(int TA_length_input, int GA_average_length_input)
 Add a single sample to each channel. This fuction also handles some preprocessing such as TA, TR, GA, baseline correction, geometric sum correction, and filtering.
 Realtime operations such as triggering are also handled here.
 */
-void dataHandler::addData(const Eigen::VectorXd &samples, const double &time_stamp, const int &trigger_A, const int &trigger_B, const int &SeqNo) {
+void dataHandler::addData(const Eigen::VectorXd &samples, const int64_t &time_stamp, const int &trigger_A, const int &trigger_B, const int &SeqNo, const int64_t &arrival_time) {
     auto start = std::chrono::high_resolution_clock::now();
 
     try {
@@ -86,153 +126,685 @@ void dataHandler::addData(const Eigen::VectorXd &samples, const double &time_sta
             std::cerr << "Error: Empty samples vector." << std::endl;
             return;
         }
-        std::lock_guard<std::mutex> lock(this->dataMutex);
+        claimRing(1);
+        addSample(samples, time_stamp, trigger_A, trigger_B, SeqNo, arrival_time);
+        tracer_.beginBatch(SeqNo, arrival_time);
+        tracer_.record(TRACE_ADD_DATA, arrival_time);
+
+    } catch (const std::exception& e) {
+        publishInvalidPacket(SeqNo, time_stamp);
+        std::cerr << "Datahandler exception: " << e.what() << '\n';
+        std::cerr << boost::stacktrace::stacktrace();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;  // Explicitly specify duration type
+    if(SeqNo > 100000) {
+        total_addData_time += duration;
+        min_addData_time = std::min(min_addData_time, duration);
+        max_addData_time = std::max(max_addData_time, duration);
+        addData_call_count++;
+        addData_bundle_count++;
+    }
+}
+
+/*
+Decode a sample packet straight into the next columns of the sample ring. The unit conversion (gain / divisor) is
+done by the decoder, so the samples do not pass through intermediate matrices. The preprocessing stages then run on
+the ring columns in place. A packet that would wrap around the end of the ring, or any packet when the ring stores
+floats or is tiled, is decoded into packet_staging_ instead. Returns the packet sequence number.
+*/
+int dataHandler::addSamplePacket(const uint8_t *buffer, size_t size, bool contains_trigger_channel, double gain, double divisor, const int64_t &arrival_time) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    sample_packet packet;
+    size_t offset = deserializeSamplePacketHeader(buffer, size, packet);
+    int SeqNo = packet.PacketSeqNo;
+
+    int num_data_channels = contains_trigger_channel ? packet.NumChannels - 1 : packet.NumChannels;
+    if (num_data_channels != channel_count_) {
+        throw std::runtime_error("Packet channel count " + std::to_string(num_data_channels) + " does not match the handler channel count " + std::to_string(channel_count_));
+    }
+
+    // The payload is validated before the ring is claimed, a claim is never taken back
+    int num_bundles = packet.NumSampleBundles;
+    size_t num_samples = static_cast<size_t>(packet.NumChannels) * num_bundles;
+    if (num_bundles == 0 || num_samples > MAX_PACKET_SAMPLES || offset + 3 * num_samples > size) {
+        throw std::runtime_error("Sample packet with " + std::to_string(num_bundles) + " bundles does not fit its " + std::to_string(size) + " bytes");
+    }
+
+    int64_t time_stamp = sampleTimeStamp(static_cast<int64_t>(packet.FirstSampleIndex), static_cast<int64_t>(packet.FirstSampleTime));
+    int gap = getGapLength(SeqNo, num_bundles);
+    if (gap < 0) return SeqNo;
+    claimRing(gap + num_bundles);
+    if (gap > 0) insertGap(gap, SeqNo, time_stamp);
+
+    // Maps the NeurOne sample indices of trigger packets to ring positions
+    if (first_sample_index_ < 0) first_sample_index_ = static_cast<int64_t>(packet.FirstSampleIndex) - samples_written_.load(std::memory_order_relaxed) - gap;
+
+    bool fits_to_ring = current_data_index_ + num_bundles <= static_cast<size_t>(buffer_capacity_);
+    double *ring_columns = fits_to_ring ? inPlaceRingColumns(current_data_index_) : nullptr;
+    if (!ring_columns && packet_staging_.cols() < num_bundles) packet_staging_.resize(channel_count_, num_bundles);
+
+    // Decoding errors are passed to the caller after the claimed columns have been published as placeholders
+    double *output = ring_columns ? ring_columns : packet_staging_.data();
+    int output_stride = ring_columns ? channel_count_ : packet_staging_.rows();
+    try {
+        decodeSamplePacketScaled(buffer, size, offset, packet, output, output_stride, gain, divisor, packet_triggers_A_, packet_triggers_B_, contains_trigger_channel);
+    } catch (...) {
+        publishInvalidPacket(SeqNo, time_stamp);
+        throw;
+    }
+    tracer_.beginBatch(SeqNo, arrival_time);
+    tracer_.record(TRACE_DECODE, arrival_time);
+    clock_model_.addPacket(SeqNo, static_cast<int64_t>(packet.FirstSampleIndex), num_bundles, arrival_time);
+
+    try {
+        if (ring_columns) {
+            addBlock(Eigen::Map<Eigen::MatrixXd>(ring_columns, channel_count_, num_bundles), time_stamp, packet_triggers_A_.head(num_bundles), packet_triggers_B_.head(num_bundles), SeqNo, arrival_time);
+        } else {
+            addBlock(packet_staging_.leftCols(num_bundles), time_stamp, packet_triggers_A_.head(num_bundles), packet_triggers_B_.head(num_bundles), SeqNo, arrival_time);
+        }
+    } catch (const std::exception& e) {
+        publishInvalidPacket(SeqNo, time_stamp);
+        std::cerr << "Datahandler exception: " << e.what() << '\n';
+        std::cerr << boost::stacktrace::stacktrace();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;
+    if(SeqNo > 100000) {
+        total_addData_time += duration;
+        min_addData_time = std::min(min_addData_time, duration);
+        max_addData_time = std::max(max_addData_time, duration);
+        addData_call_count++;
+        addData_bundle_count += num_bundles;
+    }
+
+    tracer_.record(TRACE_ADD_DATA, arrival_time);
+
+    return SeqNo;
+}
+
+/*
+Store the triggers of a NeurOne trigger packet in the trigger event ring. Unlike the trigger channel of the sample
+packets, the events carry the exact sample index of the trigger. Returns the number of triggers.
+*/
+int dataHandler::addTriggerPacket(const uint8_t *buffer, size_t size, const int64_t &arrival_time) {
+    trigger_packet packet;
+    int num_triggers = deserializeTriggerPacket_pointer(buffer, size, packet, packet_trigger_entries_, MAX_PACKET_TRIGGERS);
+
+    int64_t written = trigger_events_written_.load(std::memory_order_relaxed);
+    for (int i = 0; i < num_triggers; i++) {
+        const trigger_entry &entry = packet_trigger_entries_[i];
+        trigger_event &event = trigger_events_[(written + i) % TRIGGER_EVENT_CAPACITY];
+        event.sample_index = static_cast<int64_t>(entry.SampleIndex);
+        event.ring_position = first_sample_index_ < 0 ? -1 : event.sample_index - first_sample_index_;
+        event.micro_time = entry.MicroTime;
+        event.arrival_time = arrival_time;
+        event.type = entry.TriggerType;
+        event.code = entry.TriggerCode;
+    }
+    trigger_events_written_.store(written + num_triggers, std::memory_order_release);
+
+    return num_triggers;
+}
+
+/*
+Copy the trigger events added after read_cursor to events and advance the cursor. Events that were overwritten before
+they could be read are skipped. Returns the number of events copied.
+*/
+int dataHandler::getNewTriggerEvents(int64_t &read_cursor, std::vector<trigger_event> &events) {
+    events.clear();
+
+    int64_t written = trigger_events_written_.load(std::memory_order_acquire);
+    if (read_cursor > written) read_cursor = written;     // The handler was reset
+    int64_t first = std::max(read_cursor, written - TRIGGER_EVENT_CAPACITY);
+
+    for (int64_t i = first; i < written; i++) events.push_back(trigger_events_[i % TRIGGER_EVENT_CAPACITY]);
+
+    // Drop the events the acquisition thread may have overwritten during the copy. A packet being added can write up
+    // to MAX_PACKET_TRIGGERS slots past the published count.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    int64_t written_after = trigger_events_written_.load(std::memory_order_relaxed);
+    int64_t overwritten = std::max<int64_t>(0, written_after + static_cast<int64_t>(MAX_PACKET_TRIGGERS) - TRIGGER_EVENT_CAPACITY - first);
+    if (overwritten > 0) events.erase(events.begin(), events.begin() + std::min<int64_t>(overwritten, events.size()));
 
-        if (trigger_A == 1) { 
+    read_cursor = written;
+    return events.size();
+}
+
+/*
+End of measurement. The handler stops accepting samples and the waiting readers are woken, so the workers see the end
+right away instead of after the socket timeout. The session lists are written and the ring stays readable until the
+next MeasurementStart resets it.
+*/
+void dataHandler::endMeasurement() {
+    handler_state = WAITING_FOR_START;
+    wakeReaders();
+
+    save_seqnum_list();
+
+    last_packet_sequence_number_ = -1;
+    pending_gap_length_ = 0;
+}
+
+/*
+Add a whole packet of sample bundles (channels x bundles) in one pass. All bundles of a NeurOne packet share the
+packet sequence number and first sample time. Produces the same ring contents as calling addData for each bundle.
+*/
+void dataHandler::addPacket(const Eigen::Ref<const Eigen::MatrixXd> &samples, const int64_t &time_stamp, const Eigen::Ref<const Eigen::VectorXi> &triggers_A, const Eigen::Ref<const Eigen::VectorXi> &triggers_B, const int &SeqNo, const int64_t &arrival_time) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int num_bundles = samples.cols();
+    if (num_bundles == 0 || samples.rows() != channel_count_ || triggers_A.size() != num_bundles || triggers_B.size() != num_bundles) {
+        std::cerr << "Error: Packet dimensions do not match the handler." << std::endl;
+        return;
+    }
+
+    try {
+        int gap = getGapLength(SeqNo, num_bundles);
+        if (gap < 0) return;
+        claimRing(gap + num_bundles);
+        if (gap > 0) insertGap(gap, SeqNo, time_stamp);
+
+        // The block is processed in place, so it is first copied to its final position in the ring when possible
+        double *ring_columns = current_data_index_ + num_bundles <= static_cast<size_t>(buffer_capacity_) ? inPlaceRingColumns(current_data_index_) : nullptr;
+        if (ring_columns) {
+            Eigen::Map<Eigen::MatrixXd> block(ring_columns, channel_count_, num_bundles);
+            block = samples;
+            addBlock(block, time_stamp, triggers_A, triggers_B, SeqNo, arrival_time);
+        } else {
+            if (packet_staging_.cols() < num_bundles) packet_staging_.resize(channel_count_, num_bundles);
+            packet_staging_.leftCols(num_bundles) = samples;
+            addBlock(packet_staging_.leftCols(num_bundles), time_stamp, triggers_A, triggers_B, SeqNo, arrival_time);
+        }
+        tracer_.beginBatch(SeqNo, arrival_time);
+        tracer_.record(TRACE_ADD_DATA, arrival_time);
+    } catch (const std::exception& e) {
+        publishInvalidPacket(SeqNo, time_stamp);
+        std::cerr << "Datahandler exception: " << e.what() << '\n';
+        std::cerr << boost::stacktrace::stacktrace();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;
+    if(SeqNo > 100000) {
+        total_addData_time += duration;
+        min_addData_time = std::min(min_addData_time, duration);
+        max_addData_time = std::max(max_addData_time, duration);
+        addData_call_count++;
+        addData_bundle_count += num_bundles;
+    }
+}
+
+/*
+Preprocessing, triggering and storage of a block of sample bundles, processed in place. The block is either the next
+columns of the sample ring or packet_staging_. Each stage runs over the whole block before the next one starts. Only the
+recurrences (template update, geometric sum, FIR history) step through the columns, so the results match addSample
+exactly. Called only from the acquisition thread, after claimRing.
+*/
+void dataHandler::addBlock(Eigen::Ref<Eigen::MatrixXd> block, const int64_t &time_stamp, const Eigen::Ref<const Eigen::VectorXi> &triggers_A, const Eigen::Ref<const Eigen::VectorXi> &triggers_B, const int &SeqNo, const int64_t &arrival_time) {
+    int num_bundles = block.cols();
+    if (static_cast<int>(block_stage_flags_.size()) < num_bundles) {
+        block_stage_flags_.resize(num_bundles);
+        block_template_index_.resize(num_bundles);
+    }
+
+    // Tracker updates. The baseline average division is deferred to the baseline stage so that it happens between
+    // the same bundles as in addSample.
+    bool any_GA = false;
+    for (int i = 0; i < num_bundles; i++) {
+        uint8_t flags = 0;
+        if (triggers_A(i) == 1) {
             TA_tracker = SeqNo;
             if (GA_is_continuous) GA_tracker = SeqNo;
         }
 
         if (!GA_is_continuous && SeqNo - TA_tracker == TR_length - GA_shift_front) {
             GA_tracker = SeqNo;
-
-            // Calculate baseline average
-            baseline_average /= (TR_length - GA_shift_back - TA_length - GA_shift_front);
-            baseline_reset = true;
+            flags |= BLOCK_BASELINE_DIVIDE;
         }
 
-        // Check if TA, TR, and GA are in progress. GA is an extension of TA that covers the ramp up and down of the gradient.
-        TA_in_progress = TA_tracker > 0 && TA_tracker <= SeqNo && SeqNo < TA_tracker + TA_length;
-        TR_in_progress = TA_tracker > 0 && TA_tracker <= SeqNo && SeqNo < TA_tracker + TR_length;
-        GA_in_progress = GA_tracker > 0 && GA_tracker <= SeqNo && SeqNo < GA_tracker + GA_shift_front + TA_length + GA_shift_back;
-
-        // Gradient artifact correction
-        if (Apply_GACorr && GA_in_progress) {
+        if (TA_tracker > 0 && TA_tracker <= SeqNo && SeqNo < TA_tracker + TA_length) flags |= BLOCK_TA;
+        if (TA_tracker > 0 && TA_tracker <= SeqNo && SeqNo < TA_tracker + TR_length) flags |= BLOCK_TR;
+        if (GA_tracker > 0 && GA_tracker <= SeqNo && SeqNo < GA_tracker + GA_shift_front + TA_length + GA_shift_back) {
+            flags |= BLOCK_GA;
+            any_GA = true;
 
+            // A trigger A later in the packet moves GA_tracker, so the column is taken here for each bundle
             int temp_index = SeqNo - GA_tracker;
-
-            if (temp_index < 0) {
-                std::cerr << "Error: temp_index is negative." << std::endl;
+            if (Apply_GACorr && (temp_index < 0 || temp_index >= GACorr_.getTemplateSize())) {
+                std::cerr << "Error: temp_index outside of the GACorr template, packet stored as placeholders." << std::endl;
+                publishInvalidPacket(SeqNo, time_stamp);
                 return;
             }
+            block_template_index_[i] = temp_index;
+        }
+        block_stage_flags_[i] = flags;
+    }
+    TA_in_progress = block_stage_flags_[num_bundles - 1] & BLOCK_TA;
+    TR_in_progress = block_stage_flags_[num_bundles - 1] & BLOCK_TR;
+    GA_in_progress = block_stage_flags_[num_bundles - 1] & BLOCK_GA;
+
+    // Gradient artifact correction
+    if (Apply_GACorr && any_GA) {
+        for (int i = 0; i < num_bundles; i++) {
+            if (!(block_stage_flags_[i] & BLOCK_GA)) continue;
+            int temp_index = block_template_index_[i];
+            processing_sample_vector = GACorr_.getTemplateCol(temp_index);
+            GACorr_.update_template(temp_index, block.col(i));
+            block.col(i) -= processing_sample_vector;
+        }
+    }
 
-            if (temp_index >= GACorr_.getTemplateSize()) {
-                std::cerr << "Error: temp_index exceeds GACorr template size." << std::endl;
-                return;
-            }
+    // Apply baseline correction over runs of bundles in the same phase
+    for (int i = 0; i < num_bundles;) {
+        int run_end = i + 1;
+        while (run_end < num_bundles && block_stage_flags_[run_end] == (block_stage_flags_[i] & ~BLOCK_BASELINE_DIVIDE)) run_end++;
 
-            processing_sample_vector = samples - GACorr_.getTemplateCol(temp_index);
-            
-            GACorr_.update_template(temp_index, samples);
-        } else {
-            processing_sample_vector = samples;
+        if (block_stage_flags_[i] & BLOCK_BASELINE_DIVIDE) {
+            baseline_average /= (TR_length - GA_shift_back - TA_length - GA_shift_front);
+            baseline_reset = true;
         }
 
-        // Apply baseline correction
         if (Apply_baseline && !GA_is_continuous) {
-
-            if (GA_in_progress) {
-                GA_sum += processing_sample_vector;
-                processing_sample_vector += baseline_average - GA_average;
-            } else if (TR_in_progress) {
+            if (block_stage_flags_[i] & BLOCK_GA) {
+                for (int j = i; j < run_end; j++) GA_sum += block.col(j);
+                block.middleCols(i, run_end - i).colwise() += baseline_average - GA_average;
+            } else if (block_stage_flags_[i] & BLOCK_TR) {
                 if (baseline_reset) {
                     GA_average = GA_sum / (GA_shift_front + TA_length + GA_shift_back);
                     GA_sum.setZero();
                     baseline_average.setZero();
                     baseline_reset = false;
                 }
-                baseline_average += processing_sample_vector;
+                for (int j = i; j < run_end; j++) baseline_average += block.col(j);
             }
         }
+        i = run_end;
+    }
 
-        // Apply a geometric sum correction
-        if (Apply_geometric_sum) {
-            baseline_correction = (1 - baseline_update_rate) * baseline_correction + baseline_update_rate * processing_sample_vector;
-            processing_sample_vector -= baseline_correction;
+    // Apply a geometric sum correction
+    if (Apply_geometric_sum) {
+        for (int i = 0; i < num_bundles; i++) {
+            baseline_correction = (1 - baseline_update_rate) * baseline_correction + baseline_update_rate * block.col(i);
+            block.col(i) -= baseline_correction;
         }
+    }
 
-        // Filtering
-        if (Apply_filter) {
-            processing_sample_vector = RTfilter_.processSample(processing_sample_vector);
-        }
+    // Filtering
+    if (Apply_filter) {
+        RTfilter_.processBlock(block);
+    }
 
-        // Debug: Check buffer capacity before indexing
-        if (current_data_index_ >= buffer_capacity_) {
-            std::cerr << "Error: current_data_index exceeds buffer capacity." << std::endl;
-            return;
+    // Triggering. All bundles share SeqNo, so at most the first eligible bundle sends a pulse.
+    bool trigger_due = trigger_wheel_.due(SeqNo);
+    for (int i = 0; i < num_bundles; i++) {
+        size_t index = (current_data_index_ + i) % buffer_capacity_;
+        if (trigger_due && getTriggerEnableStatus() && !(block_stage_flags_[i] & BLOCK_TA) && firePulse()) {
+            seqNum_list.push_back(SeqNo);
+            if (arrival_time > 0) {
+                struct timespec trigger_time;
+                clock_gettime(CLOCK_REALTIME, &trigger_time);
+                int64_t trigger_ns = static_cast<int64_t>(trigger_time.tv_sec) * 1000000000LL + trigger_time.tv_nsec;
+                trigger_latency_list.push_back((trigger_ns - arrival_time) / 1e6);
+            }
+            tracer_.record(TRACE_SEND_TRIGGER, arrival_time);
+
+            trigger_wheel_.fire(SeqNo);
+            trigger_due = false;
+            trigger_buffer_out(index) = 1;
+        } else {
+            trigger_buffer_out(index) = 0;
         }
+    }
+    // The whole packet was blocked (TA, time limit or triggering disabled)
+    if (trigger_due) trigger_wheel_.suppress(SeqNo);
+    markScheduledPulses(num_bundles, SeqNo);
+
+    // Samples, timestamps, triggers and ROI means are copied as at most two contiguous segments
+    int first_part = std::min(num_bundles, buffer_capacity_ - static_cast<int>(current_data_index_));
+    int second_part = num_bundles - first_part;
+    // The ROI means are updated from the GUI thread, so they are skipped for this packet rather than waited for
+    std::unique_lock<std::mutex> ROI_lock(ROI_mutex, std::try_to_lock);
+    bool ROI_save = ROI_lock.owns_lock() && ROI_fMRI_means.size() > 0 && ROI_fMRI_means.size() == ROI_means_save.rows();
+
+    if (block.data() != inPlaceRingColumns(current_data_index_)) {
+        sample_ring_.writeColumns(current_data_index_, block.leftCols(first_part));
+    }
+    writeTimeStamps(current_data_index_, num_bundles, time_stamp);
+    arrival_time_buffer_.segment(current_data_index_, first_part).setConstant(arrival_time);
+    trigger_buffer_A.segment(current_data_index_, first_part) = triggers_A.head(first_part);
+    trigger_buffer_B.segment(current_data_index_, first_part) = triggers_B.head(first_part);
+    seqnum_buffer_.segment(current_data_index_, first_part).setConstant(SeqNo);
+    valid_buffer_.segment(current_data_index_, first_part).setOnes();
+    if (ROI_save) ROI_means_save.middleCols(current_data_index_, first_part).colwise() = ROI_fMRI_means;
+
+    current_data_index_ = (current_data_index_ + first_part) % buffer_capacity_;
+
+    if (second_part > 0) {
+        sample_ring_.writeColumns(0, block.rightCols(second_part));
+        arrival_time_buffer_.head(second_part).setConstant(arrival_time);
+        trigger_buffer_A.head(second_part) = triggers_A.tail(second_part);
+        trigger_buffer_B.head(second_part) = triggers_B.tail(second_part);
+        seqnum_buffer_.head(second_part).setConstant(SeqNo);
+        valid_buffer_.head(second_part).setOnes();
+        if (ROI_save) ROI_means_save.leftCols(second_part).colwise() = ROI_fMRI_means;
+
+        current_data_index_ = second_part % buffer_capacity_;
+    }
 
-        // Triggering
-        if (getTriggerEnableStatus() && shouldTrigger(SeqNo) && checkTimeLimit() && !TA_in_progress) {
-            latest_trigger_time = std::chrono::system_clock::now();
-            
-            if (getTriggerConnectStatus()) {
-                switch (TMS_connectionType) {
-                    case COM:
-                        send_trigger();
-                        break;
-                    case TTL:
-                        send_trigger_TTL();
-                        break;
-                }
-            }
-            
-            seqNum_list.push_back(SeqNo);
+    // The placeholders in front of this packet are published together with it
+    if (pending_gap_length_ > 0 && gap_fill_mode_ == GAP_FILL_LINEAR) interpolateGap();
+    last_packet_sequence_number_ = std::max(last_packet_sequence_number_, SeqNo);
+    publishRing(num_bundles + pending_gap_length_, SeqNo);
+    pending_gap_length_ = 0;
+}
 
-            removeTrigger(SeqNo);
-            trigger_buffer_out(current_data_index_) = 1;
+/*
+Mark the pulses fired by the scheduler thread in trigger_buffer_out and seqNum_list, as the triggering stage does for
+the pulses it sends. A pulse usually fires before the packet of its target sample arrives, so it waits until that
+sample is stored. The target sample is mapped to a ring position with first_sample_index_, like the amplifier trigger
+events. A target that is already published is only added to seqNum_list, published columns are not modified. Called
+from the triggering stage of addBlock and addSample, before the block and the placeholders in front of it are published.
+*/
+void dataHandler::markScheduledPulses(int num_bundles, int SeqNo) {
+    int64_t fired = scheduled_pulses_written_.load(std::memory_order_acquire);
+    scheduled_pulses_read_ = std::max(scheduled_pulses_read_, fired - SCHEDULED_PULSE_CAPACITY);
+    for (; scheduled_pulses_read_ < fired; scheduled_pulses_read_++) {
+        if (first_sample_index_ < 0 || pending_scheduled_pulses_.size() >= SCHEDULED_PULSE_CAPACITY) continue;
+        pending_scheduled_pulses_.push_back(scheduled_pulses_[scheduled_pulses_read_ % SCHEDULED_PULSE_CAPACITY] - first_sample_index_);
+    }
+    if (pending_scheduled_pulses_.empty()) return;
+
+    int64_t published = samples_written_.load(std::memory_order_relaxed);
+    int64_t block_start = published + pending_gap_length_;
+    int64_t block_end = block_start + num_bundles;
+    size_t kept = 0;
+    for (int64_t position : pending_scheduled_pulses_) {
+        if (position >= block_end) {
+            pending_scheduled_pulses_[kept++] = position;
+            continue;
+        }
+        if (position < 0 || position <= published - buffer_capacity_) continue;
+
+        size_t index = position % buffer_capacity_;
+        if (position >= published) {
+            trigger_buffer_out(index) = 1;
+            seqNum_list.push_back(position >= block_start ? SeqNo : seqnum_buffer_(index));
         } else {
-            trigger_buffer_out(current_data_index_) = 0;
+            seqNum_list.push_back(seqnum_buffer_(index));
         }
-        
-        // Samples, timestamp, triggers, and buffer index update
-        sample_buffer_.col(current_data_index_) = processing_sample_vector;
-        time_stamp_buffer_(current_data_index_) = time_stamp;
-        trigger_buffer_A(current_data_index_) = trigger_A;
-        trigger_buffer_B(current_data_index_) = trigger_B;
-        
-        // Save ROI means at the current index
-        if (ROI_fMRI_means.size() > 0 && ROI_fMRI_means.size() == ROI_means_save.rows()) {
-            ROI_means_save.col(current_data_index_) = ROI_fMRI_means;
+    }
+    pending_scheduled_pulses_.resize(kept);
+}
+
+/*
+Number of placeholder samples needed in front of a packet. Missing packets are assumed to have as many bundles as
+the received one. Gaps longer than max_gap_fill_ms_ are filled only up to that length. Returns -1 for a packet that
+arrives after a later one (reordered or duplicated): its placeholders are already published, so it is dropped and
+counted to keep the ring aligned to PacketSeqNo.
+*/
+int dataHandler::getGapLength(int SeqNo, int num_bundles) {
+    if (gap_fill_mode_ == GAP_FILL_OFF || last_packet_sequence_number_ < 0) return 0;
+    if (SeqNo <= last_packet_sequence_number_) {
+        late_packet_count_++;
+        return -1;
+    }
+    if (SeqNo == last_packet_sequence_number_ + 1) return 0;
+
+    int64_t missing_packets = static_cast<int64_t>(SeqNo) - last_packet_sequence_number_ - 1;
+    int64_t missing_samples = missing_packets * num_bundles;
+    int64_t max_gap_fill = std::min<int64_t>(static_cast<int64_t>(max_gap_fill_ms_) * sampling_rate_ / 1000, buffer_capacity_ / 2);
+    if (missing_samples > max_gap_fill) {
+        std::cerr << "Gap of " << missing_samples << " samples is longer than the fill limit, only " << max_gap_fill << " placeholders are inserted." << std::endl;
+        missing_samples = max_gap_fill;
+    }
+    gap_count_++;
+    gap_samples_filled_ += missing_samples;
+    return static_cast<int>(missing_samples);
+}
+
+/*
+Write placeholder samples for the missing packets in front of the packet SeqNo. The samples repeat the last stored
+sample or are zero; linear placeholders are written as last-value here and interpolated once the next packet has been
+processed (interpolateGap). They are marked invalid in valid_buffer_ and are published together with the next packet.
+*/
+void dataHandler::insertGap(int num_samples, int SeqNo, int64_t time_stamp) {
+    int previous_index = (static_cast<int>(current_data_index_) + buffer_capacity_ - 1) % buffer_capacity_;
+    int missing_packets = SeqNo - last_packet_sequence_number_ - 1;
+    int samples_per_packet = std::max(1, num_samples / std::max(1, missing_packets));
+
+    pending_gap_start_ = current_data_index_;
+    for (int i = 0; i < num_samples; i++) {
+        size_t index = (current_data_index_ + i) % buffer_capacity_;
+        int packet = std::min(i / samples_per_packet, missing_packets - 1);
+
+        if (gap_fill_mode_ == GAP_FILL_ZERO) sample_ring_.setColumnZero(index);
+        else sample_ring_.copyColumn(previous_index, index);
+
+        time_stamp_buffer_(index) = time_stamp - samplesToMicroseconds(num_samples - i);
+        arrival_time_buffer_(index) = 0;
+        trigger_buffer_A(index) = 0;
+        trigger_buffer_B(index) = 0;
+        trigger_buffer_out(index) = 0;
+        seqnum_buffer_(index) = last_packet_sequence_number_ + 1 + packet;
+        valid_buffer_(index) = 0;
+    }
+    pending_gap_length_ = num_samples;
+    current_data_index_ = (current_data_index_ + num_samples) % buffer_capacity_;
+}
+
+int64_t dataHandler::sampleTimeStamp(int64_t sample_index, int64_t first_sample_time) {
+    if (time_anchor_index_ >= 0) {
+        int64_t derived = time_anchor_us_ + samplesToMicroseconds(sample_index - time_anchor_index_);
+        if (std::llabs(derived - first_sample_time) <= TIME_STAMP_REANCHOR_US) return derived;
+    }
+    time_anchor_index_ = sample_index;
+    time_anchor_us_ = first_sample_time;
+    return first_sample_time;
+}
+
+int64_t dataHandler::samplesToMicroseconds(int64_t samples) const {
+    if (sampling_rate_ <= 0) return 0;
+    int64_t magnitude = (std::llabs(samples) * 1000000 + sampling_rate_ / 2) / sampling_rate_;
+    return samples < 0 ? -magnitude : magnitude;
+}
+
+// Per bundle time stamps of a packet, written to the ring from position start on
+void dataHandler::writeTimeStamps(size_t start, int count, int64_t first_time_stamp) {
+    for (int i = 0; i < count; i++) {
+        time_stamp_buffer_((start + i) % buffer_capacity_) = first_time_stamp + samplesToMicroseconds(i);
+    }
+}
+
+// Linear placeholders between the sample before the gap and the first sample of the packet after it
+void dataHandler::interpolateGap() {
+    int previous_index = (static_cast<int>(pending_gap_start_) + buffer_capacity_ - 1) % buffer_capacity_;
+    int next_index = (static_cast<int>(pending_gap_start_) + pending_gap_length_) % buffer_capacity_;
+
+    for (int i = 0; i < pending_gap_length_; i++) {
+        size_t index = (pending_gap_start_ + i) % buffer_capacity_;
+        SampleScalar weight = static_cast<SampleScalar>(i + 1) / (pending_gap_length_ + 1);
+        sample_ring_.interpolateColumn(index, previous_index, next_index, weight);
+    }
+}
+
+/*
+Publish the claimed columns of a packet that failed after claimRing as placeholders, like the samples of a lost packet.
+The columns may already hold part of the packet, so they are overwritten before they are published. The claim is kept:
+samples_claimed_ only moves forward, so a reader never sees a published position being reused. Nothing is done if the
+packet was already published.
+*/
+void dataHandler::publishInvalidPacket(int SeqNo, int64_t time_stamp) {
+    int64_t claimed = samples_claimed_.load(std::memory_order_relaxed) - samples_written_.load(std::memory_order_relaxed);
+    int num_bundles = static_cast<int>(claimed) - pending_gap_length_;
+    if (num_bundles <= 0) return;
+
+    int previous_index = (static_cast<int>(current_data_index_) + buffer_capacity_ - 1) % buffer_capacity_;
+    for (int i = 0; i < num_bundles; i++) {
+        size_t index = (current_data_index_ + i) % buffer_capacity_;
+
+        if (gap_fill_mode_ == GAP_FILL_ZERO) sample_ring_.setColumnZero(index);
+        else sample_ring_.copyColumn(previous_index, index);
+
+        time_stamp_buffer_(index) = time_stamp + samplesToMicroseconds(i);
+        arrival_time_buffer_(index) = 0;
+        trigger_buffer_A(index) = 0;
+        trigger_buffer_B(index) = 0;
+        trigger_buffer_out(index) = 0;
+        seqnum_buffer_(index) = SeqNo;
+        valid_buffer_(index) = 0;
+    }
+    current_data_index_ = (current_data_index_ + num_bundles) % buffer_capacity_;
+    invalid_packet_count_++;
+
+    last_packet_sequence_number_ = std::max(last_packet_sequence_number_, SeqNo);
+    publishRing(num_bundles + pending_gap_length_, SeqNo);
+    pending_gap_length_ = 0;
+}
+
+// Preprocessing, triggering and storage of a single sample bundle. Called only from the acquisition thread, after claimRing.
+void dataHandler::addSample(const Eigen::Ref<const Eigen::VectorXd> &samples, const int64_t &time_stamp, const int &trigger_A, const int &trigger_B, const int &SeqNo, const int64_t &arrival_time) {
+    if (trigger_A == 1) { 
+        TA_tracker = SeqNo;
+        if (GA_is_continuous) GA_tracker = SeqNo;
+    }
+
+    if (!GA_is_continuous && SeqNo - TA_tracker == TR_length - GA_shift_front) {
+        GA_tracker = SeqNo;
+
+        // Calculate baseline average
+        baseline_average /= (TR_length - GA_shift_back - TA_length - GA_shift_front);
+        baseline_reset = true;
+    }
+
+    // Check if TA, TR, and GA are in progress. GA is an extension of TA that covers the ramp up and down of the gradient.
+    TA_in_progress = TA_tracker > 0 && TA_tracker <= SeqNo && SeqNo < TA_tracker + TA_length;
+    TR_in_progress = TA_tracker > 0 && TA_tracker <= SeqNo && SeqNo < TA_tracker + TR_length;
+    GA_in_progress = GA_tracker > 0 && GA_tracker <= SeqNo && SeqNo < GA_tracker + GA_shift_front + TA_length + GA_shift_back;
+
+    // Gradient artifact correction
+    if (Apply_GACorr && GA_in_progress) {
+
+        int temp_index = SeqNo - GA_tracker;
+
+        if (temp_index < 0) {
+            std::cerr << "Error: temp_index is negative." << std::endl;
+            return;
+        }
+
+        if (temp_index >= GACorr_.getTemplateSize()) {
+            std::cerr << "Error: temp_index exceeds GACorr template size." << std::endl;
+            return;
         }
+
+        processing_sample_vector = samples - GACorr_.getTemplateCol(temp_index);
         
-        current_sequence_number_ = SeqNo;
-        current_data_index_ = (current_data_index_ + 1) % buffer_capacity_;
-
-        if (current_data_index_ == 0) {
-            sample_buffer_save.row(sample_buffer_save_index) = sample_buffer_.row(4);
-            sample_buffer_save_index++;
-            std::cout << "Row saved " << sample_buffer_save_index << std::endl;
-        } else if (SeqNo >= 1500000 && data_saved == false) {
-            writeMatrixdToCSV("sample_buffer_save.csv", sample_buffer_save);
-            data_saved = true;
+        GACorr_.update_template(temp_index, samples);
+    } else {
+        processing_sample_vector = samples;
+    }
+
+    // Apply baseline correction
+    if (Apply_baseline && !GA_is_continuous) {
+
+        if (GA_in_progress) {
+            GA_sum += processing_sample_vector;
+            processing_sample_vector += baseline_average - GA_average;
+        } else if (TR_in_progress) {
+            if (baseline_reset) {
+                GA_average = GA_sum / (GA_shift_front + TA_length + GA_shift_back);
+                GA_sum.setZero();
+                baseline_average.setZero();
+                baseline_reset = false;
+            }
+            baseline_average += processing_sample_vector;
         }
+    }
 
-    } catch (const std::exception& e) {
-        std::cerr << "Datahandler exception: " << e.what() << '\n';
-        std::cerr << boost::stacktrace::stacktrace();
+    // Apply a geometric sum correction
+    if (Apply_geometric_sum) {
+        baseline_correction = (1 - baseline_update_rate) * baseline_correction + baseline_update_rate * processing_sample_vector;
+        processing_sample_vector -= baseline_correction;
     }
 
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> duration = end - start;  // Explicitly specify duration type
-    if(SeqNo > 100000) {
-        total_addData_time += duration;
-        min_addData_time = std::min(min_addData_time, duration);
-        max_addData_time = std::max(max_addData_time, duration);
-        addData_call_count++;
+    // Filtering
+    if (Apply_filter) {
+        processing_sample_vector = RTfilter_.processSample(processing_sample_vector);
+    }
+
+    // Debug: Check buffer capacity before indexing
+    if (current_data_index_ >= buffer_capacity_) {
+        std::cerr << "Error: current_data_index exceeds buffer capacity." << std::endl;
+        return;
+    }
+
+    // Triggering. A blocked target stays pending for the other samples of the packet.
+    if (trigger_wheel_.due(SeqNo) && getTriggerEnableStatus() && !TA_in_progress && firePulse()) {
+        seqNum_list.push_back(SeqNo);
+        if (arrival_time > 0) {
+            struct timespec trigger_time;
+            clock_gettime(CLOCK_REALTIME, &trigger_time);
+            int64_t trigger_ns = static_cast<int64_t>(trigger_time.tv_sec) * 1000000000LL + trigger_time.tv_nsec;
+            trigger_latency_list.push_back((trigger_ns - arrival_time) / 1e6);
+        }
+        tracer_.record(TRACE_SEND_TRIGGER, arrival_time);
+
+        trigger_wheel_.fire(SeqNo);
+        trigger_buffer_out(current_data_index_) = 1;
+    } else {
+        trigger_buffer_out(current_data_index_) = 0;
+    }
+    markScheduledPulses(1, SeqNo);
+    
+    // Samples, timestamp, triggers, and buffer index update
+    sample_ring_.writeColumns(current_data_index_, processing_sample_vector);
+    time_stamp_buffer_(current_data_index_) = time_stamp;
+    arrival_time_buffer_(current_data_index_) = arrival_time;
+    trigger_buffer_A(current_data_index_) = trigger_A;
+    trigger_buffer_B(current_data_index_) = trigger_B;
+    seqnum_buffer_(current_data_index_) = SeqNo;
+    valid_buffer_(current_data_index_) = 1;
+    
+    // Save ROI means at the current index, skipped if the GUI thread is updating them
+    {
+        std::unique_lock<std::mutex> ROI_lock(ROI_mutex, std::try_to_lock);
+        if (ROI_lock.owns_lock() && ROI_fMRI_means.size() > 0 && ROI_fMRI_means.size() == ROI_means_save.rows()) {
+            ROI_means_save.col(current_data_index_) = ROI_fMRI_means;
+        }
     }
+    
+    current_data_index_ = (current_data_index_ + 1) % buffer_capacity_;
+
+    // Debug dump of channel 5 on every wrap of the ring, at most sample_buffer_save.rows() wraps
+    if (current_data_index_ == 0 && sample_buffer_save_index < sample_buffer_save.rows() && channel_count_ > 4) {
+        sample_ring_.readChannel(4, sample_buffer_save.row(sample_buffer_save_index).transpose());
+        sample_buffer_save_index++;
+        std::cout << "Row saved " << sample_buffer_save_index << std::endl;
+    } else if (SeqNo >= 1500000 && data_saved == false) {
+        writeMatrixdToCSV("sample_buffer_save.csv", sample_buffer_save);
+        data_saved = true;
+    }
+
+    publishRing(1, SeqNo);
 }
 
+/*
+Copy the latest number_of_samples samples from the ring. Readers never block the acquisition thread: the write cursor
+is read before the copy and the claim cursor after it. If the producer claimed the copied columns in the meantime the
+copy is retried. Returns the sequence number of the newest copied sample.
+*/
 int dataHandler::getLatestDataAndTriggers(Eigen::MatrixXd &output, 
                                           Eigen::VectorXi &triggers_A, 
                                           Eigen::VectorXi &triggers_B, 
                                           Eigen::VectorXi &triggers_out, 
-                                          Eigen::VectorXd &time_stamps, 
+                                          VectorXi64 &time_stamps, 
                                                       int number_of_samples) {
 
-    if (last_retrieved_sequence_number_ == current_sequence_number_) {
-        return current_sequence_number_;
-    }
+    std::shared_lock<std::shared_mutex> ring_lock(ring_mutex);
+    if (!isReady() || number_of_samples > buffer_capacity_) return current_sequence_number_.load(std::memory_order_acquire);
 
     // Ensure matrices are resized correctly
     if (output.rows() != channel_count_ || output.cols() != number_of_samples) output.resize(channel_count_, number_of_samples);
@@ -241,49 +813,170 @@ int dataHandler::getLatestDataAndTriggers(Eigen::MatrixXd &output,
     if (triggers_out.cols() != number_of_samples) triggers_out.resize(number_of_samples);
     if (time_stamps.cols() != number_of_samples) time_stamps.resize(number_of_samples);
 
-    // Calculate the number of samples that fit before reaching the end of the buffer
-    int fitToEnd = std::min(number_of_samples, static_cast<int>(current_data_index_));
-    int overflow = number_of_samples - fitToEnd;
+    for (int attempt = 0; attempt < RING_READ_ATTEMPTS; attempt++) {
+        int64_t written = samples_written_.load(std::memory_order_acquire);
+        int data_index = static_cast<int>(written % buffer_capacity_);
+
+        // Calculate the number of samples that fit before reaching the end of the buffer
+        int fitToEnd = std::min(number_of_samples, data_index);
+        int overflow = number_of_samples - fitToEnd;
+
+        if (fitToEnd > 0) {
+            sample_ring_.readColumns(data_index - fitToEnd, fitToEnd, output.rightCols(fitToEnd));
+            triggers_A.tail(fitToEnd) = trigger_buffer_A.segment(data_index - fitToEnd, fitToEnd);
+            triggers_B.tail(fitToEnd) = trigger_buffer_B.segment(data_index - fitToEnd, fitToEnd);
+            triggers_out.tail(fitToEnd) = trigger_buffer_out.segment(data_index - fitToEnd, fitToEnd);
+            time_stamps.tail(fitToEnd) = time_stamp_buffer_.segment(data_index - fitToEnd, fitToEnd);
+        }
 
-    std::lock_guard<std::mutex> lock(this->dataMutex); // Protect shared data access
+        if (overflow > 0) {
+            sample_ring_.readColumns(buffer_capacity_ - overflow, overflow, output.leftCols(overflow));
+            triggers_A.head(overflow) = trigger_buffer_A.segment(buffer_capacity_ - overflow, overflow);
+            triggers_B.head(overflow) = trigger_buffer_B.segment(buffer_capacity_ - overflow, overflow);
+            triggers_out.head(overflow) = trigger_buffer_out.segment(buffer_capacity_ - overflow, overflow);
+            time_stamps.head(overflow) = time_stamp_buffer_.segment(buffer_capacity_ - overflow, overflow);
+        }
+        int sequence_number = seqnum_buffer_((data_index + buffer_capacity_ - 1) % buffer_capacity_);
 
-    // Debugging check before accessing rightCols and middleCols
-    if (fitToEnd > 0) {
-        output.rightCols(fitToEnd) = sample_buffer_.middleCols(current_data_index_ - fitToEnd, fitToEnd);
-        triggers_A.tail(fitToEnd) = trigger_buffer_A.segment(current_data_index_ - fitToEnd, fitToEnd);
-        triggers_B.tail(fitToEnd) = trigger_buffer_B.segment(current_data_index_ - fitToEnd, fitToEnd);
-        triggers_out.tail(fitToEnd) = trigger_buffer_out.segment(current_data_index_ - fitToEnd, fitToEnd);
-        time_stamps.tail(fitToEnd) = time_stamp_buffer_.segment(current_data_index_ - fitToEnd, fitToEnd);
+        // Valid if the producer has not claimed any of the copied columns during the copy
+        std::atomic_thread_fence(std::memory_order_acquire);
+        int64_t claimed = samples_claimed_.load(std::memory_order_relaxed);
+        if (claimed - buffer_capacity_ <= written - number_of_samples) return sequence_number;
     }
 
-    // Debugging check before accessing leftCols and middleCols
-    if (overflow > 0) {
-        output.leftCols(overflow) = sample_buffer_.middleCols(buffer_capacity_ - overflow, overflow);
-        triggers_A.head(overflow) = trigger_buffer_A.segment(buffer_capacity_ - overflow, overflow);
-        triggers_B.head(overflow) = trigger_buffer_B.segment(buffer_capacity_ - overflow, overflow);
-        triggers_out.head(overflow) = trigger_buffer_out.segment(buffer_capacity_ - overflow, overflow);
-        time_stamps.head(overflow) = time_stamp_buffer_.segment(buffer_capacity_ - overflow, overflow);
+    std::cerr << "Error: Ring reader was overrun by the producer " << RING_READ_ATTEMPTS << " times." << std::endl;
+    return current_sequence_number_.load(std::memory_order_acquire);
+}
+
+/*
+Incremental read. Copies the samples published after read_cursor (total number of samples read by this reader) into
+the first columns of the outputs and advances the cursor. At most max_samples are returned; if the reader has fallen
+further behind, the older samples are skipped. The outputs are resized to max_samples columns only when needed, so
+preallocated buffers are reused. arrival_times holds the kernel receive time of the packet of each sample (ns,
+CLOCK_REALTIME, 0 for placeholders). valid is 0 for placeholders of lost packets. Returns the number of new samples, 0 if
+there are none.
+*/
+int dataHandler::getNewDataAndTriggers(int64_t &read_cursor,
+                                       SampleMatrix &output, 
+                                       Eigen::VectorXi &triggers_A, 
+                                       Eigen::VectorXi &triggers_B, 
+                                       Eigen::VectorXi &triggers_out, 
+                                       VectorXi64 &time_stamps, 
+                                       VectorXi64 &arrival_times, 
+                                       Eigen::VectorXi &valid, 
+                                                   int max_samples,
+                                                   int &sequence_number) {
+
+    std::shared_lock<std::shared_mutex> ring_lock(ring_mutex);
+    if (!isReady() || max_samples <= 0) return 0;
+    max_samples = std::min(max_samples, buffer_capacity_);
+
+    if (output.rows() != channel_count_ || output.cols() < max_samples) output.resize(channel_count_, max_samples);
+    if (triggers_A.size() < max_samples) triggers_A.resize(max_samples);
+    if (triggers_B.size() < max_samples) triggers_B.resize(max_samples);
+    if (triggers_out.size() < max_samples) triggers_out.resize(max_samples);
+    if (time_stamps.size() < max_samples) time_stamps.resize(max_samples);
+    if (arrival_times.size() < max_samples) arrival_times.resize(max_samples);
+    if (valid.size() < max_samples) valid.resize(max_samples);
+
+    for (int attempt = 0; attempt < RING_READ_ATTEMPTS; attempt++) {
+        int64_t written = samples_written_.load(std::memory_order_acquire);
+        if (read_cursor > written) read_cursor = written;     // The ring was reset
+        if (read_cursor == written) return 0;
+
+        int64_t first = std::max(read_cursor, written - max_samples);
+        int number_of_samples = static_cast<int>(written - first);
+        int start_index = static_cast<int>(first % buffer_capacity_);
+
+        // Copy as at most two contiguous segments
+        int fitToEnd = std::min(number_of_samples, buffer_capacity_ - start_index);
+        int overflow = number_of_samples - fitToEnd;
+
+        sample_ring_.readColumns(start_index, fitToEnd, output.leftCols(fitToEnd));
+        triggers_A.head(fitToEnd) = trigger_buffer_A.segment(start_index, fitToEnd);
+        triggers_B.head(fitToEnd) = trigger_buffer_B.segment(start_index, fitToEnd);
+        triggers_out.head(fitToEnd) = trigger_buffer_out.segment(start_index, fitToEnd);
+        time_stamps.head(fitToEnd) = time_stamp_buffer_.segment(start_index, fitToEnd);
+        arrival_times.head(fitToEnd) = arrival_time_buffer_.segment(start_index, fitToEnd);
+        valid.head(fitToEnd) = valid_buffer_.segment(start_index, fitToEnd);
+
+        if (overflow > 0) {
+            sample_ring_.readColumns(0, overflow, output.middleCols(fitToEnd, overflow));
+            triggers_A.segment(fitToEnd, overflow) = trigger_buffer_A.head(overflow);
+            triggers_B.segment(fitToEnd, overflow) = trigger_buffer_B.head(overflow);
+            triggers_out.segment(fitToEnd, overflow) = trigger_buffer_out.head(overflow);
+            time_stamps.segment(fitToEnd, overflow) = time_stamp_buffer_.head(overflow);
+            arrival_times.segment(fitToEnd, overflow) = arrival_time_buffer_.head(overflow);
+            valid.segment(fitToEnd, overflow) = valid_buffer_.head(overflow);
+        }
+        int latest_sequence_number = seqnum_buffer_(static_cast<int>((written - 1) % buffer_capacity_));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        int64_t claimed = samples_claimed_.load(std::memory_order_relaxed);
+        if (claimed - buffer_capacity_ <= first) {
+            read_cursor = written;
+            sequence_number = latest_sequence_number;
+            return number_of_samples;
+        }
     }
 
-    last_retrieved_sequence_number_ = current_sequence_number_;
-    return current_sequence_number_;
+    std::cerr << "Error: Ring reader was overrun by the producer " << RING_READ_ATTEMPTS << " times." << std::endl;
+    return 0;
 }
 
+/*
+Block until samples beyond read_cursor have been published or timeout_ms has passed. Returns true if new samples are
+available. The wait is a futex on wake_sequence_: a wakeup between the check and the wait changes the futex word, so
+the kernel returns immediately and no notification is lost.
+*/
+bool dataHandler::waitForNewData(int64_t read_cursor, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while (true) {
+        int sequence = wake_sequence_.load(std::memory_order_seq_cst);
+        if (samples_written_.load(std::memory_order_acquire) != read_cursor) return true;
+
+        auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::steady_clock::duration::zero()) return false;
+
+        auto remaining_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        struct timespec timeout;
+        timeout.tv_sec = remaining_ns / 1000000000LL;
+        timeout.tv_nsec = remaining_ns % 1000000000LL;
+
+        wake_waiters_.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, reinterpret_cast<int *>(&wake_sequence_), FUTEX_WAIT_PRIVATE, sequence, &timeout, nullptr, 0);
+        wake_waiters_.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+// Called by the acquisition thread. The futex syscall is skipped when nobody is waiting.
+void dataHandler::wakeReaders() {
+    wake_sequence_.fetch_add(1, std::memory_order_seq_cst);
+    if (wake_waiters_.load(std::memory_order_seq_cst) > 0) {
+        syscall(SYS_futex, reinterpret_cast<int *>(&wake_sequence_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
+
+// Only reads the ring, so a torn column at the write position is possible but the acquisition thread is never blocked
 void dataHandler::updateSignalViewerData() {
-    if (isReady()) {
-        std::lock_guard<std::mutex> lock(this->dataMutex);
-        if(sample_buffer_.rows() > 0) {
-            int n_raw_channels = std::min(12, static_cast<int>(sample_buffer_.rows()));
+    if (channel_data_callback_ && isReady()) {
+        std::shared_lock<std::shared_mutex> ring_lock(ring_mutex);
+        if(sample_ring_.rows() > 0) {
+            size_t data_index = samples_written_.load(std::memory_order_acquire) % buffer_capacity_;
+            int n_raw_channels = std::min(12, sample_ring_.rows());
             // Raw channels (0-11)
             for (int i = 0; i < n_raw_channels; i++) {
-                emit channelDataUpdated(i, sample_buffer_.row(i), trigger_buffer_A, 
-                                      trigger_buffer_B, trigger_buffer_out, time_stamp_buffer_, current_data_index_, channel_names_[i]);
+                sample_ring_.readChannel(i, viewer_channel_);
+                channel_data_callback_(i, viewer_channel_, trigger_buffer_A, 
+                                      trigger_buffer_B, trigger_buffer_out, time_stamp_buffer_, data_index, channel_names_[i]);
             }
 
             // ROI channels (12+)
+            std::lock_guard<std::mutex> ROI_lock(ROI_mutex);
             for (int i = 0; i < ROI_means_save.rows(); i++) {
-                emit channelDataUpdated(i + n_raw_channels, ROI_means_save.row(i), trigger_buffer_A, 
-                                      trigger_buffer_B, trigger_buffer_out, time_stamp_buffer_, current_data_index_, ROI_names[i]);
+                channel_data_callback_(i + n_raw_channels, ROI_means_save.row(i), trigger_buffer_A, 
+                                      trigger_buffer_B, trigger_buffer_out, time_stamp_buffer_, data_index, ROI_names[i]);
             }
         }
     }
@@ -297,6 +990,63 @@ void dataHandler::updateSignalViewerData() {
 
 // MAGPRO FUNCTIONS
 
+void dataHandler::setTriggerScheduling(bool state) {
+    if (state) {
+        trigger_scheduler_.start([this](const scheduled_trigger &trigger) { return fireScheduledTrigger(trigger); });
+    } else {
+        trigger_scheduler_.stop();
+    }
+}
+
+bool dataHandler::scheduleTrigger(int64_t target_sample, int64_t deadline_ns, int reference_seqNum) {
+    if (!getTriggerEnableStatus() || deadline_ns <= 0) return false;
+
+    // Estimates closer than the trigger time limit are refinements of the same target
+    trigger_scheduler_.setMinimumSeparation(static_cast<int64_t>(time_limit) * sampling_rate_ / 1000);
+    return trigger_scheduler_.schedule({target_sample, deadline_ns, reference_seqNum});
+}
+
+/*
+Called by the scheduler thread at the deadline of a target. Returns false if the pulse is suppressed by the trigger
+state or the time limit.
+*/
+bool dataHandler::fireScheduledTrigger(const scheduled_trigger &trigger) {
+    if (!getTriggerEnableStatus() || !firePulse()) return false;
+
+    tracer_.stamp(TRACE_SEND_TRIGGER, trigger.reference_seqNum);
+
+    // The ring is written only by the acquisition thread, which marks the pulse once its target sample is stored
+    int64_t written = scheduled_pulses_written_.load(std::memory_order_relaxed);
+    scheduled_pulses_[written % SCHEDULED_PULSE_CAPACITY] = trigger.target_sample;
+    scheduled_pulses_written_.store(written + 1, std::memory_order_release);
+    return true;
+}
+
+/*
+Send a pulse through the connected trigger output if the trigger time limit allows it. The triggering stage of the
+acquisition thread and the scheduler thread both fire pulses, so the time limit check, the update of
+latest_trigger_time and the send are one step under trigger_fire_mutex_. A thread that finds the mutex taken does not
+wait: the pulse being sent by the other thread blocks this one by the time limit anyway. Returns true if the pulse
+was sent (or recorded without a connection).
+*/
+bool dataHandler::firePulse() {
+    std::unique_lock<std::mutex> fire_lock(trigger_fire_mutex_, std::try_to_lock);
+    if (!fire_lock.owns_lock() || !checkTimeLimit()) return false;
+    latest_trigger_time = std::chrono::steady_clock::now();
+
+    if (getTriggerConnectStatus()) {
+        switch (TMS_connectionType) {
+            case COM:
+                send_trigger();
+                break;
+            case TTL:
+                send_trigger_TTL();
+                break;
+        }
+    }
+    return true;
+}
+
 int dataHandler::connectTriggerPort() {
     return magPro_3G.connectTriggerPort();
 }
@@ -388,7 +1138,6 @@ void dataHandler::savePreprocessingOutput(const Eigen::MatrixXd &output) {
     if (PreProcessing_output_save.cols() != buffer_capacity_) {
         PreProcessing_output_save.resize(number_of_EEG_channels, buffer_capacity_);
         save_index_tracker = 0;
-        current_data_index_ = 0;
     }
 
     int n_samples = output.cols();
@@ -421,7 +1170,7 @@ void dataHandler::savePreprocessingOutput(const Eigen::MatrixXd &output) {
 }
 
 void dataHandler::setROIMeans(const Eigen::VectorXd& means) {
-    std::lock_guard<std::mutex> lock(this->dataMutex);
+    std::lock_guard<std::mutex> lock(ROI_mutex);
     if (ROI_means_save.rows() != means.size() || ROI_means_save.cols() != buffer_capacity_) {
         ROI_means_save.resize(means.size(), buffer_capacity_);
         ROI_means_save.setZero();
@@ -430,7 +1179,7 @@ void dataHandler::setROIMeans(const Eigen::VectorXd& means) {
 }
 
 Eigen::VectorXd dataHandler::getROIMeanData(int roiIndex) {
-    std::lock_guard<std::mutex> lock(this->dataMutex);
+    std::lock_guard<std::mutex> lock(ROI_mutex);
     if (roiIndex >= 0 && roiIndex < ROI_means_save.rows()) {
         return ROI_means_save.row(roiIndex);
     }
@@ -2,6 +2,8 @@
 #define DATAHANDLER_H
 
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include <condition_variable>
 #include <queue>
 
@@ -10,87 +12,164 @@
 #include <chrono>
 #include <array>
 #include <vector>
-#include <unordered_set>
 #include <cmath>
 #include <iomanip>
+#include <functional>
+#include <string>
 #include <Eigen/Dense>
 #include <LabJackM.h>
-#include <QObject>
-#include <QTimer>
-#include <QDebug>
 
 #include "EEG/preprocessing/GACorrection.h"
 #include "devices/TMS/magPro/magPro.h"
 #include "../EEG/preprocessing/preprocessingFunctions.h"
 #include "../utils/utilityFunctions.h"
-#include "devices/EEG/eeg_bridge/eeg_bridge.h"
+#include "../utils/latencyTracer.h"
+#include "clockModel.h"
+#include "triggerScheduler.h"
+#include "triggerWheel.h"
+#include "sampleRing.h"
+#include "devices/EEG/eeg_bridge/samplePacket.h"
+#include "devices/EEG/eeg_bridge/triggerPacket.h"
 #include <boost/stacktrace.hpp>
 
 // In case the bind fails, use the following commands to find the PID and kill the process:
 // lsof -i :8080
 // kill -9 PID
 
+// Column vector of 64-bit integers, used for nanosecond/microsecond timestamps
+typedef Eigen::Matrix<int64_t, Eigen::Dynamic, 1> VectorXi64;
+
+// Largest accepted difference between a packet FirstSampleTime and the time derived from its sample index
+#define TIME_STAMP_REANCHOR_US 1000
+
+// Number of times a ring reader retries a copy that was overrun by the acquisition thread
+#define RING_READ_ATTEMPTS 4
+
 enum HandlerState {
   WAITING_FOR_START,
   WAITING_FOR_STOP
 };
 
+// Number of amplifier trigger events kept for the readers
+#define TRIGGER_EVENT_CAPACITY 1024
+// Pulses of the trigger scheduler waiting to be marked in the ring by the acquisition thread
+#define SCHEDULED_PULSE_CAPACITY 64
+
+// Amplifier trigger from a NeurOne trigger packet, with the index of the sample it belongs to
+struct trigger_event {
+    int64_t sample_index;       // NeurOne sample index since measurement start
+    int64_t ring_position;      // Same sample in getSamplesWritten() numbering, -1 before the first sample packet
+    uint64_t micro_time;        // NeurOne time stamp (us)
+    int64_t arrival_time;       // Kernel receive time of the trigger packet (ns, CLOCK_REALTIME)
+    uint8_t type;
+    uint8_t code;
+};
+
+// Placeholder samples written for missing packets
+enum GapFillMode {
+    GAP_FILL_OFF,
+    GAP_FILL_LAST_VALUE,
+    GAP_FILL_LINEAR,
+    GAP_FILL_ZERO
+};
+
 enum TMSConnectionType {
     COM,
     TTL
 };
 
-class dataHandler : public QObject {
-    Q_OBJECT
+// Observers of the handler. The GUI forwards these to Qt signals, the headless pipeline leaves them unset.
+typedef std::function<void(const std::vector<std::string> &channel_names)> ChannelNamesCallback;
+typedef std::function<void(int channel, const Eigen::VectorXd &data,
+                           const Eigen::VectorXi &triggers_A,
+                           const Eigen::VectorXi &triggers_B,
+                           const Eigen::VectorXi &triggers_out,
+                           const VectorXi64 &time_stamps,
+                           const size_t &data_index,
+                           std::string source_name)> ChannelDataCallback;
+
+class dataHandler {
 public:
     // Default constructor
-    explicit dataHandler(QObject *parent = nullptr)  // dataProcessor &processor
-                :   QObject(parent),
-                    channel_count_(0),
+    dataHandler()
+                :   channel_count_(0),
                     sampling_rate_(0),
                     simulation_delivery_rate_(0),
                     GACorr_(GACorrection(0, 0, 0)),
                     magPro_3G()
-    {
-        // Move timer creation and setup to the main thread using moveToThread
-        QMetaObject::invokeMethod(this, [this]() {
-            qDebug() << "Creating dataHandler timer";
-            timer = new QTimer(this);
-            connect(timer, &QTimer::timeout, this, &dataHandler::updateSignalViewerData, Qt::QueuedConnection);
-            timer->start(16);
-        }, Qt::QueuedConnection);
-    }
+    { }
 
     // Reset functions
     void reset_handler(int channel_count, int sampling_rate, int simulation_delivery_rate);
     void reset_handler(int channel_count, int sampling_rate) { reset_handler(channel_count, sampling_rate, sampling_rate); }
 
     void setHandlerState(HandlerState state) { handler_state = state; }
-    bool isReady() { return (handler_state == WAITING_FOR_STOP); }
+    bool isReady() { return (handler_state.load(std::memory_order_acquire) == WAITING_FOR_STOP); }
 
     // Data handling
-    void addData(const Eigen::VectorXd &samples, const double &time_stamp, const int &trigger_A, const int &trigger_B, const int &SeqNo);
+    void addData(const Eigen::VectorXd &samples, const int64_t &time_stamp, const int &trigger_A, const int &trigger_B, const int &SeqNo, const int64_t &arrival_time = 0);
+    void addPacket(const Eigen::Ref<const Eigen::MatrixXd> &samples, const int64_t &time_stamp, const Eigen::Ref<const Eigen::VectorXi> &triggers_A, const Eigen::Ref<const Eigen::VectorXi> &triggers_B, const int &SeqNo, const int64_t &arrival_time = 0);
+    int addSamplePacket(const uint8_t *buffer, size_t size, bool contains_trigger_channel, double gain, double divisor, const int64_t &arrival_time = 0);
+    int addTriggerPacket(const uint8_t *buffer, size_t size, const int64_t &arrival_time = 0);
+    void endMeasurement();
 
-    int getLatestSequenceNumber() { return current_sequence_number_; }
+    int getLatestSequenceNumber() { return current_sequence_number_.load(std::memory_order_acquire); }
     int getLatestDataAndTriggers(Eigen::MatrixXd &output, 
                                  Eigen::VectorXi &triggers_A, 
                                  Eigen::VectorXi &triggers_B, 
                                  Eigen::VectorXi &triggers_out, 
-                                 Eigen::VectorXd &time_stamps, 
+                                 VectorXi64 &time_stamps, 
                                              int number_of_samples);
 
+    int getNewDataAndTriggers(int64_t &read_cursor,
+                              SampleMatrix &output, 
+                              Eigen::VectorXi &triggers_A, 
+                              Eigen::VectorXi &triggers_B, 
+                              Eigen::VectorXi &triggers_out, 
+                              VectorXi64 &time_stamps, 
+                              VectorXi64 &arrival_times, 
+                              Eigen::VectorXi &valid, 
+                                          int max_samples,
+                                          int &sequence_number);
+    int64_t getSamplesWritten() { return samples_written_.load(std::memory_order_acquire); }
+    // Incremented by every reset_handler. Readers that size their buffers by the channel count compare it to detect a
+    // new measurement.
+    int getResetCount() { return reset_count_.load(std::memory_order_acquire); }
+
+    // Packet loss handling. Missing packets are replaced with placeholder samples so that the ring stays aligned
+    // with PacketSeqNo. Placeholders are marked with 0 in the validity output of getNewDataAndTriggers.
+    void setGapFillMode(GapFillMode mode) { gap_fill_mode_ = mode; }
+    GapFillMode getGapFillMode() { return gap_fill_mode_; }
+    void setMaxGapFill(int milliseconds) { max_gap_fill_ms_ = milliseconds; }
+
+    // Storage layout of the sample ring, applied by the next reset_handler (see sampleRing.h)
+    void setRingLayout(RingLayout layout) { ring_layout_ = layout; }
+    RingLayout getRingLayout() { return ring_layout_; }
+
+    // Band of the real-time FIR. Takes effect immediately while acquiring, otherwise at the next reset_handler.
+    bool setRealTimeFilterBand(double low, double high, int taps, double transition = 0) { return RTfilter_.setBand(low, high, taps, transition); }
+    filterSpec getRealTimeFilterSpec() { return RTfilter_.getSpec(); }
+
+    // Amplifier trigger events, read incrementally like the samples
+    int getNewTriggerEvents(int64_t &read_cursor, std::vector<trigger_event> &events);
+
+    // Blocking wait for new samples. The acquisition thread wakes the waiting readers every wake_granularity samples.
+    bool waitForNewData(int64_t read_cursor, int timeout_ms);
+    void setWakeGranularity(int samples) { wake_granularity_.store(std::max(1, samples), std::memory_order_relaxed); }
+    int getWakeGranularity() { return wake_granularity_.load(std::memory_order_relaxed); }
+
     int get_buffer_capacity() { return buffer_capacity_; }
     int get_buffer_length_in_seconds() { return buffer_length_in_seconds_; }
     int get_channel_count() { return channel_count_; }
     int get_ROI_channel_count() { return ROI_fMRI_means.size(); }
-    int get_current_data_index() { return current_data_index_; }
+    int get_current_data_index() { return samples_written_.load(std::memory_order_acquire) % buffer_capacity_; }
     int getSamplingRate() { return sampling_rate_; }
 
     int getPreprocessingOutput(Eigen::MatrixXd &output, 
                                  Eigen::VectorXi &triggers_A, 
                                  Eigen::VectorXi &triggers_B, 
                                  Eigen::VectorXi &triggers_out, 
-                                 Eigen::VectorXd &time_stamps, 
+                                 VectorXi64 &time_stamps, 
                                              int &number_of_samples) 
     { 
         std::lock_guard<std::mutex> lock(this->dataMutex);
@@ -115,7 +194,7 @@ public:
     void setChannelNames(std::vector<std::string> channel_names) { 
         channel_names_ = channel_names;
         channel_names_set = true;
-        emit channelNamesUpdated(channel_names_);
+        if (channel_names_callback_) channel_names_callback_(channel_names_);
     }
     bool channelNamesSet() { return channel_names_set; }
     std::vector<std::string> getChannelNames() { return channel_names_; }
@@ -161,29 +240,30 @@ public:
 
     void setTriggerTimeLimit(int value) { time_limit = std::max(min_time_limit, std::min(max_time_limit, value)); }
     double getTriggerTimeLimit() { return time_limit; }
+    // Called under trigger_fire_mutex_ by firePulse
     bool checkTimeLimit() {
-        // Calculate the time difference and compare it to the time_limit
-        auto duration_since_trigger = std::chrono::system_clock::now() - latest_trigger_time;
+        // Calculate the time difference and compare it to the time_limit. steady_clock is CLOCK_MONOTONIC, so wall clock
+        // adjustments cannot block or release pulses.
+        auto duration_since_trigger = std::chrono::steady_clock::now() - latest_trigger_time;
         auto duration_limit = std::chrono::milliseconds(time_limit);
 
         bool enough_time_passed = duration_since_trigger > duration_limit;
         return enough_time_passed;
     }
 
-    void insertTrigger(int seqNum) {
-        std::lock_guard<std::mutex> lock(triggerMutex);
-        triggerSet.insert(seqNum);
-    }
+    // Trigger target at a packet sequence number. Returns false if the packet has already passed or is too far ahead.
+    bool insertTrigger(int seqNum) { return trigger_wheel_.insert(seqNum); }
+    triggerWheel &getTriggerWheel() { return trigger_wheel_; }
 
-    bool shouldTrigger(int seqNum) {
-        std::lock_guard<std::mutex> lock(triggerMutex);
-        return triggerSet.find(seqNum) != triggerSet.end();
-    }
+    // Scheduled triggering. The phase estimation passes targets as amplifier sample indices with predicted host
+    // times, and the scheduler thread fires them at those times instead of at the arrival of the target packet.
+    void setTriggerScheduling(bool state);
+    bool getTriggerScheduling() { return trigger_scheduler_.isRunning(); }
+    bool scheduleTrigger(int64_t target_sample, int64_t deadline_ns, int reference_seqNum);
+    triggerScheduler &getTriggerScheduler() { return trigger_scheduler_; }
 
-    void removeTrigger(int seqNum) {
-        std::lock_guard<std::mutex> lock(triggerMutex);
-        triggerSet.erase(seqNum);
-    }
+    // Amplifier sample index to host time, updated with every sample packet
+    clockModel &getClockModel() { return clock_model_; }
 
     void setTMSConnectionType(TMSConnectionType type) { TMS_connectionType = type; }
 
@@ -195,18 +275,77 @@ public:
     void magPro_set_mode(int mode = 0, int direction = 0, int waveform = 1, int burst_pulses = 5, float ipi = 1, float ba_ratio = 1.0, bool delay = true);
     void magPro_request_mode_info();
     void get_mode_info(int &mode, int &direction, int &waveform, int &burst_pulses, float &ipi, float &ba_ratio, bool &enabled);
+    // Packet arrival to trigger latency tracing, shared by the acquisition thread and the workers
+    latencyTracer &getTracer() { return tracer_; }
+
+    // Session statistics
+    int getGapCount() { return gap_count_; }
+    int64_t getGapSamplesFilled() { return gap_samples_filled_; }
+    int getLatePacketCount() { return late_packet_count_; }
+    int getInvalidPacketCount() { return invalid_packet_count_; }
+    int64_t getTriggerEventCount() { return trigger_events_written_.load(std::memory_order_acquire); }
+    const std::vector<int> &getSentTriggers() { return seqNum_list; }
+    const std::vector<double> &getTriggerLatencies() { return trigger_latency_list; }
+
     void save_seqnum_list() { 
         writeMatrixiToCSV("trigger_seqNum_list.csv", vectorToColumnMatrixi(seqNum_list)); 
-        qDebug() << "Trigger list size:" << seqNum_list.size();
+        std::cout << "Trigger list size: " << seqNum_list.size() << '\n';
+
+        // Kernel packet arrival to trigger output latencies
+        if (!trigger_latency_list.empty()) {
+            writeMatrixdToCSV("trigger_latency_list.csv", vectorToColumnMatrixd(trigger_latency_list));
+            double max_latency = *std::max_element(trigger_latency_list.begin(), trigger_latency_list.end());
+            std::cout << "Maximum ingest to trigger latency: " << max_latency << " ms" << '\n';
+        }
+
+        // Sample accurate amplifier triggers of the session
+        int64_t events_written = trigger_events_written_.load(std::memory_order_acquire);
+        if (events_written > 0) {
+            int64_t first_event = std::max<int64_t>(0, events_written - TRIGGER_EVENT_CAPACITY);
+            Eigen::MatrixXd events(events_written - first_event, 4);
+            for (int64_t i = first_event; i < events_written; i++) {
+                const trigger_event &event = trigger_events_[i % TRIGGER_EVENT_CAPACITY];
+                events.row(i - first_event) << event.sample_index, event.ring_position, event.type, event.code;
+            }
+            writeMatrixdToCSV("amplifier_trigger_events.csv", events);
+            std::cout << "Amplifier trigger events: " << events_written << '\n';
+        }
+
+        clock_model_.printReport(std::cout);
+
+        if (trigger_wheel_.getScheduledCount() > 0) {
+            trigger_wheel_.printStatistics(std::cout);
+        }
+
+        if (trigger_scheduler_.getScheduledCount() > 0) {
+            trigger_scheduler_.printStatistics(std::cout);
+            trigger_scheduler_.writeTimingsCSV("trigger_timing_list.csv");
+        }
+
+        if (tracer_.histogram(TRACE_ADD_DATA).count() > 0) {
+            tracer_.printSummary(std::cout);
+            tracer_.writeHistogramsCSV("latency_histograms.csv");
+        }
+
+        if (gap_count_ > 0) {
+            std::cout << "Packet loss: " << gap_count_ << " gaps, " << gap_samples_filled_ << " placeholder samples" << '\n';
+        }
+        if (late_packet_count_ > 0) {
+            std::cout << "Late packets dropped: " << late_packet_count_ << '\n';
+        }
+        if (invalid_packet_count_ > 0) {
+            std::cout << "Packets stored as placeholders after a processing error: " << invalid_packet_count_ << '\n';
+        }
 
         // Print timing statistics for addData
         if (addData_call_count > 0) {
             double avg_time = total_addData_time.count() / addData_call_count;
-            qDebug() << "addData statistics:"
-                     << "\nTotal calls:" << addData_call_count
-                     << "\nAverage time:" << avg_time * 1000 << "ms"
-                     << "\nMinimum total time:" << min_addData_time * 1000 << "ms"
-                     << "\nMaximum total time:" << max_addData_time * 1000 << "ms";
+            std::cout << "addData statistics:"
+                      << "\nTotal calls: " << addData_call_count
+                      << "\nAverage time: " << avg_time * 1000 << " ms"
+                      << "\nAverage time per bundle: " << total_addData_time.count() / addData_bundle_count * 1000 << " ms"
+                      << "\nMinimum total time: " << min_addData_time.count() * 1000 << " ms"
+                      << "\nMaximum total time: " << max_addData_time.count() * 1000 << " ms" << '\n';
         }
     }
 
@@ -221,29 +360,77 @@ public:
 
     void setROINames(const std::vector<std::string>& names) { ROI_names = names; }
 
-signals:
-    void channelNamesUpdated(const std::vector<std::string>& channelNames);
-    void channelDataUpdated(int channel, const Eigen::VectorXd &data, 
-                           const Eigen::VectorXi &triggers_A, 
-                           const Eigen::VectorXi &triggers_B, 
-                           const Eigen::VectorXi &triggers_out, 
-                           const Eigen::VectorXd &time_stamps, 
-                                    const size_t &data_index,
-                                     std::string source_name);
-
-public slots:
+    void setChannelNamesCallback(ChannelNamesCallback callback) { channel_names_callback_ = callback; }
+    void setChannelDataCallback(ChannelDataCallback callback) { channel_data_callback_ = callback; }
+
     void savePreprocessingOutput(const Eigen::MatrixXd &output);
 
-private slots:
+    // Passes the ring contents to the channel data callback. Called periodically by the GUI.
     void updateSignalViewerData();
 
 private:
-    HandlerState handler_state = WAITING_FOR_START;
+    void addSample(const Eigen::Ref<const Eigen::VectorXd> &samples, const int64_t &time_stamp, const int &trigger_A, const int &trigger_B, const int &SeqNo, const int64_t &arrival_time);
+    int getGapLength(int SeqNo, int num_bundles);
+    void insertGap(int num_samples, int SeqNo, int64_t time_stamp);
+    void interpolateGap();
+    void publishInvalidPacket(int SeqNo, int64_t time_stamp);
+    bool firePulse();
+    void markScheduledPulses(int num_bundles, int SeqNo);
+    void addBlock(Eigen::Ref<Eigen::MatrixXd> block, const int64_t &time_stamp, const Eigen::Ref<const Eigen::VectorXi> &triggers_A, const Eigen::Ref<const Eigen::VectorXi> &triggers_B, const int &SeqNo, const int64_t &arrival_time);
+
+    // Time stamps (us). A packet whose FirstSampleTime disagrees with the derived time by more than
+    // TIME_STAMP_REANCHOR_US (e.g. an amplifier restart) becomes the new anchor.
+    int64_t sampleTimeStamp(int64_t sample_index, int64_t first_sample_time);
+
+    // Ring columns from index on, if the acquisition stages can process them in place (double column ring only)
+    double *inPlaceRingColumns(size_t index) {
+#ifdef EEG_FLOAT32_SAMPLES
+        (void)index;
+        return nullptr;
+#else
+        return sample_ring_.columnData(index);
+#endif
+    }
+    int64_t samplesToMicroseconds(int64_t samples) const;
+    void writeTimeStamps(size_t start, int count, int64_t first_time_stamp);
+
+    /*
+    Lock-free publication of the ring. The acquisition thread is the only writer. Before touching ring columns it
+    advances samples_claimed_, and after the columns are complete it advances samples_written_. Readers copy the
+    columns behind samples_written_ and check afterwards that none of them were claimed during the copy.
+    */
+    void claimRing(int num_samples) {
+        samples_claimed_.store(samples_written_.load(std::memory_order_relaxed) + num_samples, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void publishRing(int num_samples, int SeqNo) {
+        int64_t written = samples_written_.load(std::memory_order_relaxed) + num_samples;
+        samples_written_.store(written, std::memory_order_release);
+        current_sequence_number_.store(SeqNo, std::memory_order_release);
+
+        if (written >= next_wake_) {
+            next_wake_ = written + wake_granularity_.load(std::memory_order_relaxed);
+            wakeReaders();
+        }
+    }
 
-    QTimer *timer = nullptr;
+    // Futex based wakeup, the acquisition thread never takes a lock to notify the readers
+    void wakeReaders();
+    std::atomic<int> wake_sequence_{0};
+    std::atomic<int> wake_waiters_{0};
+    std::atomic<int> wake_granularity_{1};
+    int64_t next_wake_ = 0;                     // Acquisition thread only
+
+    std::atomic<HandlerState> handler_state{WAITING_FOR_START};
+
+    ChannelNamesCallback channel_names_callback_;
+    ChannelDataCallback channel_data_callback_;
 
     // Synchronization primitives
-    std::mutex dataMutex;
+    std::mutex dataMutex;                       // Preprocessing output shared between the workers
+    std::shared_mutex ring_mutex;               // Held exclusively only while reset_handler reallocates the ring
+    std::mutex ROI_mutex;                       // ROI means, never waited for by the acquisition thread
     std::condition_variable data_condition;
     bool processingWorkerRunning = true;
 
@@ -251,14 +438,21 @@ private:
     Eigen::VectorXi source_channels_;
     bool channel_names_set = false;
     std::vector<std::string> channel_names_;
-    Eigen::MatrixXd sample_buffer_;
-    Eigen::VectorXd time_stamp_buffer_;
+    sampleRing sample_ring_;
+    RingLayout ring_layout_ = RING_LAYOUT_COLUMNS;
+    Eigen::VectorXd viewer_channel_;            // One channel of the ring for the signal viewer callback
+    VectorXi64 time_stamp_buffer_;
+    VectorXi64 arrival_time_buffer_;        // Kernel receive time of the packet of each sample (ns, CLOCK_REALTIME)
     Eigen::VectorXi trigger_buffer_A;
     Eigen::VectorXi trigger_buffer_B;
     Eigen::VectorXi trigger_buffer_out;
-    size_t current_data_index_ = 0;
-    int current_sequence_number_ = 0;
-    int last_retrieved_sequence_number_ = -1;
+    Eigen::VectorXi seqnum_buffer_;             // Packet sequence number of each sample
+    Eigen::VectorXi valid_buffer_;              // 0 for placeholders of lost packets
+    size_t current_data_index_ = 0;             // Acquisition thread only, readers use samples_written_
+    std::atomic<int64_t> samples_claimed_{0};
+    std::atomic<int64_t> samples_written_{0};
+    std::atomic<int> current_sequence_number_{0};
+    std::atomic<int> reset_count_{0};
     int buffer_length_in_seconds_ = 30;
     int buffer_capacity_;
     int channel_count_;
@@ -267,11 +461,54 @@ private:
 
     Eigen::VectorXd processing_sample_vector;
 
+    // Decoding of sample packets straight into the ring
+    Eigen::MatrixXd packet_staging_;            // Used only when a packet wraps around the end of the ring
+    Eigen::VectorXi packet_triggers_A_;
+    Eigen::VectorXi packet_triggers_B_;
+
+    // Per bundle tracker state of the block being processed in addBlock
+    enum BlockStageFlags : uint8_t {
+        BLOCK_TA = 0x01,
+        BLOCK_TR = 0x02,
+        BLOCK_GA = 0x04,
+        BLOCK_BASELINE_DIVIDE = 0x08
+    };
+    std::vector<uint8_t> block_stage_flags_;
+    std::vector<int> block_template_index_;     // GA template column of each bundle, SeqNo - GA_tracker at that bundle
+
+    // Amplifier trigger events. Written only by the acquisition thread, slot i % capacity holds event i.
+    std::array<trigger_event, TRIGGER_EVENT_CAPACITY> trigger_events_;
+    std::atomic<int64_t> trigger_events_written_{0};
+    trigger_entry packet_trigger_entries_[MAX_PACKET_TRIGGERS];
+    int64_t first_sample_index_ = -1;           // NeurOne sample index of ring position 0
+
+    // Target samples of the pulses fired by the scheduler thread, slot i % capacity holds pulse i. The acquisition
+    // thread moves them to pending_scheduled_pulses_ (ring positions) until the target sample is stored.
+    std::array<int64_t, SCHEDULED_PULSE_CAPACITY> scheduled_pulses_;
+    std::atomic<int64_t> scheduled_pulses_written_{0};
+    int64_t scheduled_pulses_read_ = 0;
+    std::vector<int64_t> pending_scheduled_pulses_;
+
+    // Sample time stamps (us) are derived from the sample index, with FirstSampleTime of a packet as the anchor
+    int64_t time_anchor_index_ = -1;
+    int64_t time_anchor_us_ = 0;
+
+    // Packet loss handling, acquisition thread only
+    GapFillMode gap_fill_mode_ = GAP_FILL_LAST_VALUE;
+    int max_gap_fill_ms_ = 1000;
+    int last_packet_sequence_number_ = -1;
+    size_t pending_gap_start_ = 0;
+    int pending_gap_length_ = 0;
+    int gap_count_ = 0;
+    int64_t gap_samples_filled_ = 0;
+    int late_packet_count_ = 0;                 // Reordered or duplicated packets dropped while filling gaps
+    int invalid_packet_count_ = 0;              // Packets that failed after their claim, stored as placeholders
+
     Eigen::MatrixXd preprocessing_output;
     Eigen::VectorXi preprocessing_triggers_A;
     Eigen::VectorXi preprocessing_triggers_B;
     Eigen::VectorXi preprocessing_triggers_out;
-    Eigen::VectorXd preprocessing_time_stamps;
+    VectorXi64 preprocessing_time_stamps;
     int preprocessing_number_of_samples;
     int processing_sequence_number;
     int processing_downsampling_factor = 1;
@@ -332,10 +569,10 @@ private:
     int time_limit = 500;
     const int min_time_limit = 100;
     const int max_time_limit = 100000;
-    std::chrono::time_point<std::chrono::system_clock> latest_trigger_time;
+    std::chrono::time_point<std::chrono::steady_clock> latest_trigger_time;      // Guarded by trigger_fire_mutex_
+    std::mutex trigger_fire_mutex_;
 
-    std::mutex triggerMutex;
-    std::unordered_set<int> triggerSet;
+    triggerWheel trigger_wheel_;
 
     // int SAVE_INDEX_TRACKER = 0;
     // bool data_saved = false;
@@ -344,6 +581,8 @@ private:
     int last_save_index = -1;
     bool data_saved = false;
     std::vector<int> seqNum_list;
+    std::vector<double> trigger_latency_list;     // Packet arrival to trigger output (ms)
+    latencyTracer tracer_;
 
     Eigen::MatrixXd sample_buffer_save;
     int sample_buffer_save_index = 0;
@@ -358,6 +597,12 @@ private:
     std::chrono::duration<double> min_addData_time{std::numeric_limits<double>::max()};
     std::chrono::duration<double> max_addData_time{std::numeric_limits<double>::min()};
     int addData_call_count = 0;
+    long addData_bundle_count = 0;
+
+    clockModel clock_model_;
+    // Declared last so that the scheduler thread is stopped before the members it uses are destroyed
+    bool fireScheduledTrigger(const scheduled_trigger &trigger);
+    triggerScheduler trigger_scheduler_;
 };
 
 #endif // DATAHANDLER_H
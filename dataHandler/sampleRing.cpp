@@ -0,0 +1,81 @@
+#include "sampleRing.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+void sampleRing::reset(int channels, int ring_capacity, RingLayout ring_layout) {
+    layout = ring_layout;
+    channel_count = std::max(0, channels);
+    capacity = std::max(0, ring_capacity);
+
+    if (layout == RING_LAYOUT_COLUMNS) {
+        columns = SampleMatrix::Zero(channel_count, capacity);
+        tiles.reset();
+        tile_count = 0;
+        return;
+    }
+
+    columns.resize(0, 0);
+    tile_count = (static_cast<size_t>(capacity) + RING_TILE_SAMPLES - 1) / RING_TILE_SAMPLES;
+    size_t bytes = std::max<size_t>(storageBytes(), RING_TILE_ALIGNMENT);
+    tiles.reset(static_cast<SampleScalar *>(std::aligned_alloc(RING_TILE_ALIGNMENT, bytes)));
+    if (!tiles) {
+        std::cerr << "Failed to allocate " << bytes << " bytes for the tiled sample ring, using the column layout" << '\n';
+        reset(channels, ring_capacity, RING_LAYOUT_COLUMNS);
+        return;
+    }
+    std::memset(tiles.get(), 0, bytes);
+}
+
+void sampleRing::setColumnZero(int index) {
+    if (layout == RING_LAYOUT_COLUMNS) {
+        columns.col(index).setZero();
+        return;
+    }
+    SampleScalar *sample = tiles.get() + offset(0, index);
+    for (int channel = 0; channel < channel_count; channel++) sample[channel * RING_TILE_SAMPLES] = 0;
+}
+
+void sampleRing::copyColumn(int source, int destination) {
+    if (layout == RING_LAYOUT_COLUMNS) {
+        columns.col(destination) = columns.col(source);
+        return;
+    }
+    const SampleScalar *from = tiles.get() + offset(0, source);
+    SampleScalar *to = tiles.get() + offset(0, destination);
+    for (int channel = 0; channel < channel_count; channel++) to[channel * RING_TILE_SAMPLES] = from[channel * RING_TILE_SAMPLES];
+}
+
+void sampleRing::interpolateColumn(int destination, int previous, int next, SampleScalar weight) {
+    if (layout == RING_LAYOUT_COLUMNS) {
+        columns.col(destination) = (1 - weight) * columns.col(previous) + weight * columns.col(next);
+        return;
+    }
+    const SampleScalar *before = tiles.get() + offset(0, previous);
+    const SampleScalar *after = tiles.get() + offset(0, next);
+    SampleScalar *to = tiles.get() + offset(0, destination);
+    for (int channel = 0; channel < channel_count; channel++) {
+        int stride = channel * RING_TILE_SAMPLES;
+        to[stride] = (1 - weight) * before[stride] + weight * after[stride];
+    }
+}
+
+void sampleRing::readChannel(int channel, int index, int count, Eigen::Ref<Eigen::VectorXd, 0, Eigen::InnerStride<>> output) const {
+    if (layout == RING_LAYOUT_COLUMNS) {
+        output.head(count) = columns.row(channel).segment(index, count).transpose().cast<double>();
+        return;
+    }
+    int done = 0;
+    while (done < count) {
+        int position = index + done;
+        int run = std::min(count - done, RING_TILE_SAMPLES - (position & TILE_MASK));
+        const SampleScalar *samples = tiles.get() + offset(channel, position);
+        for (int i = 0; i < run; i++) output(done + i) = static_cast<double>(samples[i]);
+        done += run;
+    }
+}
+
+size_t sampleRing::storageBytes() const {
+    if (layout == RING_LAYOUT_COLUMNS) return static_cast<size_t>(columns.size()) * sizeof(SampleScalar);
+    return tile_count * channel_count * RING_TILE_SAMPLES * sizeof(SampleScalar);
+}
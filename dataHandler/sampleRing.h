@@ -0,0 +1,136 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <Eigen/Dense>
+
+// Scalar of the sample ring and of the sample copies handed to the workers. The NeurOne samples are 24-bit integers,
+// so float keeps their full resolution and halves the locked ring memory (CMake option FLOAT32_SAMPLES). The
+// acquisition stages and the phase estimation still compute in double.
+#ifdef EEG_FLOAT32_SAMPLES
+typedef float SampleScalar;
+#else
+typedef double SampleScalar;
+#endif
+typedef Eigen::Matrix<SampleScalar, Eigen::Dynamic, Eigen::Dynamic> SampleMatrix;
+
+/*
+Storage of the sample ring (channels x capacity), written one time point (column) at a time by the acquisition thread
+and read by channel (row) by the viewers and in blocks of columns by the workers.
+
+RING_LAYOUT_COLUMNS is a column-major matrix: a column is contiguous, so writes and block reads are plain copies and
+the acquisition stages can run in place on the ring, but a channel is strided by the channel count.
+RING_LAYOUT_TILED stores RING_TILE_SAMPLES consecutive samples of a channel contiguously, the tiles of all channels
+of a time span after each other, aligned to cache lines. A channel is read in whole tiles, a column write touches one
+cache line per channel. benchmarks/ring_layout_benchmark.cpp measures both for the common channel counts.
+*/
+
+enum RingLayout {
+    RING_LAYOUT_COLUMNS,
+    RING_LAYOUT_TILED
+};
+
+// Samples of one channel per tile (512 bytes of doubles) and the alignment of the tiles. Must be a power of two.
+#define RING_TILE_SAMPLES 64
+#define RING_TILE_ALIGNMENT 64
+
+class sampleRing {
+public:
+    sampleRing() : tiles(nullptr, &std::free) { }
+
+    // Zeroed ring. The tiled capacity is rounded up to whole tiles internally, the positions wrap at capacity.
+    void reset(int channels, int capacity, RingLayout layout);
+
+    RingLayout getLayout() const { return layout; }
+    int rows() const { return channel_count; }
+    int cols() const { return capacity; }
+
+    // Time-major access, acquisition thread only. The columns of a block must not wrap around the end of the ring.
+
+    // Contiguous storage of the columns from index on, nullptr if the layout is tiled
+    SampleScalar *columnData(int index) { return layout == RING_LAYOUT_COLUMNS ? columns.col(index).data() : nullptr; }
+
+    template <typename Derived>
+    void writeColumns(int index, const Eigen::MatrixBase<Derived> &block) {
+        if (layout == RING_LAYOUT_COLUMNS) {
+            columns.middleCols(index, block.cols()) = block.template cast<SampleScalar>();
+            return;
+        }
+        // Channel by channel within a tile, so that the ring is written in contiguous runs
+        int done = 0;
+        while (done < block.cols()) {
+            int position = index + done;
+            int run = std::min<int>(block.cols() - done, RING_TILE_SAMPLES - (position & TILE_MASK));
+            SampleScalar *tile = tiles.get() + offset(0, position);
+            for (int channel = 0; channel < channel_count; channel++) {
+                SampleScalar *samples = tile + channel * RING_TILE_SAMPLES;
+                for (int i = 0; i < run; i++) samples[i] = static_cast<SampleScalar>(block(channel, done + i));
+            }
+            done += run;
+        }
+    }
+
+    void setColumnZero(int index);
+    void copyColumn(int source, int destination);
+    // destination = (1 - weight) * previous + weight * next
+    void interpolateColumn(int destination, int previous, int next, SampleScalar weight);
+
+    // Channel-major access, safe for the readers of the ring
+
+    // Columns index ... index + count - 1 to the columns of output (channels x count), which must not wrap
+    template <typename Derived>
+    void readColumns(int index, int count, Eigen::MatrixBase<Derived> &output) const {
+        typedef typename Derived::Scalar OutputScalar;
+        if (layout == RING_LAYOUT_COLUMNS) {
+            output.leftCols(count) = columns.middleCols(index, count).template cast<OutputScalar>();
+            return;
+        }
+        // One tile of every channel at a time, so each tile is read as a contiguous run
+        int done = 0;
+        while (done < count) {
+            int position = index + done;
+            int run = std::min(count - done, RING_TILE_SAMPLES - (position & TILE_MASK));
+            const SampleScalar *tile = tiles.get() + offset(0, position);
+            for (int channel = 0; channel < channel_count; channel++) {
+                const SampleScalar *samples = tile + channel * RING_TILE_SAMPLES;
+                for (int i = 0; i < run; i++) output(channel, done + i) = static_cast<OutputScalar>(samples[i]);
+            }
+            done += run;
+        }
+    }
+    template <typename Derived>
+    void readColumns(int index, int count, Eigen::MatrixBase<Derived> &&output) const { readColumns(index, count, output); }
+
+    // Samples index ... index + count - 1 of one channel to the first count entries of output, which must not wrap
+    void readChannel(int channel, int index, int count, Eigen::Ref<Eigen::VectorXd, 0, Eigen::InnerStride<>> output) const;
+    // The whole ring of one channel in ring position order
+    void readChannel(int channel, Eigen::Ref<Eigen::VectorXd, 0, Eigen::InnerStride<>> output) const { readChannel(channel, 0, capacity, output); }
+
+    SampleScalar sample(int channel, int index) const {
+        return layout == RING_LAYOUT_COLUMNS ? columns(channel, index) : tiles.get()[offset(channel, index)];
+    }
+
+    // Bytes allocated for the samples
+    size_t storageBytes() const;
+
+private:
+    static const int TILE_MASK = RING_TILE_SAMPLES - 1;
+
+    size_t offset(int channel, int index) const {
+        size_t tile = static_cast<size_t>(index) / RING_TILE_SAMPLES;
+        return (tile * channel_count + channel) * RING_TILE_SAMPLES + (index & TILE_MASK);
+    }
+
+    RingLayout layout = RING_LAYOUT_COLUMNS;
+    int channel_count = 0;
+    int capacity = 0;
+    size_t tile_count = 0;
+
+    SampleMatrix columns;                                       // RING_LAYOUT_COLUMNS
+    std::unique_ptr<SampleScalar, decltype(&std::free)> tiles;  // RING_LAYOUT_TILED
+};
+
+#endif // SAMPLERING_H
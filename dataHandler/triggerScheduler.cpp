@@ -0,0 +1,167 @@
+#include "triggerScheduler.h"
+#include "clockModel.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <immintrin.h>
+#include <pthread.h>
+#include <sched.h>
+
+void triggerScheduler::start(FireCallback callback) {
+    if (isRunning()) return;
+    fire_callback = callback;
+    {
+        std::lock_guard<std::mutex> lock(timing_mutex);
+        timings.reserve(TIMING_LOG_CAPACITY);
+    }
+    running.store(true, std::memory_order_release);
+
+    thread = std::thread([this]() {
+        // The pulses are timed by this thread, so it runs with real-time priority when permitted
+        struct sched_param params;
+        params.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &params) != 0) {
+            std::cerr << "Trigger scheduler: failed to set thread to real-time" << '\n';
+        }
+        run();
+    });
+}
+
+void triggerScheduler::stop() {
+    if (!isRunning()) return;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        running.store(false, std::memory_order_release);
+    }
+    queue_condition.notify_all();
+    if (thread.joinable()) thread.join();
+    clear();
+}
+
+bool triggerScheduler::schedule(const scheduled_trigger &trigger) {
+    if (trigger.deadline_ns <= clockModel::monotonicNow()) {
+        late_count.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+
+        // A newer estimate of a pending target replaces it
+        auto same_target = std::find_if(queue.begin(), queue.end(), [&](const scheduled_trigger &pending) {
+            return std::llabs(pending.target_sample - trigger.target_sample) <= minimum_separation;
+        });
+        if (same_target != queue.end()) {
+            *same_target = trigger;
+        } else {
+            if (queue.size() >= QUEUE_CAPACITY) return false;
+            queue.push_back(trigger);
+            scheduled_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::sort(queue.begin(), queue.end(), [](const scheduled_trigger &a, const scheduled_trigger &b) { return a.deadline_ns < b.deadline_ns; });
+    }
+    queue_condition.notify_one();
+    return true;
+}
+
+void triggerScheduler::clear() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue.clear();
+}
+
+void triggerScheduler::run() {
+    while (isRunning()) {
+        scheduled_trigger trigger;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (queue.empty()) {
+                queue_condition.wait(lock, [this] { return !isRunning() || !queue.empty(); });
+                continue;
+            }
+
+            // Far away targets are waited on with the condition variable, so that new targets can still be inserted
+            int64_t remaining = queue.front().deadline_ns - clockModel::monotonicNow();
+            if (remaining > COMMIT_WINDOW_NS) {
+                queue_condition.wait_for(lock, std::chrono::nanoseconds(remaining - COMMIT_WINDOW_NS));
+                continue;
+            }
+
+            trigger = queue.front();
+            queue.erase(queue.begin());
+        }
+
+        // Sleep until shortly before the deadline, then spin
+        int64_t wakeup = trigger.deadline_ns - spin_ns;
+        struct timespec wakeup_time;
+        wakeup_time.tv_sec = wakeup / 1000000000LL;
+        wakeup_time.tv_nsec = wakeup % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup_time, nullptr) == EINTR) {}
+        while (clockModel::monotonicNow() < trigger.deadline_ns) _mm_pause();
+
+        // Taken before the callback, so the serial or TTL write of the pulse is not part of the timing error
+        int64_t achieved = clockModel::monotonicNow();
+        bool fired = fire_callback ? fire_callback(trigger) : false;
+
+        if (fired) {
+            fired_count.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(timing_mutex);
+            if (timings.size() < TIMING_LOG_CAPACITY) timings.push_back({trigger.target_sample, trigger.deadline_ns, achieved});
+        } else {
+            suppressed_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::vector<trigger_timing> triggerScheduler::getTimings() {
+    std::lock_guard<std::mutex> lock(timing_mutex);
+    return timings;
+}
+
+void triggerScheduler::resetTimings() {
+    std::lock_guard<std::mutex> lock(timing_mutex);
+    timings.clear();
+    scheduled_count.store(0, std::memory_order_relaxed);
+    fired_count.store(0, std::memory_order_relaxed);
+    suppressed_count.store(0, std::memory_order_relaxed);
+    late_count.store(0, std::memory_order_relaxed);
+}
+
+void triggerScheduler::printStatistics(std::ostream &os) {
+    std::vector<trigger_timing> log = getTimings();
+    os << "Scheduled triggers: " << getScheduledCount() << " scheduled, " << getFiredCount() << " fired, "
+       << getSuppressedCount() << " suppressed, " << getLateCount() << " late" << '\n';
+    if (log.empty()) return;
+
+    std::vector<double> errors;
+    errors.reserve(log.size());
+    for (const trigger_timing &timing : log) errors.push_back((timing.achieved_ns - timing.intended_ns) / 1000.0);
+    std::sort(errors.begin(), errors.end());
+
+    double mean = 0;
+    for (double error : errors) mean += error;
+    mean /= errors.size();
+
+    os << "Trigger timing error (achieved - intended): mean " << mean << " us, median " << errors[errors.size() / 2]
+       << " us, p99 " << errors[std::min(errors.size() - 1, static_cast<size_t>(0.99 * errors.size()))]
+       << " us, max " << errors.back() << " us" << '\n';
+}
+
+bool triggerScheduler::writeTimingsCSV(const std::string &filename) {
+    std::vector<trigger_timing> log = getTimings();
+    FILE *file = fopen(filename.c_str(), "w");
+    if (!file) {
+        std::cerr << "Failed to open " << filename << '\n';
+        return false;
+    }
+
+    for (const trigger_timing &timing : log) {
+        fprintf(file, "%lld,%lld,%lld,%.3f\n", static_cast<long long>(timing.target_sample), static_cast<long long>(timing.intended_ns),
+                static_cast<long long>(timing.achieved_ns), (timing.achieved_ns - timing.intended_ns) / 1000.0);
+    }
+
+    fclose(file);
+    std::cout << "Data written to " << filename << " successfully." << '\n';
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef TRIGGERSCHEDULER_H
+#define TRIGGERSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stimulation target handed to the scheduler
+struct scheduled_trigger {
+    int64_t target_sample;          // Amplifier sample index of the target
+    int64_t deadline_ns;            // CLOCK_MONOTONIC time of the target
+    int reference_seqNum;           // Newest packet used for the estimate (latency tracing)
+};
+
+// Intended and achieved time of a sent pulse
+struct trigger_timing {
+    int64_t target_sample;
+    int64_t intended_ns;
+    int64_t achieved_ns;
+};
+
+/*
+Fires stimulation pulses at absolute CLOCK_MONOTONIC deadlines instead of at the arrival of the target packet. The
+thread waits on a condition variable until the earliest target is close, then sleeps with clock_nanosleep until shortly
+before the deadline and spins the rest. A new estimate of the same target (within the minimum separation) replaces
+the pending one.
+*/
+class triggerScheduler {
+public:
+    // Sends the pulse. Returns false if the pulse was suppressed.
+    typedef std::function<bool(const scheduled_trigger &trigger)> FireCallback;
+
+    triggerScheduler() {};
+    ~triggerScheduler() { stop(); }
+
+    void start(FireCallback callback);
+    void stop();
+    bool isRunning() const { return running.load(std::memory_order_acquire); }
+
+    // Returns false if the deadline has already passed
+    bool schedule(const scheduled_trigger &trigger);
+    void clear();
+
+    void setSpinTime(int64_t ns) { spin_ns = ns; }
+    void setMinimumSeparation(int64_t samples) { minimum_separation = samples; }
+
+    std::vector<trigger_timing> getTimings();
+    // Clears the timing log and the counters, called when the handler is reset for a new measurement
+    void resetTimings();
+
+    // Counters of the session
+    uint64_t getScheduledCount() const { return scheduled_count.load(std::memory_order_relaxed); }
+    uint64_t getFiredCount() const { return fired_count.load(std::memory_order_relaxed); }
+    uint64_t getSuppressedCount() const { return suppressed_count.load(std::memory_order_relaxed); }
+    uint64_t getLateCount() const { return late_count.load(std::memory_order_relaxed); }
+
+    // Timing error statistics and the per pulse log (target sample, intended ns, achieved ns, error us)
+    void printStatistics(std::ostream &os);
+    bool writeTimingsCSV(const std::string &filename);
+
+private:
+    void run();
+
+    // Wake up this long before the deadline to sleep precisely with clock_nanosleep
+    static const int64_t COMMIT_WINDOW_NS = 2000000;
+    // Pending targets
+    static const size_t QUEUE_CAPACITY = 16;
+    // Pulses kept in the timing log of a session, reserved when the thread starts
+    static const size_t TIMING_LOG_CAPACITY = 65536;
+
+    FireCallback fire_callback;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    std::vector<scheduled_trigger> queue;       // Sorted by deadline
+
+    int64_t spin_ns = 50000;
+    int64_t minimum_separation = 0;
+
+    std::mutex timing_mutex;
+    std::vector<trigger_timing> timings;
+
+    std::atomic<uint64_t> scheduled_count{0};
+    std::atomic<uint64_t> fired_count{0};
+    std::atomic<uint64_t> suppressed_count{0};
+    std::atomic<uint64_t> late_count{0};
+};
+
+#endif // TRIGGERSCHEDULER_H
@@ -0,0 +1,83 @@
+#include "triggerWheel.h"
+#include <algorithm>
+
+void triggerWheel::reset() {
+    for (int i = 0; i < TRIGGER_WHEEL_CAPACITY; i++) wheel_slots[i].store(EMPTY, std::memory_order_relaxed);
+    current_seqNum.store(EMPTY, std::memory_order_relaxed);
+    scheduled_count.store(0, std::memory_order_relaxed);
+    fired_count.store(0, std::memory_order_relaxed);
+    suppressed_count.store(0, std::memory_order_relaxed);
+    expired_count.store(0, std::memory_order_release);
+}
+
+bool triggerWheel::insert(int seqNum) {
+    int64_t target = seqNum;
+    int64_t current = current_seqNum.load(std::memory_order_acquire);
+    if (current != EMPTY) {
+        if (target <= current) {
+            scheduled_count.fetch_add(1, std::memory_order_relaxed);
+            expired_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (target - current >= TRIGGER_WHEEL_CAPACITY) return false;
+    }
+
+    int64_t previous = slot(target).exchange(target, std::memory_order_acq_rel);
+    if (previous == target) return true;        // Already pending
+    scheduled_count.fetch_add(1, std::memory_order_relaxed);
+    if (previous != EMPTY) expired_count.fetch_add(1, std::memory_order_relaxed);
+
+    // The consumer may have passed the target while it was being stored. Whoever clears the slot counts it.
+    if (current_seqNum.load(std::memory_order_acquire) > target) {
+        int64_t expected = target;
+        if (slot(target).compare_exchange_strong(expected, EMPTY, std::memory_order_acq_rel)) {
+            expired_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    return true;
+}
+
+void triggerWheel::expire(int64_t seqNum, int64_t next) {
+    std::atomic<int64_t> &entry = slot(seqNum);
+    int64_t pending = entry.load(std::memory_order_acquire);
+    if (pending == EMPTY || pending >= next) return;
+    if (!entry.compare_exchange_strong(pending, EMPTY, std::memory_order_acq_rel)) return;
+
+    // A target of the previous packet was reached but not fired, anything older was skipped over
+    if (pending == current_seqNum.load(std::memory_order_relaxed)) {
+        suppressed_count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        expired_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool triggerWheel::due(int seqNum) {
+    int64_t target = seqNum;
+    int64_t current = current_seqNum.load(std::memory_order_relaxed);
+
+    if (current == EMPTY || target < current) {
+        // First packet, or the numbering restarted
+        current_seqNum.store(target, std::memory_order_release);
+    } else if (target > current) {
+        // Clear the slots passed since the previous packet. A jump longer than the wheel clears every slot once.
+        int64_t first = std::max(current, target - TRIGGER_WHEEL_CAPACITY + 1);
+        for (int64_t passed = first; passed < target; passed++) expire(passed, target);
+        expire(target, target);
+        current_seqNum.store(target, std::memory_order_release);
+    }
+
+    return slot(target).load(std::memory_order_acquire) == target;
+}
+
+void triggerWheel::take(int64_t seqNum, std::atomic<uint64_t> &counter) {
+    int64_t expected = seqNum;
+    if (slot(seqNum).compare_exchange_strong(expected, EMPTY, std::memory_order_acq_rel)) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void triggerWheel::printStatistics(std::ostream &os) const {
+    os << "Trigger targets: " << getScheduledCount() << " scheduled, " << getFiredCount() << " fired, "
+       << getSuppressedCount() << " suppressed, " << getExpiredCount() << " expired" << '\n';
+}
@@ -0,0 +1,61 @@
+#ifndef TRIGGERWHEEL_H
+#define TRIGGERWHEEL_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+/*
+Pending trigger targets indexed by packet sequence number. The slot of a target is its sequence number modulo the
+capacity, so the acquisition thread checks a packet with a single load. The phase estimation inserts targets, the
+acquisition thread is the only consumer. It advances the wheel with every packet and clears the slots it passes, so
+targets that were never reached (packet gaps, late inserts) or that were blocked (TA, time limit) do not accumulate.
+
+A target is counted once as fired, suppressed (reached but blocked) or expired (passed without being reached).
+*/
+
+// Number of packets ahead of the newest packet that can hold a target. Must be a power of two.
+#define TRIGGER_WHEEL_CAPACITY 4096
+
+class triggerWheel {
+public:
+    triggerWheel() { reset(); }
+
+    // Not safe against concurrent inserts or checks
+    void reset();
+
+    // Producer side. Returns false if the target has already passed or is too far ahead.
+    bool insert(int seqNum);
+
+    // Consumer side. Advances the wheel to the packet and returns true if it has a pending target.
+    bool due(int seqNum);
+    // Removes the pending target of the current packet
+    void fire(int seqNum) { take(seqNum, fired_count); }
+    void suppress(int seqNum) { take(seqNum, suppressed_count); }
+
+    uint64_t getScheduledCount() const { return scheduled_count.load(std::memory_order_relaxed); }
+    uint64_t getFiredCount() const { return fired_count.load(std::memory_order_relaxed); }
+    uint64_t getSuppressedCount() const { return suppressed_count.load(std::memory_order_relaxed); }
+    uint64_t getExpiredCount() const { return expired_count.load(std::memory_order_relaxed); }
+
+    void printStatistics(std::ostream &os) const;
+
+private:
+    static const int64_t EMPTY = -1;
+    static const int64_t MASK = TRIGGER_WHEEL_CAPACITY - 1;
+
+    std::atomic<int64_t> &slot(int64_t seqNum) { return wheel_slots[seqNum & MASK]; }
+    void take(int64_t seqNum, std::atomic<uint64_t> &counter);
+    // Clears a slot holding a target older than the packet being advanced to
+    void expire(int64_t seqNum, int64_t next);
+
+    std::atomic<int64_t> wheel_slots[TRIGGER_WHEEL_CAPACITY];
+    std::atomic<int64_t> current_seqNum{EMPTY};         // Newest packet checked by the consumer
+
+    std::atomic<uint64_t> scheduled_count{0};
+    std::atomic<uint64_t> fired_count{0};
+    std::atomic<uint64_t> suppressed_count{0};
+    std::atomic<uint64_t> expired_count{0};
+};
+
+#endif // TRIGGERWHEEL_H
@@ -5,6 +5,13 @@
 
 void EegBridge::bind_socket() {
 
+    // A replayed capture does not need the socket
+    if (isReplaying()) {
+        kernel_timestamps = false;
+        setup_batch_slots();
+        return;
+    }
+
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
         std::cerr << "Socket creation failed" << '\n';
@@ -39,7 +46,192 @@ void EegBridge::bind_socket() {
         std::cerr << "Failed to set socket receive buffer size." << std::endl;
     }
 
+    // Ask the kernel to stamp every datagram with its arrival time
+    int enable_timestamps = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable_timestamps, sizeof(enable_timestamps)) < 0) {
+        std::cerr << "Failed to enable kernel receive timestamps. Using user space timestamps." << std::endl;
+        kernel_timestamps = false;
+    } else {
+        kernel_timestamps = true;
+    }
+
     len = sizeof(cliaddr);
+
+    setup_batch_slots();
+}
+
+void EegBridge::setup_batch_slots() {
+    // Point every recvmmsg slot to its own packet buffer
+    memset(batch_msgs, 0, sizeof(batch_msgs));
+    for (int i = 0; i < RECV_BATCH_SIZE; i++) {
+        batch_iovecs[i].iov_base = batch_buffers[i];
+        batch_iovecs[i].iov_len = BUFFER_LENGTH;
+        batch_msgs[i].msg_hdr.msg_iov = &batch_iovecs[i];
+        batch_msgs[i].msg_hdr.msg_iovlen = 1;
+        batch_msgs[i].msg_hdr.msg_control = batch_control[i];
+        batch_msgs[i].msg_hdr.msg_controllen = sizeof(batch_control[i]);
+        batch_arrival_ns[i] = 0;
+    }
+
+    batch_wakeups = 0;
+    batch_packets = 0;
+    max_batch_size = 0;
+    batch_size_counts.fill(0);
+}
+
+/*
+Receive all queued packets with one system call. MSG_WAITFORONE blocks until the first packet
+arrives (or the socket timeout expires) and then returns whatever else is already in the socket queue.
+In unbatched mode only the first slot is used.
+*/
+int EegBridge::receive_batch() {
+    int vlen = batched_receive ? RECV_BATCH_SIZE : 1;
+
+    if (isReplaying()) return replay_batch(vlen);
+
+    // The kernel overwrites msg_controllen with the length it used
+    for (int i = 0; i < vlen; i++) {
+        batch_msgs[i].msg_hdr.msg_controllen = sizeof(batch_control[i]);
+    }
+
+    int packets = recvmmsg(sockfd, batch_msgs, vlen, MSG_WAITFORONE, nullptr);
+    if (packets <= 0) return packets;
+
+    // Fallback for packets without a kernel timestamp
+    struct timespec wakeup_time;
+    clock_gettime(CLOCK_REALTIME, &wakeup_time);
+    int64_t wakeup_ns = static_cast<int64_t>(wakeup_time.tv_sec) * 1000000000LL + wakeup_time.tv_nsec;
+
+    for (int i = 0; i < packets; i++) {
+        batch_arrival_ns[i] = wakeup_ns;
+        if (!kernel_timestamps) continue;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&batch_msgs[i].msg_hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&batch_msgs[i].msg_hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec arrival;
+                memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+                batch_arrival_ns[i] = static_cast<int64_t>(arrival.tv_sec) * 1000000000LL + arrival.tv_nsec;
+                break;
+            }
+        }
+    }
+
+    if (recorder.isOpen()) {
+        for (int i = 0; i < packets; i++) {
+            recorder.write(batch_buffers[i], batch_msgs[i].msg_len, batch_arrival_ns[i]);
+        }
+    }
+
+    batch_wakeups++;
+    batch_packets += packets;
+    max_batch_size = std::max(max_batch_size, packets);
+    batch_size_counts[packets]++;
+
+    return packets;
+}
+
+/*
+Replay counterpart of receive_batch. Packets are released at their recorded arrival times
+relative to the first packet, scaled by replay_speed. Each release sleeps until an absolute
+deadline so that the sleep overshoot does not accumulate over a long capture. Packets that are
+already due are returned together like a recvmmsg batch. The arrival times are stamped with the
+replay time so that latency measurements downstream stay meaningful.
+Returns 0 once the capture is exhausted.
+*/
+int EegBridge::replay_batch(int vlen) {
+    int packets = 0;
+
+    while (packets < vlen) {
+        if (!replay_has_next) {
+            replay_next_length = replay.next(replay_next, BUFFER_LENGTH, replay_next_ns);
+            if (replay_next_length < 0) {
+                replay_finished = true;
+                break;
+            }
+            replay_has_next = true;
+
+            if (replay_first_ns < 0) {
+                replay_first_ns = replay_next_ns;
+                clock_gettime(CLOCK_MONOTONIC, &replay_start_time);
+            }
+        }
+
+        if (replay_speed > 0) {
+            int64_t offset_ns = static_cast<int64_t>((replay_next_ns - replay_first_ns) / replay_speed);
+            int64_t due_ns = static_cast<int64_t>(replay_start_time.tv_sec) * 1000000000LL + replay_start_time.tv_nsec + offset_ns;
+
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t now_ns = static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+
+            if (now_ns < due_ns) {
+                if (packets > 0) break; // Return what is already due, the rest goes to the next batch
+
+                struct timespec deadline;
+                deadline.tv_sec = due_ns / 1000000000LL;
+                deadline.tv_nsec = due_ns % 1000000000LL;
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+            }
+        }
+
+        memcpy(batch_buffers[packets], replay_next, replay_next_length);
+        batch_msgs[packets].msg_len = replay_next_length;
+        replay_has_next = false;
+        packets++;
+    }
+
+    if (packets == 0) return 0;
+
+    struct timespec replay_time;
+    clock_gettime(CLOCK_REALTIME, &replay_time);
+    int64_t replay_ns = static_cast<int64_t>(replay_time.tv_sec) * 1000000000LL + replay_time.tv_nsec;
+    for (int i = 0; i < packets; i++) batch_arrival_ns[i] = replay_ns;
+
+    batch_wakeups++;
+    batch_packets += packets;
+    max_batch_size = std::max(max_batch_size, packets);
+    batch_size_counts[packets]++;
+
+    return packets;
+}
+
+bool EegBridge::startRecording(const std::string &filename) {
+    if (!recorder.open(filename)) return false;
+    std::cout << "Recording received packets to " << filename << '\n';
+    return true;
+}
+
+bool EegBridge::openReplay(const std::string &filename, double speed) {
+    if (!replay.open(filename)) return false;
+
+    replay_speed = speed;
+    replay_finished = false;
+    replay_has_next = false;
+    replay_first_ns = -1;
+
+    std::cout << "Replaying " << replay.recordCount() << " packets from " << filename;
+    if (speed > 0) std::cout << " at " << speed << "x speed" << '\n';
+    else std::cout << " as fast as possible" << '\n';
+    return true;
+}
+
+void EegBridge::closeReplay() {
+    replay.close();
+    replay_has_next = false;
+}
+
+void EegBridge::printBatchStatistics() {
+    if (batch_wakeups == 0) return;
+
+    std::cout << "Receive batch statistics:\n"
+              << "Wakeups: " << batch_wakeups << "\n"
+              << "Packets: " << batch_packets << "\n"
+              << "Average packets per wakeup: " << static_cast<double>(batch_packets) / batch_wakeups << "\n"
+              << "Maximum packets per wakeup: " << max_batch_size << "\n";
+
+    for (int i = 1; i <= RECV_BATCH_SIZE; i++) {
+        if (batch_size_counts[i] > 0) std::cout << "  " << i << " packets: " << batch_size_counts[i] << " wakeups\n";
+    }
 }
 
 void EegBridge::spin(volatile std::sig_atomic_t &signal_received) {
@@ -172,3 +364,175 @@ void EegBridge::spin(volatile std::sig_atomic_t &signal_received) {
         std::cerr << boost::stacktrace::stacktrace();
     }
 }
+
+void EegBridge::handler_spin(dataHandler &handler, volatile std::sig_atomic_t &signal_received) {
+    
+    try {
+    running = true;
+    std::cout << "Waiting for measurement start..." << '\n';
+    eeg_bridge_status = WAITING_MEASUREMENT_START;
+    while (!signal_received) {
+        int packets = receive_batch();
+        if (packets <= 0) {
+            if (signal_received) break; // Check if the signal caused recvmmsg to fail
+            if (replayFinished()) {
+                std::cout << "Replay finished" << '\n';
+                break;
+            }
+            std::cerr << "Receive failed" << '\n';
+            // break; // Optionally break on other errors too
+            continue;
+        }
+
+        // Time from the kernel arrival to the return of recvmmsg
+        int64_t received_ns = latencyTracer::now();
+        for (int slot = 0; slot < packets; slot++) handler.getTracer().record(TRACE_RECV, packet_arrival_ns(slot), received_ns);
+
+        // Drain the whole batch
+        for (int slot = 0; slot < packets; slot++) {
+            handle_packet(handler, packet_buffer(slot), packet_length(slot), packet_arrival_ns(slot));
+        }
+    }
+
+    running = false;
+    std::cout << "Shutting down..." << '\n';
+    printBatchStatistics();
+    stopRecording();
+    closeReplay();
+    close_socket();
+
+    } catch (const std::exception& e) {
+        std::cerr << "Eeg_bridge exception: " << e.what() << '\n';
+        std::cerr << boost::stacktrace::stacktrace();
+    }
+}
+
+void EegBridge::handle_packet(dataHandler &handler, const unsigned char *packet, int n, int64_t arrival_ns) {
+    unsigned char firstByte = packet[0];
+    // Handle packets
+    switch (firstByte)
+    {
+    case 0x01: { // MeasurementStartPacket
+        // Add buffer validation
+        if (n <= 0 || packet == nullptr) {
+            throw std::runtime_error("Invalid buffer or size in MeasurementStart: n=" + std::to_string(n));
+        }
+        
+        std::cout << "MeasurementStart package received!" << '\n';
+        std::cout << "Packet size: " << n << " Bytes" << '\n';
+        measurement_start_packet packet_info;
+        std::vector<uint16_t> SourceChannels;
+        std::vector<uint8_t> ChannelTypes;
+        
+        try {
+            deserializeMeasurementStartPacket_pointer(packet, n, packet_info, SourceChannels, ChannelTypes);
+        } catch (const std::exception& e) {
+            std::cerr << "MeasurementStart deserialization error: " << e.what() << '\n';
+            break;
+        }
+
+        // Validate channel data
+        if (SourceChannels.empty()) {
+            throw std::runtime_error("No channels received in MeasurementStart packet");
+        }
+        
+        // Divide channels into data and trigger sources
+        std::vector<uint16_t> data_channel_sources;
+        uint16_t trigger_channel_source = -1;
+        for (size_t i = 0; i < SourceChannels.size(); i++) {
+            uint16_t source = SourceChannels[i];
+            if(source < 60000) { 
+                data_channel_sources.push_back(source);
+            } else {
+                trigger_channel_source = source; 
+            }
+        }
+
+        numChannels = packet_info.NumChannels;
+        
+        if (trigger_channel_source != -1) numDataChannels = numChannels - 1;              // Excluding trigger channel
+        else numDataChannels = numChannels;
+        
+        sampling_rate = packet_info.SamplingRateHz;
+        lastSequenceNumber = -1;
+
+        handler.setSourceChannels(data_channel_sources);
+        handler.setTriggerSource(trigger_channel_source);
+
+        data_handler_samples = Eigen::MatrixXd::Zero(numDataChannels, 10);
+
+        std::cout << "MeasurementStart package processed!\n";
+
+        handler.reset_handler(numDataChannels, sampling_rate);
+        std::cout << "DataHandler reset!\n";
+        eeg_bridge_status = MEASUREMENT_IN_PROGRESS;
+        std::cout << "Waiting for packets..." << '\n';
+
+        break;
+
+    } case 0x02: { // SamplesPacket
+        if (eeg_bridge_status == WAITING_MEASUREMENT_START || !handler.isReady()) break;
+
+        // Add buffer validation
+        if (n <= 0 || packet == nullptr) {
+            throw std::runtime_error("Invalid buffer or size: n=" + std::to_string(n));
+        }
+
+        // Decode the packet straight into the dataHandler ring
+        int sequenceNumber;
+        try {
+            sequenceNumber = handler.addSamplePacket(packet, n, (numChannels > numDataChannels),
+                DC_MODE_SCALE, NANO_TO_MICRO_CONVERSION, arrival_ns);
+        } catch (const std::exception& e) {
+            std::cerr << "Deserialization error: " << e.what() << '\n';
+            break;
+        }
+
+        // Reordered and duplicated packets are dropped by the dataHandler and do not move the expected sequence number
+        if (lastSequenceNumber != -1 && sequenceNumber <= lastSequenceNumber) break;
+
+        // Check for dropped packets
+        if (lastSequenceNumber != -1 && sequenceNumber != (lastSequenceNumber + 1)) {
+            // The dataHandler fills the gap with placeholder samples according to its gap fill mode
+            std::cerr << "Packet loss detected. Expected sequence: " << (lastSequenceNumber + 1) << ", but received: " << sequenceNumber << '\n';
+        }
+
+        lastSequenceNumber = sequenceNumber; // Update the latest sequence number
+
+        // Debug output to confirm data integrity
+        // std::cout << "Package " << sequenceNumber << " received!\n";
+        break;
+
+    } case 0x03: { // TriggerPacket
+        if (eeg_bridge_status == WAITING_MEASUREMENT_START || !handler.isReady()) break;
+
+        try {
+            handler.addTriggerPacket(packet, n, arrival_ns);
+        } catch (const std::exception& e) {
+            std::cerr << "TriggerPacket deserialization error: " << e.what() << '\n';
+        }
+        break;
+
+    } case 0x04: { // MeasurementEndPacket
+        if (eeg_bridge_status == WAITING_MEASUREMENT_START) break;
+
+        std::cout << "MeasurementEnd package received!" << '\n';
+        handler.endMeasurement();
+        // The capture stays open: it covers the whole session, including the next MeasurementStart, and is closed
+        // when the bridge stops. Flushing keeps the measurement readable if the process ends without closing it.
+        flushRecording();
+
+        lastSequenceNumber = -1;
+        eeg_bridge_status = WAITING_MEASUREMENT_START;
+        std::cout << "Waiting for measurement start..." << '\n';
+        break;
+    
+    } case 0x05: { // HardwareStatePacket
+        /* code */
+        break;
+    
+    
+    } default:
+        break;
+    }
+}
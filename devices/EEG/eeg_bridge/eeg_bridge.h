@@ -2,20 +2,29 @@
 #define EEGBRIDGE_H
 
 #include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include <time.h>
+#include <cerrno>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <cstring>
 #include <iostream>
 #include <csignal>
 #include <vector>
+#include <array>
 #include "samplePacket.h"
 #include "measurementStartPacket.h"
-#include "../dataHandler/dataHandler.h"
+#include "triggerPacket.h"
+#include "packetCapture.h"
+#include "dataHandler/dataHandler.h"
 #include <boost/stacktrace.hpp>
 
 // The maximum length of the UDP packet, as mentioned in the manual of Bittium NeurOne.
 #define BUFFER_LENGTH 1472
 
+// Number of packet slots filled by a single recvmmsg call in batched receive mode
+#define RECV_BATCH_SIZE 64
+
 enum EegBridgeStatus {
   WAITING_MEASUREMENT_START,
   MEASUREMENT_IN_PROGRESS
@@ -27,11 +36,39 @@ public:
 
     void bind_socket();
     void spin(volatile std::sig_atomic_t &signal_received);
+
+    // Receive loop feeding the dataHandler. Runs until signal_received is set or a replay ends.
+    void handler_spin(dataHandler &handler, volatile std::sig_atomic_t &signal_received);
+    void handle_packet(dataHandler &handler, const unsigned char *packet, int n, int64_t arrival_ns);
     void setPort(int port) { PORT = port; }
     void setTimeout(int timeout) { socket_timeout = timeout; }
     
     int receive_packet() { return recvfrom(sockfd, (char*)buffer, BUFFER_LENGTH, MSG_WAITALL, (struct sockaddr*)&cliaddr, &len); }
-    void close_socket() { close(sockfd); }
+    void close_socket() { if (sockfd >= 0) close(sockfd); sockfd = -1; }
+
+    // Batched receive. Fills the packet slots and returns the number of packets received (or -1 on failure).
+    int receive_batch();
+    const unsigned char *packet_buffer(int slot) const { return batch_buffers[slot]; }
+    int packet_length(int slot) const { return static_cast<int>(batch_msgs[slot].msg_len); }
+    // Kernel receive time of the packet in nanoseconds (CLOCK_REALTIME)
+    int64_t packet_arrival_ns(int slot) const { return batch_arrival_ns[slot]; }
+
+    void setBatchedReceive(bool state) { batched_receive = state; }
+    bool getBatchedReceive() { return batched_receive; }
+    void printBatchStatistics();
+
+    // Raw packet capture. Every received datagram is appended to the capture file with its arrival time.
+    bool startRecording(const std::string &filename);
+    void stopRecording() { recorder.close(); }
+    void flushRecording() { recorder.flush(); }
+    bool isRecording() const { return recorder.isOpen(); }
+
+    // Replay of a capture file instead of the socket. speed 1.0 replays in real time, N replays N times faster
+    // and 0 replays as fast as possible.
+    bool openReplay(const std::string &filename, double speed = 1.0);
+    void closeReplay();
+    bool isReplaying() const { return replay.isOpen(); }
+    bool replayFinished() const { return replay_finished; }
 
     bool isRunning() { return running; }
 
@@ -52,12 +89,45 @@ public:
     unsigned char buffer[BUFFER_LENGTH];
     Eigen::MatrixXd data_handler_samples;
 
+    // Batch statistics. batch_size_counts[n] is the number of wakeups that returned n packets.
+    uint64_t batch_wakeups = 0;
+    uint64_t batch_packets = 0;
+    int max_batch_size = 0;
+    std::array<uint64_t, RECV_BATCH_SIZE + 1> batch_size_counts{};
+
 private:
     int PORT = 50000;
     int socket_timeout = 60;
-    int sockfd;
+    int sockfd = -1;
     struct sockaddr_in servaddr, cliaddr;
     socklen_t len;
+
+    // Packet ring filled by recvmmsg
+    bool batched_receive = true;
+    unsigned char batch_buffers[RECV_BATCH_SIZE][BUFFER_LENGTH];
+    struct mmsghdr batch_msgs[RECV_BATCH_SIZE];
+    struct iovec batch_iovecs[RECV_BATCH_SIZE];
+
+    // Kernel receive timestamps (SO_TIMESTAMPNS control messages)
+    bool kernel_timestamps = false;
+    char batch_control[RECV_BATCH_SIZE][CMSG_SPACE(sizeof(struct timespec))];
+    int64_t batch_arrival_ns[RECV_BATCH_SIZE];
+
+    void setup_batch_slots();
+    int replay_batch(int vlen);
+
+    PacketRecorder recorder;
+
+    // Replay state. The next record is read ahead so that it can be held back until it is due.
+    PacketReplay replay;
+    double replay_speed = 1.0;
+    bool replay_finished = false;
+    bool replay_has_next = false;
+    int replay_next_length = 0;
+    int64_t replay_next_ns = 0;
+    int64_t replay_first_ns = -1;           // Recorded arrival time of the first replayed packet
+    struct timespec replay_start_time;      // CLOCK_MONOTONIC time when the first packet was replayed
+    unsigned char replay_next[BUFFER_LENGTH];
 };
 
 #endif // EEGBRIDGE_H
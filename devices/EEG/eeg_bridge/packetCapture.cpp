@@ -0,0 +1,162 @@
+#include "packetCapture.h"
+
+static const char CAPTURE_MAGIC[8] = {'E', 'E', 'G', 'C', 'A', 'P', '0', '1'};
+static const char INDEX_MAGIC[8] = {'E', 'E', 'G', 'I', 'D', 'X', '0', '1'};
+
+bool PacketRecorder::open(const std::string &filename) {
+    close();
+
+    file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open capture file " << filename << '\n';
+        return false;
+    }
+
+    // Large stdio buffer so that the receive thread only hits the disk every few hundred packets
+    write_buffer.resize(4 * 1024 * 1024);
+    setvbuf(file, write_buffer.data(), _IOFBF, write_buffer.size());
+
+    capture_file_header header;
+    memcpy(header.Magic, CAPTURE_MAGIC, sizeof(header.Magic));
+    header.Version = CAPTURE_VERSION;
+    header.Reserved = 0;
+    fwrite(&header, sizeof(header), 1, file);
+
+    position = sizeof(header);
+    offsets.clear();
+    offsets.reserve(1 << 20);
+    return true;
+}
+
+void PacketRecorder::write(const unsigned char *packet, uint32_t length, int64_t arrival_ns) {
+    if (!file) return;
+
+    capture_record_header record;
+    record.ArrivalNs = arrival_ns;
+    record.Length = length;
+    record.Reserved = 0;
+
+    fwrite(&record, sizeof(record), 1, file);
+    fwrite(packet, 1, length, file);
+
+    offsets.push_back(position);
+    position += sizeof(record) + length;
+}
+
+void PacketRecorder::close() {
+    if (!file) return;
+
+    capture_footer footer;
+    footer.IndexOffset = position;
+    footer.RecordCount = offsets.size();
+    memcpy(footer.Magic, INDEX_MAGIC, sizeof(footer.Magic));
+
+    if (!offsets.empty()) fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file);
+    fwrite(&footer, sizeof(footer), 1, file);
+
+    fclose(file);
+    file = nullptr;
+    std::cout << "Capture closed, " << offsets.size() << " packets recorded" << '\n';
+}
+
+bool PacketReplay::open(const std::string &filename) {
+    close();
+
+    file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Failed to open capture file " << filename << '\n';
+        return false;
+    }
+
+    capture_file_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.Magic, CAPTURE_MAGIC, sizeof(header.Magic)) != 0) {
+        std::cerr << "Not a packet capture file: " << filename << '\n';
+        close();
+        return false;
+    }
+    if (header.Version != CAPTURE_VERSION) {
+        std::cerr << "Unsupported capture version " << header.Version << '\n';
+        close();
+        return false;
+    }
+
+    if (!readIndex()) {
+        std::cerr << "Capture index missing, scanning records" << '\n';
+        scanRecords();
+    }
+
+    return seek(0);
+}
+
+// Loads the index written by PacketRecorder::close. Returns false if the footer is missing or inconsistent.
+bool PacketReplay::readIndex() {
+    if (fseeko(file, 0, SEEK_END) != 0) return false;
+    off_t file_size = ftello(file);
+    if (file_size < static_cast<off_t>(sizeof(capture_file_header) + sizeof(capture_footer))) return false;
+
+    capture_footer footer;
+    if (fseeko(file, file_size - sizeof(footer), SEEK_SET) != 0 || fread(&footer, sizeof(footer), 1, file) != 1) return false;
+    if (memcmp(footer.Magic, INDEX_MAGIC, sizeof(footer.Magic)) != 0) return false;
+    if (footer.IndexOffset + footer.RecordCount * sizeof(uint64_t) + sizeof(footer) != static_cast<uint64_t>(file_size)) return false;
+
+    offsets.resize(footer.RecordCount);
+    if (fseeko(file, footer.IndexOffset, SEEK_SET) != 0) return false;
+    if (footer.RecordCount > 0 && fread(offsets.data(), sizeof(uint64_t), offsets.size(), file) != offsets.size()) {
+        offsets.clear();
+        return false;
+    }
+
+    data_end = footer.IndexOffset;
+    return true;
+}
+
+// Rebuilds the index of an unterminated capture. A trailing partial record is ignored.
+void PacketReplay::scanRecords() {
+    offsets.clear();
+    fseeko(file, 0, SEEK_END);
+    uint64_t file_size = ftello(file);
+
+    uint64_t position = sizeof(capture_file_header);
+    capture_record_header record;
+    while (fseeko(file, position, SEEK_SET) == 0 && fread(&record, sizeof(record), 1, file) == 1) {
+        uint64_t record_end = position + sizeof(record) + record.Length;
+        if (record_end > file_size) break;
+        offsets.push_back(position);
+        position = record_end;
+    }
+
+    data_end = position;
+}
+
+bool PacketReplay::seek(uint64_t record) {
+    if (!file || record > offsets.size()) return false;
+
+    current = record;
+    uint64_t position = (record < offsets.size()) ? offsets[record] : data_end;
+    return fseeko(file, position, SEEK_SET) == 0;
+}
+
+int PacketReplay::next(unsigned char *buffer, size_t buffer_size, int64_t &arrival_ns) {
+    if (!file || current >= offsets.size()) return -1;
+
+    capture_record_header record;
+    if (fread(&record, sizeof(record), 1, file) != 1) return -1;
+    if (record.Length > buffer_size) {
+        std::cerr << "Capture record " << current << " is larger than the packet buffer" << '\n';
+        return -1;
+    }
+    if (fread(buffer, 1, record.Length, file) != record.Length) return -1;
+
+    arrival_ns = record.ArrivalNs;
+    current++;
+    return static_cast<int>(record.Length);
+}
+
+void PacketReplay::close() {
+    if (!file) return;
+    fclose(file);
+    file = nullptr;
+    offsets.clear();
+    current = 0;
+    data_end = 0;
+}
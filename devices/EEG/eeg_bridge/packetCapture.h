@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+Capture file layout (native byte order):
+  header  : magic "EEGCAP01", uint32 version, uint32 reserved
+  records : int64 arrival_ns, uint32 length, uint32 reserved, payload[length]
+  index   : uint64 file offset of every record
+  footer  : uint64 index offset, uint64 record count, magic "EEGIDX01"
+The index and footer are written when the recorder is closed. A capture without a footer
+(e.g. after a crash) is still readable, the index is then rebuilt by scanning the records.
+*/
+
+#define CAPTURE_VERSION 1
+
+struct __attribute__((packed)) capture_file_header {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Reserved;
+};
+
+struct __attribute__((packed)) capture_record_header {
+    int64_t ArrivalNs;
+    uint32_t Length;
+    uint32_t Reserved;
+};
+
+struct __attribute__((packed)) capture_footer {
+    uint64_t IndexOffset;
+    uint64_t RecordCount;
+    char Magic[8];
+};
+
+// Appends received datagrams with their arrival times to a capture file
+class PacketRecorder {
+public:
+    PacketRecorder() {};
+    ~PacketRecorder() { close(); }
+
+    bool open(const std::string &filename);
+    void write(const unsigned char *packet, uint32_t length, int64_t arrival_ns);
+    void flush() { if (file) fflush(file); }
+    void close();
+
+    bool isOpen() const { return file != nullptr; }
+    uint64_t recordCount() const { return offsets.size(); }
+
+private:
+    FILE *file = nullptr;
+    uint64_t position = 0;
+    std::vector<uint64_t> offsets;
+    std::vector<char> write_buffer;
+};
+
+// Reads a capture file record by record
+class PacketReplay {
+public:
+    PacketReplay() {};
+    ~PacketReplay() { close(); }
+
+    bool open(const std::string &filename);
+    void close();
+
+    // Copies the next record to buffer. Returns the payload length, or -1 at the end of the capture or on a truncated record.
+    int next(unsigned char *buffer, size_t buffer_size, int64_t &arrival_ns);
+    bool seek(uint64_t record);
+
+    bool isOpen() const { return file != nullptr; }
+    uint64_t recordCount() const { return offsets.size(); }
+    uint64_t currentRecord() const { return current; }
+
+private:
+    bool readIndex();
+    void scanRecords();
+
+    FILE *file = nullptr;
+    uint64_t data_end = 0;
+    uint64_t current = 0;
+    std::vector<uint64_t> offsets;
+};
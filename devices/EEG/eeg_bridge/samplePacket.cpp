@@ -1,5 +1,123 @@
 #include "samplePacket.h"
 
+// Parses the fixed sample packet header and returns the offset of the first sample
+size_t deserializeSamplePacketHeader(const uint8_t *buffer, size_t size, sample_packet &packet) {
+    size_t offset = 0;
+
+    if (buffer == nullptr || size < sizeof(sample_packet)) {
+        throw std::runtime_error("Invalid buffer or size.");
+    }
+
+    packet.FrameType = buffer[offset++];
+    packet.MainUnitNum = buffer[offset++];
+    packet.Reserved[0] = buffer[offset++];
+    packet.Reserved[1] = buffer[offset++];
+
+    memcpy(&packet.PacketSeqNo, buffer + offset, sizeof(uint32_t));
+    packet.PacketSeqNo = ntohl(packet.PacketSeqNo);
+    offset += sizeof(uint32_t);
+
+    memcpy(&packet.NumChannels, buffer + offset, sizeof(uint16_t));
+    packet.NumChannels = ntohs(packet.NumChannels);
+    offset += sizeof(uint16_t);
+
+    memcpy(&packet.NumSampleBundles, buffer + offset, sizeof(uint16_t));
+    packet.NumSampleBundles = ntohs(packet.NumSampleBundles);
+    offset += sizeof(uint16_t);
+
+    memcpy(&packet.FirstSampleIndex, buffer + offset, sizeof(uint64_t));
+    packet.FirstSampleIndex = ntohll(packet.FirstSampleIndex);
+    offset += sizeof(uint64_t);
+
+    memcpy(&packet.FirstSampleTime, buffer + offset, sizeof(uint64_t));
+    packet.FirstSampleTime = ntohll(packet.FirstSampleTime);
+    offset += sizeof(uint64_t);
+
+    return offset;
+}
+
+/*
+Converts big-endian 24-bit signed samples to int32. The shuffle places the three bytes of each sample
+in the upper 24 bits of a 32-bit lane and the arithmetic shift sign extends them. The vector loads read
+4 bytes past the samples they convert, so the last samples are always handled by the scalar loop.
+*/
+void decodeInt24BE(const uint8_t *src, int32_t *dst, size_t count) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i shuffle = _mm256_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9,
+                                             -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+    for (; i + 10 <= count; i += 8) {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i + 12));
+        __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        __m256i samples = _mm256_srai_epi32(_mm256_shuffle_epi8(bytes, shuffle), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), samples);
+    }
+#endif
+
+#if defined(__SSSE3__)
+    const __m128i shuffle_128 = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+    for (; i + 6 <= count; i += 4) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i));
+        __m128i samples = _mm_srai_epi32(_mm_shuffle_epi8(bytes, shuffle_128), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), samples);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const uint8_t *sample_bytes = src + 3 * i;
+        int32_t sample = (static_cast<int32_t>(sample_bytes[0]) << 24) |
+                         (static_cast<int32_t>(sample_bytes[1]) << 16) |
+                         (static_cast<int32_t>(sample_bytes[2]) << 8);
+        dst[i] = sample >> 8; // Sign extension for 24-bit to 32-bit
+    }
+}
+
+/*
+Decodes the samples of a packet whose header has already been parsed (offset points to the first sample).
+The packet size is checked once, the whole payload is converted to int32 in one pass and the data channels are
+written as (sample * gain) / divisor to the column-major output, one column per bundle. output_stride is the
+distance between columns in the output, so the samples can be written straight into a larger buffer.
+The trigger bits are extracted from the trigger channel in a separate pass.
+*/
+void decodeSamplePacketScaled(const uint8_t *buffer, size_t size, size_t offset, const sample_packet &packet, double *output, int output_stride, double gain, double divisor, Eigen::VectorXi &triggers_A, Eigen::VectorXi &triggers_B, bool contains_trigger_channel) {
+    const int num_channels = packet.NumChannels;
+    const int num_bundles = packet.NumSampleBundles;
+    const size_t num_samples = static_cast<size_t>(num_channels) * num_bundles;
+
+    if (num_samples > MAX_PACKET_SAMPLES || offset + 3 * num_samples > size) {
+        throw std::runtime_error("Buffer overrun while reading samples.");
+    }
+
+    const int num_data_channels = contains_trigger_channel ? num_channels - 1 : num_channels;
+    if (num_data_channels > output_stride) {
+        throw std::runtime_error("Output buffer has fewer rows than the packet has data channels.");
+    }
+
+    // Samples are stored bundle by bundle, which matches the column-major channels x bundles layout
+    int32_t raw_samples[MAX_PACKET_SAMPLES];
+    decodeInt24BE(buffer + offset, raw_samples, num_samples);
+    Eigen::Map<const Eigen::Matrix<int32_t, Eigen::Dynamic, Eigen::Dynamic>> raw(raw_samples, num_channels, num_bundles);
+
+    Eigen::Map<Eigen::MatrixXd, 0, Eigen::OuterStride<>> out(output, num_data_channels, num_bundles, Eigen::OuterStride<>(output_stride));
+    out = (raw.topRows(num_data_channels).cast<double>() * gain) / divisor;
+
+    // Trigger pass. The low byte of the 24-bit trigger sample carries the trigger bits.
+    if (triggers_A.size() != num_bundles) triggers_A.resize(num_bundles);
+    if (triggers_B.size() != num_bundles) triggers_B.resize(num_bundles);
+    if (contains_trigger_channel) {
+        for (int bundle = 0; bundle < num_bundles; ++bundle) {
+            int32_t trigger_sample = raw(num_channels - 1, bundle);
+            triggers_A(bundle) = static_cast<int>((trigger_sample & 0x02) != 0);
+            triggers_B(bundle) = static_cast<int>((trigger_sample & 0x08) != 0);
+        }
+    } else {
+        triggers_A.setZero();
+        triggers_B.setZero();
+    }
+}
+
 void deserializeSamplePacketEigen_pointer(const uint8_t *buffer, size_t size, sample_packet &packet, Eigen::MatrixXd &packet_handler_buffer, Eigen::VectorXi &triggers_A, Eigen::VectorXi &triggers_B, bool contains_trigger_channel) {
     size_t offset = 0;
 
@@ -7,6 +7,13 @@
 #include <cstring>
 #include <Eigen/Dense>
 
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+// Upper bound for the number of 24-bit samples in one UDP packet (1472 byte payload)
+#define MAX_PACKET_SAMPLES (1472 / 3)
+
 struct sample_packet {
     uint8_t FrameType;
     uint8_t MainUnitNum;
@@ -18,6 +25,9 @@ struct sample_packet {
     uint64_t FirstSampleTime;
 };
 
+size_t deserializeSamplePacketHeader(const uint8_t *buffer, size_t size, sample_packet &packet);
+void decodeInt24BE(const uint8_t *src, int32_t *dst, size_t count);
+void decodeSamplePacketScaled(const uint8_t *buffer, size_t size, size_t offset, const sample_packet &packet, double *output, int output_stride, double gain, double divisor, Eigen::VectorXi &triggers_A, Eigen::VectorXi &triggers_B, bool contains_trigger_channel);
 void deserializeSamplePacketEigen_pointer(const uint8_t *buffer, size_t size, sample_packet &packet, Eigen::MatrixXd &packet_handler_buffer, Eigen::VectorXi &triggers_A, Eigen::VectorXi &triggers_B, bool contains_trigger_channel);
 std::vector<std::vector<double>> deserializeSamplePacket_pointer(const uint8_t *buffer, size_t size, sample_packet &packet);
 void printSamplePacket(const sample_packet& packet);
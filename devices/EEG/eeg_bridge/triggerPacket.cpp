@@ -0,0 +1,66 @@
+#include "triggerPacket.h"
+
+// Parses the header and up to max_triggers trigger entries. Returns the number of entries written to triggers.
+int deserializeTriggerPacket_pointer(const uint8_t *buffer, size_t size, trigger_packet &packet, trigger_entry *triggers, int max_triggers) {
+    size_t offset = 0;
+
+    if (buffer == nullptr || size < sizeof(trigger_packet)) {
+        throw std::runtime_error("Invalid buffer or size.");
+    }
+
+    packet.FrameType = buffer[offset++];
+    packet.MainUnitNum = buffer[offset++];
+    packet.Reserved[0] = buffer[offset++];
+    packet.Reserved[1] = buffer[offset++];
+
+    memcpy(&packet.PacketSeqNo, buffer + offset, sizeof(uint32_t));
+    packet.PacketSeqNo = ntohl(packet.PacketSeqNo);
+    offset += sizeof(uint32_t);
+
+    memcpy(&packet.NumTriggers, buffer + offset, sizeof(uint16_t));
+    packet.NumTriggers = ntohs(packet.NumTriggers);
+    offset += sizeof(uint16_t);
+
+    packet.Reserved2[0] = buffer[offset++];
+    packet.Reserved2[1] = buffer[offset++];
+
+    if (offset + static_cast<size_t>(packet.NumTriggers) * sizeof(trigger_entry) > size) {
+        throw std::runtime_error("Buffer overrun while reading triggers.");
+    }
+    if (packet.NumTriggers > max_triggers) {
+        throw std::runtime_error("Too many triggers in packet: " + std::to_string(packet.NumTriggers));
+    }
+
+    for (int i = 0; i < packet.NumTriggers; i++) {
+        trigger_entry &trigger = triggers[i];
+
+        memcpy(&trigger.MicroTime, buffer + offset, sizeof(uint64_t));
+        trigger.MicroTime = ntohll(trigger.MicroTime);
+        offset += sizeof(uint64_t);
+
+        memcpy(&trigger.SampleIndex, buffer + offset, sizeof(uint64_t));
+        trigger.SampleIndex = ntohll(trigger.SampleIndex);
+        offset += sizeof(uint64_t);
+
+        trigger.TriggerType = buffer[offset++];
+        trigger.TriggerCode = buffer[offset++];
+        trigger.Reserved[0] = buffer[offset++];
+        trigger.Reserved[1] = buffer[offset++];
+    }
+
+    return packet.NumTriggers;
+}
+
+void printTriggerPacket(const trigger_packet &packet, const trigger_entry *triggers, int num_triggers) {
+    std::cout << "FrameType: " << static_cast<int>(packet.FrameType) << std::endl;
+    std::cout << "MainUnitNum: " << static_cast<int>(packet.MainUnitNum) << std::endl;
+    std::cout << "PacketSeqNo: " << packet.PacketSeqNo << std::endl;
+    std::cout << "NumTriggers: " << packet.NumTriggers << std::endl;
+    for (int i = 0; i < num_triggers; i++) {
+        std::cout << "  MicroTime: " << triggers[i].MicroTime
+                  << " SampleIndex: " << triggers[i].SampleIndex
+                  << " Type: " << static_cast<int>(triggers[i].TriggerType)
+                  << " Code: " << static_cast<int>(triggers[i].TriggerCode) << std::endl;
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "networkUtils.h"
+#include <iostream>
+#include <arpa/inet.h>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+// Upper bound for the number of trigger entries in one UDP packet (1472 byte payload)
+#define MAX_PACKET_TRIGGERS ((1472 - sizeof(trigger_packet)) / sizeof(trigger_entry))
+
+struct __attribute__((packed)) trigger_packet {
+    uint8_t FrameType;
+    uint8_t MainUnitNum;
+    uint8_t Reserved[2];
+    uint32_t PacketSeqNo;
+    uint16_t NumTriggers;
+    uint8_t Reserved2[2];
+};
+
+// One trigger with the index of the sample it belongs to
+struct __attribute__((packed)) trigger_entry {
+    uint64_t MicroTime;
+    uint64_t SampleIndex;
+    uint8_t TriggerType;
+    uint8_t TriggerCode;
+    uint8_t Reserved[2];
+};
+
+// NeurOne trigger types
+enum TriggerType {
+    TRIGGER_TYPE_STIMULATION = 1,
+    TRIGGER_TYPE_VIDEO = 2,
+    TRIGGER_TYPE_MASK = 3
+};
+
+int deserializeTriggerPacket_pointer(const uint8_t *buffer, size_t size, trigger_packet &packet, trigger_entry *triggers, int max_triggers);
+void printTriggerPacket(const trigger_packet &packet, const trigger_entry *triggers, int num_triggers);
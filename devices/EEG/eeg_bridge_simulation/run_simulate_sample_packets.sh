@@ -1,3 +1,3 @@
-g++ -o build/send_packets simulate_sample_packets.cpp
+g++ -O3 -std=c++17 -o build/send_packets simulate_sample_packets.cpp
 
-./build/send_packets
\ No newline at end of file
+./build/send_packets --address 192.168.0.105 "$@"
\ No newline at end of file
@@ -2,46 +2,198 @@
 #include <vector>
 #include <cstring>
 #include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
 #include <sys/socket.h>
+#include <sys/prctl.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <chrono>
-#include <thread>
+#include <time.h>
 #include <random>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <algorithm>
 
 /*
-This can be used to send packets to the port used by the main program to simulate the retrieval of bittium packets.
-Current available packages:
-    MeasurementStartPackage
-    SamplesPackage
-
-TODO:
-    MeasurementEndPackage
+Load generator for the NeurOne real-time protocol. Sends a MeasurementStart packet, a stream of
+Samples packets and a MeasurementEnd packet to the port used by the main program.
+
+The sample packets are generated once into a packet pool before sending starts, either from a CSV
+file (one row per sample, data channels followed by the trigger column) or from a synthetic signal:
+  - alpha oscillation with slow amplitude modulation and white noise on every channel
+  - gradient artefact (GA): derivative of trapezoidal slice gradients during the acquisition
+    time (TA) of every TR, marked with trigger A at the start of every volume
+  - ballistocardiogram artefact (BCG): pulse shaped artefact following heart beats with jittered intervals
+During sending only the header fields (sequence number, sample index and time) are patched, the
+pool wraps around when the stream is longer than the pool.
+
+Packets are sent at absolute deadlines (clock_nanosleep with TIMER_ABSTIME) so the rate does not drift,
+optionally faster than real time or as fast as possible. Packet loss and reordering can be injected.
+
+Run with --help for the options.
 */
 
-// Simulating parameters
-const uint16_t CHANNEL_COUNT = 13;
-const uint32_t SAMPLINGRATE = 5000;
-
 const uint8_t DC_MODE_SCALE = 100;
 const uint16_t NANO_TO_MICRO_CONVERSION = 1000;
-const double DOUBLESCALINGFACTOR = 10000.0;
+
+// Microvolts to the 24-bit sample units used by the receiver (sample * DC_MODE_SCALE / NANO_TO_MICRO_CONVERSION)
+const double MICROVOLT_TO_SAMPLE = static_cast<double>(NANO_TO_MICRO_CONVERSION) / DC_MODE_SCALE;
+
+// Trigger bits in the low byte of the trigger channel
+const int32_t TRIGGER_A_BIT = 0x02;
+const int32_t TRIGGER_B_BIT = 0x08;
+
+// The maximum length of the UDP packet and the size of the sample packet header
+#define BUFFER_LENGTH 1472
+#define SAMPLE_PACKET_HEADER 28
 
 // Target port
 #define PORT 50000
 
-int32_t getRandomNumber(int32_t min, int32_t max) {
-    std::random_device rd; // Obtain a random number from hardware
-    std::mt19937 gen(rd()); // Seed the generator
-    std::uniform_int_distribution<> distr(min, max); // Define the range
+struct generator_parameters {
+    std::string address = "127.0.0.1";
+    int port = PORT;
+
+    int channels = 13;                  // Data channels, the trigger channel is added on top
+    int sampling_rate = 5000;
+    int bundles = 1;                    // Sample bundles per packet
+    double duration = 0;                // Seconds, 0 sends until interrupted (or the whole CSV file once)
+    double pool_seconds = 10;
+    double rate_multiplier = 1.0;       // Sending speed relative to real time
+    bool max_rate = false;              // Send as fast as possible
+    int spin_us = 0;                    // Busy wait this long before every deadline instead of sleeping
+    unsigned int seed = 1;
+    double report_interval = 5;
+
+    // Injected network faults
+    double loss = 0;                    // Probability of dropping a packet
+    int loss_burst = 1;                 // Consecutive packets dropped per loss event
+    double reorder = 0;                 // Probability of swapping a packet with the next one
+
+    // Synthetic signal, amplitudes in microvolts
+    std::string csv_file;
+    double alpha_frequency = 10.0;
+    double alpha_amplitude = 20.0;
+    double noise_amplitude = 5.0;
+    double ga_amplitude = 0;            // 0 disables the gradient artefact
+    double tr = 2.0;                    // Seconds
+    double ta = 1.5;                    // Seconds
+    int slices = 30;
+    double bcg_amplitude = 0;           // 0 disables the BCG artefact
+    double heart_rate = 60.0;           // Beats per minute
+    double trigger_b_interval = 2.0;    // Seconds between trigger B markers, 0 disables
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+void signalHandler(int) {
+    stop_requested = 1;
+}
+
+void printUsage(const char *program) {
+    generator_parameters defaults;
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --address <ip>              Receiver address (" << defaults.address << ")\n"
+              << "  --port <port>               Receiver port (" << defaults.port << ")\n"
+              << "  --channels <n>              EEG channels, excluding the trigger channel (" << defaults.channels << ")\n"
+              << "  --rate <hz>                 Sampling rate (" << defaults.sampling_rate << ")\n"
+              << "  --bundles <n>               Sample bundles per packet (" << defaults.bundles << ")\n"
+              << "  --duration <s>              Stream length, 0 = until Ctrl-C (" << defaults.duration << ")\n"
+              << "  --pool <s>                  Length of the pre-generated packet pool (" << defaults.pool_seconds << ")\n"
+              << "  --speed <x>                 Send x times faster than real time (" << defaults.rate_multiplier << ")\n"
+              << "  --max-rate                  Send as fast as possible\n"
+              << "  --spin-us <us>              Busy wait before each deadline (" << defaults.spin_us << ")\n"
+              << "  --seed <n>                  Random seed (" << defaults.seed << ")\n"
+              << "  --report <s>                Progress report interval, 0 disables (" << defaults.report_interval << ")\n"
+              << "  --loss <p>                  Packet loss probability (" << defaults.loss << ")\n"
+              << "  --loss-burst <n>            Packets lost per loss event (" << defaults.loss_burst << ")\n"
+              << "  --reorder <p>               Probability of swapping adjacent packets (" << defaults.reorder << ")\n"
+              << "  --csv <file>                Send samples from a CSV file instead of the synthetic signal\n"
+              << "  --alpha-freq <hz>           Alpha frequency (" << defaults.alpha_frequency << ")\n"
+              << "  --alpha-amp <uV>            Alpha amplitude (" << defaults.alpha_amplitude << ")\n"
+              << "  --noise <uV>                White noise standard deviation (" << defaults.noise_amplitude << ")\n"
+              << "  --ga-amp <uV>               Gradient artefact amplitude, 0 = off (" << defaults.ga_amplitude << ")\n"
+              << "  --tr <s>                    Repetition time (" << defaults.tr << ")\n"
+              << "  --ta <s>                    Acquisition time (" << defaults.ta << ")\n"
+              << "  --slices <n>                Slices per volume (" << defaults.slices << ")\n"
+              << "  --bcg-amp <uV>              BCG artefact amplitude, 0 = off (" << defaults.bcg_amplitude << ")\n"
+              << "  --heart-rate <bpm>          Heart rate of the BCG artefact (" << defaults.heart_rate << ")\n"
+              << "  --trigger-b <s>             Interval of trigger B markers, 0 = off (" << defaults.trigger_b_interval << ")\n";
+}
+
+bool parseArguments(int argc, char *argv[], generator_parameters &params) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") { printUsage(argv[0]); return false; }
+        if (arg == "--max-rate") { params.max_rate = true; continue; }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << '\n';
+            return false;
+        }
+        std::string value = argv[++i];
+
+        try {
+            if (arg == "--address") params.address = value;
+            else if (arg == "--port") params.port = std::stoi(value);
+            else if (arg == "--channels") params.channels = std::stoi(value);
+            else if (arg == "--rate") params.sampling_rate = std::stoi(value);
+            else if (arg == "--bundles") params.bundles = std::stoi(value);
+            else if (arg == "--duration") params.duration = std::stod(value);
+            else if (arg == "--pool") params.pool_seconds = std::stod(value);
+            else if (arg == "--speed") params.rate_multiplier = std::stod(value);
+            else if (arg == "--spin-us") params.spin_us = std::stoi(value);
+            else if (arg == "--seed") params.seed = std::stoul(value);
+            else if (arg == "--report") params.report_interval = std::stod(value);
+            else if (arg == "--loss") params.loss = std::stod(value);
+            else if (arg == "--loss-burst") params.loss_burst = std::stoi(value);
+            else if (arg == "--reorder") params.reorder = std::stod(value);
+            else if (arg == "--csv") params.csv_file = value;
+            else if (arg == "--alpha-freq") params.alpha_frequency = std::stod(value);
+            else if (arg == "--alpha-amp") params.alpha_amplitude = std::stod(value);
+            else if (arg == "--noise") params.noise_amplitude = std::stod(value);
+            else if (arg == "--ga-amp") params.ga_amplitude = std::stod(value);
+            else if (arg == "--tr") params.tr = std::stod(value);
+            else if (arg == "--ta") params.ta = std::stod(value);
+            else if (arg == "--slices") params.slices = std::stoi(value);
+            else if (arg == "--bcg-amp") params.bcg_amplitude = std::stod(value);
+            else if (arg == "--heart-rate") params.heart_rate = std::stod(value);
+            else if (arg == "--trigger-b") params.trigger_b_interval = std::stod(value);
+            else {
+                std::cerr << "Unknown option " << arg << '\n';
+                return false;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "Invalid value for " << arg << ": " << value << '\n';
+            return false;
+        }
+    }
+
+    if (params.channels < 1 || params.channels > 65535 || params.sampling_rate < 1 || params.bundles < 1 ||
+        params.rate_multiplier <= 0 || params.loss_burst < 1 || params.slices < 1 || params.ta > params.tr) {
+        std::cerr << "Invalid parameters" << '\n';
+        return false;
+    }
+    return true;
+}
+
+void putUint16(uint8_t *buffer, uint16_t value) {
+    buffer[0] = (value >> 8) & 0xFF;
+    buffer[1] = value & 0xFF;
+}
 
-    return distr(gen); // Generate and return the random number
+void putUint32(uint8_t *buffer, uint32_t value) {
+    for (int i = 0; i < 4; i++) buffer[i] = (value >> ((3 - i) * 8)) & 0xFF;
 }
 
+void putUint64(uint8_t *buffer, uint64_t value) {
+    for (int i = 0; i < 8; i++) buffer[i] = (value >> ((7 - i) * 8)) & 0xFF;
+}
 
 std::vector<uint8_t> serializeMeasurementStartPacketData(
     uint8_t FrameType,
@@ -53,237 +205,417 @@ std::vector<uint8_t> serializeMeasurementStartPacketData(
     uint16_t NumChannels,
     const std::vector<uint16_t>& SourceChannels,
     const std::vector<uint8_t>& ChannelTypes) {
-    
-    std::vector<uint8_t> buffer;
-    
-    // Assuming the buffer should have a basic capacity. Adjust as needed.
-    buffer.reserve(1472); // Reserve an arbitrary size for simplicity
-
-    // Serialize fixed-size fields in big-endian order
-    buffer.push_back(FrameType);
-    buffer.push_back(MainUnitNum);
-    buffer.insert(buffer.end(), Reserved, Reserved + 2); // Assuming Reserved is an array
-    
-    // Serialize multi-byte integers in big-endian order
-    buffer.push_back((SamplingRateHz >> 24) & 0xFF);
-    buffer.push_back((SamplingRateHz >> 16) & 0xFF);
-    buffer.push_back((SamplingRateHz >> 8) & 0xFF);
-    buffer.push_back(SamplingRateHz & 0xFF);
-
-    buffer.push_back((SampleFormat >> 24) & 0xFF);
-    buffer.push_back((SampleFormat >> 16) & 0xFF);
-    buffer.push_back((SampleFormat >> 8) & 0xFF);
-    buffer.push_back(SampleFormat & 0xFF);
-
-    buffer.push_back((TriggerDefs >> 24) & 0xFF);
-    buffer.push_back((TriggerDefs >> 16) & 0xFF);
-    buffer.push_back((TriggerDefs >> 8) & 0xFF);
-    buffer.push_back(TriggerDefs & 0xFF);
-
-    buffer.push_back((NumChannels >> 8) & 0xFF);
-    buffer.push_back(NumChannels & 0xFF);
-
-    // Serialize SourceChannels
+
+    std::vector<uint8_t> buffer(18 + 3 * NumChannels);
+
+    buffer[0] = FrameType;
+    buffer[1] = MainUnitNum;
+    buffer[2] = Reserved[0];
+    buffer[3] = Reserved[1];
+    putUint32(&buffer[4], SamplingRateHz);
+    putUint32(&buffer[8], SampleFormat);
+    putUint32(&buffer[12], TriggerDefs);
+    putUint16(&buffer[16], NumChannels);
+
+    size_t offset = 18;
     for (auto channel : SourceChannels) {
-        buffer.push_back((channel >> 8) & 0xFF);
-        buffer.push_back(channel & 0xFF);
+        putUint16(&buffer[offset], channel);
+        offset += 2;
     }
-
-    // Serialize ChannelTypes
     for (auto type : ChannelTypes) {
-        buffer.push_back(type);
+        buffer[offset++] = type;
     }
 
     return buffer;
 }
 
-std::vector<uint8_t> serializeSamplePacketData(
-    uint8_t FrameType, uint8_t MainUnitNum, uint8_t Reserved[2], uint32_t PacketSeqNo, 
-    uint16_t NumChannels, uint16_t NumSampleBundles, uint64_t FirstSampleIndex, uint64_t FirstSampleTime, 
-    std::vector<std::vector<int32_t>> &int24Data) {
-    
-    std::vector<uint8_t> buffer;
-    buffer.reserve(1472); // Adjust based on int24Data size
-
-    // Serialize fixed-size fields in big-endian order
-    buffer.push_back(FrameType);
-    buffer.push_back(MainUnitNum);
-    buffer.insert(buffer.end(), Reserved, Reserved + 2);
-    
-    // Serialize multi-byte integers in big-endian order
-    buffer.push_back((PacketSeqNo >> 24) & 0xFF);
-    buffer.push_back((PacketSeqNo >> 16) & 0xFF);
-    buffer.push_back((PacketSeqNo >> 8) & 0xFF);
-    buffer.push_back(PacketSeqNo & 0xFF);
-
-    buffer.push_back((NumChannels >> 8) & 0xFF);
-    buffer.push_back(NumChannels & 0xFF);
-
-    buffer.push_back((NumSampleBundles >> 8) & 0xFF);
-    buffer.push_back(NumSampleBundles & 0xFF);
-
-    for(int i = 7; i >= 0; --i) {
-        buffer.push_back((FirstSampleIndex >> (i * 8)) & 0xFF);
-    }
+// Writes the header of a sample packet. The sequence number, sample index and time are patched before sending.
+void writeSamplePacketHeader(uint8_t *buffer, uint16_t NumChannels, uint16_t NumSampleBundles) {
+    buffer[0] = 2;  // FrameType
+    buffer[1] = 2;  // MainUnitNum
+    buffer[2] = 0;
+    buffer[3] = 0;
+    putUint32(buffer + 4, 0);
+    putUint16(buffer + 8, NumChannels);
+    putUint16(buffer + 10, NumSampleBundles);
+    putUint64(buffer + 12, 0);
+    putUint64(buffer + 20, 0);
+}
 
-    for(int i = 7; i >= 0; --i) {
-        buffer.push_back((FirstSampleTime >> (i * 8)) & 0xFF);
-    }
+void patchSamplePacketHeader(uint8_t *buffer, uint32_t PacketSeqNo, uint64_t FirstSampleIndex, uint64_t FirstSampleTime) {
+    putUint32(buffer + 4, PacketSeqNo);
+    putUint64(buffer + 12, FirstSampleIndex);
+    putUint64(buffer + 20, FirstSampleTime);
+}
 
-    // Serialize int24[N][C] in big-endian order
-    for (auto &row : int24Data) {
-        for (auto &val : row) {
-            // Assuming val represents a signed 24-bit integer correctly, including handling negative values
-            buffer.push_back((val >> 16) & 0xFF); // MSB
-            buffer.push_back((val >> 8) & 0xFF);
-            buffer.push_back(val & 0xFF); // LSB
-        }
+void putInt24(uint8_t *buffer, int32_t value) {
+    value = std::max(-8388608, std::min(8388607, value));
+    buffer[0] = (value >> 16) & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = value & 0xFF;
+}
+
+std::vector<uint8_t> generateMeasurementStartPacket(int data_channels, int sampling_rate) {
+    uint8_t Reserved[2] = {0, 0};
+    uint16_t NumChannels = data_channels + 1;
+
+    // Data channels are numbered from 1, the trigger channel is the last source
+    std::vector<uint16_t> SourceChannels(NumChannels);
+    for (int i = 0; i < data_channels; i++) {
+        SourceChannels[i] = i + 1;
     }
+    SourceChannels[NumChannels - 1] = 65535;
 
-    return buffer;
+    std::vector<uint8_t> ChannelTypes(NumChannels, 0);
+
+    return serializeMeasurementStartPacketData(1, 2, Reserved, sampling_rate, 1, 0, NumChannels, SourceChannels, ChannelTypes);
 }
 
-std::vector<uint8_t> generateExampleMeasurementStartPacket() {
-    uint8_t FrameType = 1; // Assuming 1 indicates a Measurement Start packet
-    uint8_t MainUnitNum = 2;
-    uint8_t Reserved[2] = {0, 0}; // Fill with appropriate values if needed
-    uint32_t SamplingRateHz = SAMPLINGRATE; // Example: 5000 Hz
-    uint32_t SampleFormat = 1; // Example format
-    uint32_t TriggerDefs = 0; // Example trigger definitions
-    uint16_t NumChannels = CHANNEL_COUNT; // Number of channels
+std::vector<uint8_t> generateMeasurementEndPacket() {
+    return {4, 2, 0, 0};
+}
 
-    // Example source channels and types
-    std::vector<uint16_t> SourceChannels(CHANNEL_COUNT, 0); // Example channel IDs
+/*
+Packet pool. All packets have the same length and are stored back to back.
+Sample values are in the 24-bit receiver units, stored channel-interleaved like the packets.
+*/
+struct packet_pool {
+    std::vector<uint8_t> data;
+    size_t packet_size = 0;
+    size_t packets = 0;
+
+    uint8_t *packet(size_t k) { return data.data() + (k % packets) * packet_size; }
+};
+
+// Packs samples (bundle-major, channels + trigger per bundle) into the pool
+void buildPool(packet_pool &pool, const std::vector<int32_t> &samples, int total_channels, int bundles) {
+    size_t total_samples = samples.size() / total_channels;
+    pool.packet_size = SAMPLE_PACKET_HEADER + static_cast<size_t>(bundles) * total_channels * 3;
+    pool.packets = total_samples / bundles;
+    pool.data.assign(pool.packets * pool.packet_size, 0);
+
+    for (size_t k = 0; k < pool.packets; k++) {
+        uint8_t *buffer = pool.packet(k);
+        writeSamplePacketHeader(buffer, total_channels, bundles);
+
+        uint8_t *payload = buffer + SAMPLE_PACKET_HEADER;
+        const int32_t *source = samples.data() + k * bundles * total_channels;
+        for (int i = 0; i < bundles * total_channels; i++) {
+            putInt24(payload + 3 * i, source[i]);
+        }
+    }
+}
 
-    for(size_t i = 0; i < CHANNEL_COUNT - 1; i++) {
-        SourceChannels[i] = i + 1;
+// Reads the CSV rows. Returns the number of data channels (columns minus the trigger column).
+int readCsvSamples(const std::string &filename, std::vector<int32_t> &samples) {
+    std::ifstream csvFile(filename);
+    if (!csvFile) {
+        std::cerr << "Failed to open " << filename << '\n';
+        return -1;
     }
-    SourceChannels[CHANNEL_COUNT - 1] = 65535;
 
-    std::vector<uint8_t> ChannelTypes(CHANNEL_COUNT, 0); // Example channel types (0 and 1 for demonstration)
+    std::string line;
+    int columns = -1;
+    while (std::getline(csvFile, line)) {
+        std::stringstream lineStream(line);
+        std::string cell;
+        std::vector<int32_t> row;
+
+        while (std::getline(lineStream, cell, ',')) {
+            row.push_back(std::stod(cell));
+        }
+        if (row.empty()) continue;
+        if (columns == -1) columns = row.size();
+        if (static_cast<int>(row.size()) != columns) {
+            std::cerr << "Skipping CSV row with " << row.size() << " columns instead of " << columns << '\n';
+            continue;
+        }
+
+        // A 1 in the trigger column marks trigger A
+        row.back() = (row.back() == 1) ? TRIGGER_A_BIT : 0;
+        samples.insert(samples.end(), row.begin(), row.end());
+    }
 
-    return serializeMeasurementStartPacketData(
-        FrameType, MainUnitNum, Reserved, SamplingRateHz,
-        SampleFormat, TriggerDefs, NumChannels, SourceChannels, ChannelTypes);
+    return columns - 1;
 }
 
-// Example usage
-std::vector<uint8_t> generateExampleSamplePacket_random() {
-    uint8_t FrameType = 2, MainUnitNum = 2, Reserved[2] = {3, 4};
-    uint32_t PacketSeqNo = 123456;
-    uint16_t NumChannels = CHANNEL_COUNT, NumSampleBundles = 2;
-    uint64_t FirstSampleIndex = 123456789012345, FirstSampleTime = 98765432109876;
+/*
+Synthetic signal for pool_samples samples. The per channel gains of all components are drawn
+once so that every channel sees a different mixture.
+*/
+void generateSyntheticSamples(const generator_parameters &params, size_t pool_samples, std::mt19937 &generator, std::vector<int32_t> &samples) {
+    const int data_channels = params.channels;
+    const int total_channels = data_channels + 1;
+    const double fs = params.sampling_rate;
+
+    std::uniform_real_distribution<double> gain_distribution(0.5, 1.5);
+    std::uniform_real_distribution<double> phase_distribution(0, 2 * M_PI);
+    std::uniform_real_distribution<double> sign_distribution(-1.0, 1.0);
+    std::normal_distribution<double> noise_distribution(0, 1);
+
+    std::vector<double> alpha_gain(data_channels), alpha_phase(data_channels), ga_gain(data_channels), bcg_gain(data_channels);
+    for (int c = 0; c < data_channels; c++) {
+        alpha_gain[c] = gain_distribution(generator);
+        alpha_phase[c] = phase_distribution(generator);
+        ga_gain[c] = gain_distribution(generator);
+        bcg_gain[c] = sign_distribution(generator);
+    }
+
+    // Heart beat times with 5 % interval jitter
+    std::vector<size_t> beats;
+    if (params.bcg_amplitude > 0 && params.heart_rate > 0) {
+        std::normal_distribution<double> interval_distribution(60.0 / params.heart_rate, 0.05 * 60.0 / params.heart_rate);
+        double beat_time = 0;
+        while (beat_time * fs < pool_samples) {
+            beats.push_back(static_cast<size_t>(beat_time * fs));
+            beat_time += std::max(0.3, interval_distribution(generator));
+        }
+    }
+
+    const size_t tr_samples = static_cast<size_t>(std::llround(params.tr * fs));
+    const size_t ta_samples = static_cast<size_t>(std::llround(params.ta * fs));
+    const double slice_samples = static_cast<double>(ta_samples) / params.slices;
+    const size_t trigger_b_samples = static_cast<size_t>(std::llround(params.trigger_b_interval * fs));
+
+    // BCG pulse: Gaussian 200 ms after the heart beat with 40 ms width
+    const double bcg_delay = 0.2 * fs;
+    const double bcg_width = 0.04 * fs;
+    size_t next_beat = 0;
+
+    samples.assign(pool_samples * total_channels, 0);
+    for (size_t n = 0; n < pool_samples; n++) {
+        double t = n / fs;
+        double alpha_envelope = params.alpha_amplitude * (1.0 + 0.5 * std::sin(2 * M_PI * 0.2 * t));
+
+        // Gradient artefact: derivative of a trapezoidal gradient in every slice, positive on the ramp up
+        // and negative on the ramp down
+        double ga = 0;
+        int32_t trigger = 0;
+        if (params.ga_amplitude > 0 && tr_samples > 0) {
+            size_t volume_position = n % tr_samples;
+            if (volume_position == 0) trigger |= TRIGGER_A_BIT;
+            if (volume_position < ta_samples) {
+                double slice_position = std::fmod(volume_position, slice_samples) / slice_samples;
+                if (slice_position < 0.1) ga = params.ga_amplitude;
+                else if (slice_position >= 0.9) ga = -params.ga_amplitude;
+            }
+        }
+        if (trigger_b_samples > 0 && n % trigger_b_samples == 0) trigger |= TRIGGER_B_BIT;
 
-    std::vector<std::vector<int32_t>> Samples(NumSampleBundles, std::vector<int32_t>(NumChannels));
+        double bcg = 0;
+        if (!beats.empty()) {
+            while (next_beat + 1 < beats.size() && n >= beats[next_beat + 1]) next_beat++;
+            double distance = static_cast<double>(n) - beats[next_beat] - bcg_delay;
+            bcg = params.bcg_amplitude * std::exp(-0.5 * distance * distance / (bcg_width * bcg_width));
+        }
 
-    for (auto &vec : Samples) {
-        for (auto &val : vec) {
-            val = getRandomNumber(-10, 10);
+        int32_t *row = samples.data() + n * total_channels;
+        for (int c = 0; c < data_channels; c++) {
+            double value = alpha_gain[c] * alpha_envelope * std::sin(2 * M_PI * params.alpha_frequency * t + alpha_phase[c])
+                         + params.noise_amplitude * noise_distribution(generator)
+                         + ga_gain[c] * ga
+                         + bcg_gain[c] * bcg;
+            row[c] = static_cast<int32_t>(std::lround(value * MICROVOLT_TO_SAMPLE));
         }
+        row[data_channels] = trigger;
     }
+}
 
-    // for (auto &vec : Samples) {
-    //     for (auto &val : vec) {
-    //         std::cout << val << ' ';
-    //     }
-    //     std::cout << '\n';
-    // }
+int64_t monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
 
-    return serializeSamplePacketData(FrameType, MainUnitNum, Reserved, PacketSeqNo, NumChannels, NumSampleBundles, FirstSampleIndex, FirstSampleTime, Samples);
+// Sleeps until the absolute deadline. The last spin_ns are busy waited for lower wakeup jitter.
+void waitUntil(int64_t deadline_ns, int64_t spin_ns) {
+    int64_t sleep_until = deadline_ns - spin_ns;
+    if (monotonicNs() < sleep_until) {
+        struct timespec deadline;
+        deadline.tv_sec = sleep_until / 1000000000LL;
+        deadline.tv_nsec = sleep_until % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR && !stop_requested) {}
+    }
+    while (spin_ns > 0 && monotonicNs() < deadline_ns) {}
 }
 
-// Example usage
-std::vector<uint8_t> generateExampleSamplePacket_csv(std::vector<int32_t> sample_vector, uint32_t SeqNo, uint64_t SampleTime) {
-    uint8_t FrameType = 2, MainUnitNum = 2, Reserved[2] = {3, 4};
-    uint32_t PacketSeqNo = SeqNo;
-    uint16_t NumChannels = CHANNEL_COUNT, NumSampleBundles = 1;
-    uint64_t FirstSampleIndex = 123456789012345, FirstSampleTime = SampleTime;
+int main(int argc, char *argv[]) {
+    generator_parameters params;
+    if (!parseArguments(argc, argv, params)) return 1;
+
+    std::signal(SIGINT, signalHandler);
+    std::signal(SIGTERM, signalHandler);
+
+    std::mt19937 generator(params.seed);
 
-    std::vector<std::vector<int32_t>> Samples(NumSampleBundles, std::vector<int32_t>(NumChannels));
+    // Generate the packet pool
+    std::vector<int32_t> samples;
+    if (!params.csv_file.empty()) {
+        params.channels = readCsvSamples(params.csv_file, samples);
+        if (params.channels < 1) return 1;
 
-    for (auto &vec : Samples) {
-        vec = sample_vector;
+        size_t trigger_b_samples = static_cast<size_t>(std::llround(params.trigger_b_interval * params.sampling_rate));
+        size_t total_samples = samples.size() / (params.channels + 1);
+        for (size_t n = 0; trigger_b_samples > 0 && n < total_samples; n += trigger_b_samples) {
+            samples[n * (params.channels + 1) + params.channels] |= TRIGGER_B_BIT;
+        }
+    } else {
+        size_t pool_samples = static_cast<size_t>(std::llround(params.pool_seconds * params.sampling_rate));
+        // Whole volumes keep the gradient artefact continuous when the pool wraps
+        if (params.ga_amplitude > 0) {
+            size_t tr_samples = static_cast<size_t>(std::llround(params.tr * params.sampling_rate));
+            pool_samples = ((pool_samples + tr_samples - 1) / tr_samples) * tr_samples;
+        }
+        pool_samples = std::max(pool_samples, static_cast<size_t>(2 * params.bundles));
+        generateSyntheticSamples(params, pool_samples, generator, samples);
     }
 
-    if (SeqNo % 10000 == 0) {
-	Samples.front().back() |= 0x08;
-	//std::cout << "Trigger_A set" << '\n';
+    const int total_channels = params.channels + 1;
+    const size_t packet_size = SAMPLE_PACKET_HEADER + static_cast<size_t>(params.bundles) * total_channels * 3;
+    if (packet_size > BUFFER_LENGTH) {
+        std::cerr << "Packet size " << packet_size << " exceeds " << BUFFER_LENGTH << " bytes. At most "
+                  << (BUFFER_LENGTH - SAMPLE_PACKET_HEADER) / (3 * total_channels) << " bundles fit with " << params.channels << " channels." << '\n';
+        return 1;
     }
-    if (sample_vector.back() == 1) {
-	Samples.front().back() |= 0x02;
-	//std::cout << "Trigger_B set " << sample_vector.back() << '\n';
+
+    packet_pool pool;
+    buildPool(pool, samples, total_channels, params.bundles);
+    samples.clear();
+    samples.shrink_to_fit();
+    if (pool.packets == 0) {
+        std::cerr << "No samples to send" << '\n';
+        return 1;
     }
-    
-    return serializeSamplePacketData(FrameType, MainUnitNum, Reserved, PacketSeqNo, NumChannels, NumSampleBundles, FirstSampleIndex, FirstSampleTime, Samples);
-}
 
-void sendUDP(const std::vector<uint8_t> &data, const std::string &address, int port) {
+    uint64_t packets_to_send = 0;  // 0 = until interrupted
+    if (params.duration > 0) packets_to_send = static_cast<uint64_t>(params.duration * params.sampling_rate / params.bundles);
+    else if (!params.csv_file.empty()) packets_to_send = pool.packets;
+
+    std::cout << "Packet pool: " << pool.packets << " packets of " << pool.packet_size << " bytes ("
+              << pool.data.size() / (1024.0 * 1024.0) << " MB)\n"
+              << params.channels << " channels + trigger, " << params.sampling_rate << " Hz, " << params.bundles << " bundles per packet, "
+              << params.sampling_rate / static_cast<double>(params.bundles) * (params.max_rate ? 0 : params.rate_multiplier) << " packets/s"
+              << (params.max_rate ? " (max rate)" : "") << '\n';
+
+    // Connected socket, so that every send skips the address lookup
     int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
         std::cerr << "Error opening socket" << std::endl;
-        return;
+        return 1;
     }
 
     sockaddr_in servaddr;
     memset(&servaddr, 0, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
-    servaddr.sin_port = htons(port);
-    servaddr.sin_addr.s_addr = inet_addr(address.c_str());
+    servaddr.sin_port = htons(params.port);
+    servaddr.sin_addr.s_addr = inet_addr(params.address.c_str());
+    if (connect(sockfd, (const sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
+        std::cerr << "Failed to connect to " << params.address << ':' << params.port << std::endl;
+        return 1;
+    }
 
-    sendto(sockfd, data.data(), data.size(), 0, (const sockaddr *)&servaddr, sizeof(servaddr));
-    close(sockfd);
-}
+    int send_buffer = 4 * 1024 * 1024;
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
 
-int main() {
-    std::vector<uint8_t> MSdata = generateExampleMeasurementStartPacket();
-    // std::string IP_address = "127.0.0.1"; // Localhost
-    // std::string IP_address = "192.168.0.100";
-    std::string IP_address = "192.168.0.105";
+    // Tight wakeups from clock_nanosleep
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
 
-    sendUDP(MSdata, IP_address, PORT);
+    std::vector<uint8_t> MSdata = generateMeasurementStartPacket(params.channels, params.sampling_rate);
+    send(sockfd, MSdata.data(), MSdata.size(), 0);
     std::cout << "MeasurementStartPackage sent!" << '\n';
 
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    struct timespec one_second = {1, 0};
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &one_second, nullptr);
 
-    // std::ifstream csvFile("/home/user/EEG/data/testdata_veikka_raw.csv");
-    std::ifstream csvFile("/home/veikka/Work/EEG/DataStream/mat_file_conversion/testdata_interleaved_sept.csv");
-    // std::ifstream csvFile("/home/user/EEG/data/testdata_interleaved_sept.csv");
-    // std::ifstream csvFile("/home/user/EEG/data/testdata_continuous_sept.csv");
-    // std::ifstream csvFile("/home/user/EEG/data/5_eeg_7_cwl_reference.csv");
-    // std::ifstream csvFile("/home/user/EEG/data/testdata_sine.csv");
-    // std::ifstream csvFile("/home/veikka/Work/EEG/DataStream/mat_file_conversion/testdata_veikka_raw.csv");
-    std::string line;
-    uint32_t sequenceNumber = 0;
-    auto sleepDurationMicroseconds = static_cast<long long>(1000000) / SAMPLINGRATE;
+    const double packet_interval_ns = 1e9 * params.bundles / (params.sampling_rate * params.rate_multiplier);
+    const int64_t spin_ns = static_cast<int64_t>(params.spin_us) * 1000;
+    const int64_t report_interval_ns = static_cast<int64_t>(params.report_interval * 1e9);
 
-    auto startTimePoint = std::chrono::system_clock::now();
-    auto lastTimePoint = std::chrono::steady_clock::now();
+    std::uniform_real_distribution<double> probability(0.0, 1.0);
+    uint8_t held_packet[BUFFER_LENGTH];
+    bool packet_held = false;
+    int burst_remaining = 0;
 
-    int number_of_sample_packets_to_send = 40000000;//14999;
-    while (std::getline(csvFile, line) && sequenceNumber < number_of_sample_packets_to_send) {
-        std::stringstream lineStream(line);
-        std::string cell;
-        std::vector<int32_t> sampleVector;
+    uint64_t sent = 0, dropped = 0, reordered = 0, late = 0, send_errors = 0;
+    int64_t max_lateness_ns = 0;
 
-        while (std::getline(lineStream, cell, ',')) {
-            sampleVector.push_back(std::stod(cell));
+    int64_t start_ns = monotonicNs();
+    int64_t next_report_ns = start_ns + report_interval_ns;
+    uint64_t k = 0;
+
+    for (; !stop_requested && (packets_to_send == 0 || k < packets_to_send); k++) {
+        int64_t deadline_ns = start_ns + static_cast<int64_t>(k * packet_interval_ns);
+
+        if (!params.max_rate) {
+            waitUntil(deadline_ns, spin_ns);
+            int64_t lateness_ns = monotonicNs() - deadline_ns;
+            max_lateness_ns = std::max(max_lateness_ns, lateness_ns);
+            if (lateness_ns > packet_interval_ns) late++;
         }
-        
-        auto timeStamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now() - startTimePoint);
-        uint64_t SampleTime = static_cast<uint64_t>(timeStamp.count());
-        std::vector<uint8_t> samplePacket = generateExampleSamplePacket_csv(sampleVector, sequenceNumber, SampleTime);
 
-        sendUDP(samplePacket, IP_address, PORT);
+        uint8_t *packet = pool.packet(k);
+        uint64_t first_sample = k * params.bundles;
+        patchSamplePacketHeader(packet, static_cast<uint32_t>(k), first_sample,
+                                static_cast<uint64_t>(first_sample * 1000000.0 / params.sampling_rate));
 
-        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - lastTimePoint;
-        std::cout << "Package " << sequenceNumber << " sent! Time since last packet: " << elapsed.count() << " seconds.\n";
+        // Packet loss
+        if (burst_remaining > 0) {
+            burst_remaining--;
+            dropped++;
+            continue;
+        }
+        if (params.loss > 0 && probability(generator) < params.loss) {
+            burst_remaining = params.loss_burst - 1;
+            dropped++;
+            continue;
+        }
 
-        // Throttle sending to maintain sampling rate
-        std::this_thread::sleep_for(std::chrono::microseconds(sleepDurationMicroseconds));
-        lastTimePoint = std::chrono::steady_clock::now();
+        // Reordering: hold this packet back and send it after the next one
+        if (!packet_held && params.reorder > 0 && probability(generator) < params.reorder) {
+            memcpy(held_packet, packet, pool.packet_size);
+            packet_held = true;
+            reordered++;
+            continue;
+        }
+
+        if (send(sockfd, packet, pool.packet_size, 0) < 0) send_errors++;
+        else sent++;
+
+        if (packet_held) {
+            if (send(sockfd, held_packet, pool.packet_size, 0) < 0) send_errors++;
+            else sent++;
+            packet_held = false;
+        }
+
+        int64_t now_ns = monotonicNs();
+        if (report_interval_ns > 0 && now_ns >= next_report_ns) {
+            double elapsed = (now_ns - start_ns) / 1e9;
+            std::cout << "Sent " << sent << " packets in " << elapsed << " s (" << sent / elapsed << " packets/s), "
+                      << dropped << " dropped, " << late << " late" << std::endl;
+            next_report_ns += report_interval_ns;
+        }
+    }
+
+    if (packet_held) {
+        if (send(sockfd, held_packet, pool.packet_size, 0) < 0) send_errors++;
+        else sent++;
+    }
+
+    double elapsed = (monotonicNs() - start_ns) / 1e9;
+
+    std::vector<uint8_t> MEdata = generateMeasurementEndPacket();
+    send(sockfd, MEdata.data(), MEdata.size(), 0);
+    std::cout << "MeasurementEndPackage sent!" << '\n';
+    close(sockfd);
 
-        sequenceNumber++;
+    std::cout << "Packets generated: " << k << "\n"
+              << "Packets sent: " << sent << " (" << sent / elapsed << " packets/s, " << sent * params.bundles / elapsed << " samples/s)\n"
+              << "Packets dropped: " << dropped << "\n"
+              << "Packets reordered: " << reordered << "\n"
+              << "Send errors: " << send_errors << "\n";
+    if (!params.max_rate) {
+        std::cout << "Late packets (more than one interval): " << late << "\n"
+                  << "Maximum lateness: " << max_lateness_ns / 1000.0 << " us\n";
     }
 
     return 0;
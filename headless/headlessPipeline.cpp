@@ -0,0 +1,357 @@
+#include "headlessPipeline.h"
+#include <pthread.h>
+#include <sched.h>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+// Pins the calling thread to a core and switches it to SCHED_RR. core < 0 leaves the thread as is.
+static void setThreadRealtime(int core, const std::string &name) {
+    if (core < 0) return;
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
+        std::cerr << "Failed to pin " << name << " thread to core " << core << '\n';
+    }
+
+    struct sched_param params;
+    params.sched_priority = sched_get_priority_max(SCHED_RR);
+    if (pthread_setschedparam(pthread_self(), SCHED_RR, &params) != 0) {
+        std::cerr << "Failed to set " << name << " thread to real-time" << '\n';
+    }
+}
+
+bool loadHeadlessConfig(const std::string &filename, headlessConfig &config) {
+    boost::property_tree::ptree tree;
+    try {
+        boost::property_tree::read_json(filename, tree);
+    } catch (const boost::property_tree::json_parser_error &e) {
+        std::cerr << "Failed to read config " << filename << ": " << e.what() << '\n';
+        return false;
+    }
+
+    config.duration_s = tree.get("duration_s", config.duration_s);
+    config.stats_file = tree.get("stats_file", config.stats_file);
+    config.trace_report_s = tree.get("trace_report_s", config.trace_report_s);
+    config.ring_layout = tree.get("ring_layout", config.ring_layout);
+    if (config.ring_layout != "columns" && config.ring_layout != "tiled") {
+        std::cerr << "Unknown ring_layout " << config.ring_layout << ", expected columns or tiled" << '\n';
+        return false;
+    }
+
+    std::string fft_planning = tree.get("fft.planning", std::string("measure"));
+    if (!parseFFTPlanningEffort(fft_planning, config.fft_planning)) {
+        std::cerr << "Unknown fft.planning " << fft_planning << ", expected estimate, measure or patient" << '\n';
+        return false;
+    }
+    config.fft_wisdom = tree.get("fft.wisdom", config.fft_wisdom);
+
+    filterSpec &filter = config.realtime_filter;
+    filter.low = tree.get("realtime_filter.low", filter.low);
+    filter.high = tree.get("realtime_filter.high", filter.high);
+    filter.order = tree.get("realtime_filter.taps", filter.order);
+    filter.transition = tree.get("realtime_filter.transition", filter.transition);
+
+    config.port = tree.get("bridge.port", config.port);
+    config.timeout = tree.get("bridge.timeout", config.timeout);
+    config.record_file = tree.get("bridge.record", config.record_file);
+    config.replay_file = tree.get("bridge.replay", config.replay_file);
+    config.replay_speed = tree.get("bridge.replay_speed", config.replay_speed);
+    config.bridge_core = tree.get("bridge.core", config.bridge_core);
+
+    config.trigger_enable = tree.get("trigger.enable", config.trigger_enable);
+    config.trigger_connection = tree.get("trigger.connection", config.trigger_connection);
+    config.trigger_time_limit = tree.get("trigger.time_limit", config.trigger_time_limit);
+    config.trigger_scheduled = tree.get("trigger.scheduled", config.trigger_scheduled);
+    config.trigger_spin_us = tree.get("trigger.spin_us", config.trigger_spin_us);
+
+    preprocessingParameters &prep = config.prepParams;
+    prep.numberOfSamples = tree.get("preprocessing.numberOfSamples", prep.numberOfSamples);
+    prep.downsampling_factor = tree.get("preprocessing.downsampling_factor", prep.downsampling_factor);
+    prep.delay = tree.get("preprocessing.delay", prep.delay);
+    prep.wake_granularity = tree.get("preprocessing.wake_granularity", prep.wake_granularity);
+    prep.wait_timeout_ms = tree.get("preprocessing.wait_timeout_ms", prep.wait_timeout_ms);
+    config.remove_bcg = tree.get("preprocessing.remove_bcg", config.remove_bcg);
+    config.preprocessing_core = tree.get("preprocessing.core", config.preprocessing_core);
+
+    // The phase estimation window follows the preprocessing output
+    phaseEstimateParameters &phase = config.phaseEstParams;
+    phase.numberOfSamples = prep.numberOfSamples;
+    phase.downsampling_factor = prep.downsampling_factor;
+    phase.edge = tree.get("phase_estimation.edge", phase.edge);
+    phase.modelOrder = tree.get("phase_estimation.modelOrder", phase.modelOrder);
+    phase.hilbertWinLength = tree.get("phase_estimation.hilbertWinLength", phase.hilbertWinLength);
+    phase.stimulation_target = tree.get("phase_estimation.stimulation_target", phase.stimulation_target);
+    phase.phase_shift = tree.get("phase_estimation.phase_shift", phase.phase_shift);
+    phase.wait_timeout_ms = tree.get("phase_estimation.wait_timeout_ms", phase.wait_timeout_ms);
+    phase.filter2_low = tree.get("phase_estimation.filter_low", phase.filter2_low);
+    phase.filter2_high = tree.get("phase_estimation.filter_high", phase.filter2_high);
+    phase.filter2_taps = tree.get("phase_estimation.filter_taps", phase.filter2_taps);
+    phase.filter2_transition = tree.get("phase_estimation.filter_transition", phase.filter2_transition);
+    config.phase_estimation = tree.get("phase_estimation.enable", config.phase_estimation);
+    config.spatial_channel = tree.get("phase_estimation.spatial_channel", config.spatial_channel);
+    config.phase_estimation_core = tree.get("phase_estimation.core", config.phase_estimation_core);
+
+    phaseEstimateStates &states = config.phaseEstStates;
+    states.performPhaseEstimation = config.phase_estimation;
+    states.performFiltering = tree.get("phase_estimation.filtering", states.performFiltering);
+    states.performEstimation = tree.get("phase_estimation.estimation", states.performEstimation);
+    states.performHilbertTransform = tree.get("phase_estimation.hilbert", states.performHilbertTransform);
+    states.performPhaseTargeting = tree.get("phase_estimation.phase_targeting", states.performPhaseTargeting);
+    return true;
+}
+
+headlessPipeline::headlessPipeline(dataHandler &handler, EegBridge &bridge, headlessConfig config)
+    : handler(handler), bridge(bridge), config(config)
+{ }
+
+headlessPipeline::~headlessPipeline() {
+    stopProcessing();
+    if (bridge_thread.joinable()) bridge_thread.join();
+}
+
+int headlessPipeline::run(volatile std::sig_atomic_t &signal_received) {
+    if (!config.replay_file.empty() && !bridge.openReplay(config.replay_file, config.replay_speed)) return 1;
+    if (!config.record_file.empty() && !bridge.startRecording(config.record_file)) return 1;
+
+    // Applied when the MeasurementStart packet resets the handler
+    handler.setRingLayout(config.ring_layout == "tiled" ? RING_LAYOUT_TILED : RING_LAYOUT_COLUMNS);
+    setFFTPlanningEffort(config.fft_planning);
+    if (!config.fft_wisdom.empty()) loadFFTWisdom(config.fft_wisdom);
+    const filterSpec &filter = config.realtime_filter;
+    if (!handler.setRealTimeFilterBand(filter.low, filter.high, filter.order, filter.transition)) return 1;
+
+    if (config.trigger_enable && connectTrigger()) {
+        handler.setTriggerTimeLimit(config.trigger_time_limit);
+        handler.setTriggerEnableStatus(true);
+    }
+    if (config.trigger_scheduled) {
+        handler.getTriggerScheduler().setSpinTime(config.trigger_spin_us * 1000LL);
+        handler.setTriggerScheduling(true);
+    }
+
+    startBridge(signal_received);
+
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start;
+    while (!signal_received && !bridge_done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        // Channel count and sampling rate are known after the MeasurementStart packet, which also resets the handler
+        if (handler.isReady() && handler.getResetCount() != processing_reset_count) {
+            stopProcessing();
+            startProcessing();
+        }
+
+        if (config.trace_report_s > 0) {
+            std::chrono::duration<double> since_report = std::chrono::steady_clock::now() - last_report;
+            if (since_report.count() >= config.trace_report_s) {
+                handler.getTracer().printSummary(std::cout);
+                handler.getClockModel().printReport(std::cout);
+                last_report = std::chrono::steady_clock::now();
+            }
+        }
+
+        if (config.duration_s > 0) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= config.duration_s) break;
+        }
+    }
+
+    stopProcessing();
+    handler.setTriggerScheduling(false);
+    signal_received = 1;
+    if (bridge_thread.joinable()) bridge_thread.join();
+
+    handler.save_seqnum_list();
+    writeStatistics();
+    if (!config.fft_wisdom.empty()) saveFFTWisdom(config.fft_wisdom);
+    return 0;
+}
+
+void headlessPipeline::startBridge(volatile std::sig_atomic_t &signal_received) {
+    bridge.setPort(config.port);
+    bridge.setTimeout(config.timeout);
+
+    bridge_thread = std::thread([this, &signal_received]() {
+        setThreadRealtime(config.bridge_core, "EEG bridge");
+        bridge.bind_socket();
+        bridge.handler_spin(handler, signal_received);
+        bridge_done = true;
+    });
+}
+
+void headlessPipeline::startProcessing() {
+    std::cout << "Measurement started, starting processing" << '\n';
+    processing_reset_count = handler.getResetCount();
+    processingRunning = 1;
+
+    // The pipelines of the previous measurement are stopped, so they can be replaced
+    phaseEstimation.reset();
+    preprocessing = std::make_unique<preprocessingPipeline>(handler, processingRunning, config.prepParams);
+    preprocessing->setRemoveBCG(config.remove_bcg);
+
+    if (config.phase_estimation) {
+        phaseEstimation = std::make_unique<phaseEstimationPipeline>(handler, processingRunning, config.phaseEstParams);
+        phaseEstimation->setStates(config.phaseEstStates);
+        phaseEstimation->setSpatilaTargetChannel(config.spatial_channel);
+
+        // Preprocessing output goes straight to the phase estimation mailbox
+        phaseEstimationPipeline *phase = phaseEstimation.get();
+        preprocessing->setOutputCallback([phase](const Eigen::MatrixXd &output, const Eigen::VectorXi &triggers_A, const Eigen::VectorXi &triggers_B,
+                                                 const Eigen::VectorXi &triggers_out, const VectorXi64 &time_stamps, int number_of_samples, int seq_num) {
+            phase->handlePreprocessingOutput(output, triggers_A, triggers_B, triggers_out, time_stamps, number_of_samples, seq_num);
+        });
+
+        phase_estimation_thread = std::thread([this]() {
+            setThreadRealtime(config.phase_estimation_core, "phase estimation");
+            try {
+                phaseEstimation->run();
+            } catch (const std::exception &e) {
+                std::cerr << "Phase estimation error: " << e.what() << '\n';
+            }
+        });
+    }
+
+    preprocessing_thread = std::thread([this]() {
+        setThreadRealtime(config.preprocessing_core, "preprocessing");
+        try {
+            preprocessing->run();
+        } catch (const std::exception &e) {
+            std::cerr << "Preprocessing error: " << e.what() << '\n';
+        }
+    });
+}
+
+void headlessPipeline::stopProcessing() {
+    processingRunning = 0;
+    if (preprocessing_thread.joinable()) preprocessing_thread.join();
+    if (phase_estimation_thread.joinable()) phase_estimation_thread.join();
+}
+
+bool headlessPipeline::connectTrigger() {
+    if (config.trigger_connection == "COM") {
+        handler.setTMSConnectionType(COM);
+        if (handler.connectTriggerPort() != 0) {
+            std::cerr << "Failed to connect the MagPro trigger port" << '\n';
+            return false;
+        }
+        handler.setTriggerConnectStatus(true);
+    } else if (config.trigger_connection == "TTL") {
+        handler.setTMSConnectionType(TTL);
+        if (handler.connectTriggerPort_TTL() != 0) {
+            std::cerr << "Failed to connect the LabJack trigger output" << '\n';
+            return false;
+        }
+        handler.setTriggerConnectStatus(true);
+    }
+    // "none" records the trigger decisions without sending pulses
+    return true;
+}
+
+void headlessPipeline::writeStatistics() {
+    boost::property_tree::ptree stats;
+
+    stats.put("acquisition.samples", handler.getSamplesWritten());
+    stats.put("acquisition.sampling_rate", handler.getSamplingRate());
+    stats.put("acquisition.channels", handler.get_channel_count());
+    stats.put("acquisition.ring_layout", config.ring_layout);
+    std::ostringstream realtime_filter;
+    realtime_filter << handler.getRealTimeFilterSpec();
+    stats.put("acquisition.realtime_filter", realtime_filter.str());
+    stats.put("acquisition.gaps", handler.getGapCount());
+    stats.put("acquisition.placeholder_samples", handler.getGapSamplesFilled());
+    stats.put("acquisition.late_packets", handler.getLatePacketCount());
+    stats.put("acquisition.invalid_packets", handler.getInvalidPacketCount());
+    stats.put("acquisition.amplifier_trigger_events", handler.getTriggerEventCount());
+
+    clock_report clock = handler.getClockModel().getReport();
+    if (clock.packets > 0) {
+        stats.put("clock.drift_ppm", clock.drift_ppm);
+        stats.put("clock.period_ns", clock.period_ns);
+        stats.put("clock.window_s", clock.window_s);
+        stats.put("clock.jitter_mean_us", clock.jitter_mean_us);
+        stats.put("clock.jitter_std_us", clock.jitter_std_us);
+        stats.put("clock.jitter_max_us", clock.jitter_max_us);
+    }
+
+    const std::vector<double> &latencies = handler.getTriggerLatencies();
+    stats.put("triggers.sent", handler.getSentTriggers().size());
+    triggerWheel &wheel = handler.getTriggerWheel();
+    stats.put("triggers.targets_scheduled", wheel.getScheduledCount());
+    stats.put("triggers.targets_fired", wheel.getFiredCount());
+    stats.put("triggers.targets_suppressed", wheel.getSuppressedCount());
+    stats.put("triggers.targets_expired", wheel.getExpiredCount());
+    triggerScheduler &scheduler = handler.getTriggerScheduler();
+    if (scheduler.getScheduledCount() > 0) {
+        stats.put("triggers.scheduled", scheduler.getScheduledCount());
+        stats.put("triggers.scheduled_fired", scheduler.getFiredCount());
+        stats.put("triggers.scheduled_suppressed", scheduler.getSuppressedCount());
+        stats.put("triggers.scheduled_late", scheduler.getLateCount());
+
+        std::vector<trigger_timing> timings = scheduler.getTimings();
+        if (!timings.empty()) {
+            double max_error_us = 0;
+            double sum_error_us = 0;
+            for (const trigger_timing &timing : timings) {
+                double error_us = (timing.achieved_ns - timing.intended_ns) / 1000.0;
+                sum_error_us += error_us;
+                max_error_us = std::max(max_error_us, std::abs(error_us));
+            }
+            stats.put("triggers.timing_error_mean_us", sum_error_us / timings.size());
+            stats.put("triggers.timing_error_max_abs_us", max_error_us);
+        }
+    }
+    if (!latencies.empty()) {
+        stats.put("triggers.latency_mean_ms", std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size());
+        stats.put("triggers.latency_max_ms", *std::max_element(latencies.begin(), latencies.end()));
+    }
+
+    // Latency from the packet arrival to the end of each stage
+    const latencyTracer &tracer = handler.getTracer();
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+        latency_summary s = tracer.summary(stage);
+        if (s.count == 0) continue;
+        boost::property_tree::ptree stage_stats;
+        stage_stats.put("count", s.count);
+        stage_stats.put("mean_us", s.mean_us);
+        stage_stats.put("p50_us", s.p50_us);
+        stage_stats.put("p90_us", s.p90_us);
+        stage_stats.put("p99_us", s.p99_us);
+        stage_stats.put("p99_9_us", s.p999_us);
+        stage_stats.put("max_us", s.max_us);
+        stats.add_child(std::string("latency.") + traceStageName(stage), stage_stats);
+    }
+
+    if (preprocessing) {
+        stats.put("preprocessing.iterations", preprocessing->getIterationCount());
+        stats.put("preprocessing.average_ms", preprocessing->getAverageTime() * 1000);
+        if (preprocessing->getIterationCount() > 0) {
+            stats.put("preprocessing.minimum_ms", preprocessing->getMinimumTime() * 1000);
+            stats.put("preprocessing.maximum_ms", preprocessing->getMaximumTime() * 1000);
+            stats.put("preprocessing.arrival_latency_average_ms", preprocessing->getAverageArrivalLatency() * 1000);
+            stats.put("preprocessing.arrival_latency_maximum_ms", preprocessing->getMaximumArrivalLatency() * 1000);
+        }
+    }
+    if (phaseEstimation) {
+        stats.put("phase_estimation.iterations", phaseEstimation->getIterationCount());
+        stats.put("phase_estimation.average_ms", phaseEstimation->getAverageTime() * 1000);
+        if (phaseEstimation->getIterationCount() > 0) {
+            stats.put("phase_estimation.minimum_ms", phaseEstimation->getMinimumTime() * 1000);
+            stats.put("phase_estimation.maximum_ms", phaseEstimation->getMaximumTime() * 1000);
+        }
+        stats.put("phase_estimation.inserted_triggers", phaseEstimation->getTriggerCount());
+    }
+
+    try {
+        boost::property_tree::write_json(config.stats_file, stats);
+        std::cout << "Statistics written to " << config.stats_file << '\n';
+    } catch (const boost::property_tree::json_parser_error &e) {
+        std::cerr << "Failed to write statistics: " << e.what() << '\n';
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef HEADLESSPIPELINE_H
+#define HEADLESSPIPELINE_H
+
+#include <csignal>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <iostream>
+
+#include "dataHandler/dataHandler.h"
+#include "devices/EEG/eeg_bridge/eeg_bridge.h"
+#include "EEG/preprocessing/preprocessingPipeline.h"
+#include "EEG/phaseEstimation/phaseEstimationPipeline.h"
+#include "math/fftPlanCache.h"
+
+/*
+Configuration of a headless run. Read from a JSON file, every key is optional:
+{
+    "duration_s": 0,                            // 0 runs until Ctrl+C or the end of a replay
+    "stats_file": "headless_stats.json",
+    "trace_report_s": 0,                        // Print the latency percentiles every n seconds, 0 = off
+    "ring_layout": "columns",                   // Sample ring storage: columns or tiled, see dataHandler/sampleRing.h
+    "fft": { "planning": "measure", "wisdom": "fftw_wisdom" },                     // estimate, measure or patient, see math/fftPlanCache.h
+    "realtime_filter": { "low": 0, "high": 80, "taps": 81, "transition": 170 },     // LS FIR of the acquisition, see math/filterDesign.h
+    "bridge": { "port": 50000, "timeout": 60, "record": "", "replay": "", "replay_speed": 1.0, "core": 0 },
+    "trigger": { "enable": false, "connection": "none", "time_limit": 1000,             // connection: none, COM or TTL
+                 "scheduled": false, "spin_us": 50 },                                   // Fire at predicted times, see triggerScheduler.h
+    "preprocessing": { "numberOfSamples": 10000, "downsampling_factor": 10, "delay": 5,
+                       "wake_granularity": 1, "wait_timeout_ms": 100, "remove_bcg": false, "core": -1 },
+    "phase_estimation": { "enable": true, "edge": 35, "modelOrder": 15, "hilbertWinLength": 64,
+                          "stimulation_target": 0, "phase_shift": -40, "filtering": false,
+                          "phase_targeting": false, "spatial_channel": 0, "core": -1,
+                          "filter_low": 9, "filter_high": 13, "filter_taps": 71, "filter_transition": 3 }
+}
+A core of -1 leaves the thread unpinned. Pinned threads are also switched to SCHED_RR.
+*/
+struct headlessConfig {
+    double duration_s = 0;
+    std::string stats_file = "headless_stats.json";
+    double trace_report_s = 0;
+    std::string ring_layout = "columns";
+    filterSpec realtime_filter = MultiChannelRealTimeFilter().getSpec();
+    FFTPlanningEffort fft_planning = FFT_PLANNING_MEASURE;
+    std::string fft_wisdom = "fftw_wisdom";
+
+    int port = 50000;
+    int timeout = 60;
+    std::string record_file;
+    std::string replay_file;
+    double replay_speed = 1.0;
+    int bridge_core = 0;
+
+    bool trigger_enable = false;
+    std::string trigger_connection = "none";
+    int trigger_time_limit = 1000;
+    bool trigger_scheduled = false;
+    int trigger_spin_us = 50;
+
+    preprocessingParameters prepParams;
+    bool remove_bcg = false;
+    int preprocessing_core = -1;
+
+    bool phase_estimation = true;
+    phaseEstimateParameters phaseEstParams;
+    phaseEstimateStates phaseEstStates;
+    int spatial_channel = 0;
+    int phase_estimation_core = -1;
+};
+
+bool loadHeadlessConfig(const std::string &filename, headlessConfig &config);
+
+/*
+Acquisition, preprocessing and phase estimation without the GUI. The bridge receive loop, the preprocessing loop
+and the phase estimation loop run on their own threads and are connected through the pipeline callbacks. The
+processing pipelines are rebuilt for every MeasurementStart, so the statistics cover the last measurement.
+*/
+class headlessPipeline {
+public:
+    headlessPipeline(dataHandler &handler, EegBridge &bridge, headlessConfig config);
+    ~headlessPipeline();
+
+    // Blocks until signal_received is set, the duration elapses or the replay ends
+    int run(volatile std::sig_atomic_t &signal_received);
+
+private:
+    void startBridge(volatile std::sig_atomic_t &signal_received);
+    void startProcessing();
+    void stopProcessing();
+    bool connectTrigger();
+    void writeStatistics();
+
+    dataHandler &handler;
+    EegBridge &bridge;
+    headlessConfig config;
+
+    std::thread bridge_thread;
+    std::thread preprocessing_thread;
+    std::thread phase_estimation_thread;
+    std::atomic<bool> bridge_done{false};
+
+    volatile std::sig_atomic_t processingRunning = 0;
+    std::unique_ptr<preprocessingPipeline> preprocessing;
+    std::unique_ptr<phaseEstimationPipeline> phaseEstimation;
+    int processing_reset_count = -1;        // getResetCount() of the measurement the pipelines were built for
+};
+
+#endif // HEADLESSPIPELINE_H
@@ -0,0 +1,48 @@
+#include <csignal>
+#include <iostream>
+#include <malloc.h>
+#include <sys/mman.h> // For mlockall
+
+#include "dataHandler/dataHandler.h"
+#include "devices/EEG/eeg_bridge/eeg_bridge.h"
+#include "headlessPipeline.h"
+
+// Acquisition and closed-loop processing without the GUI:
+//   ./real_time_eeg_headless [config.json]
+// See headlessPipeline.h for the configuration keys.
+
+// This is used to terminate the program with Ctrl+C
+volatile std::sig_atomic_t signal_received = 0;
+void signal_handler(int) {
+    signal_received = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    headlessConfig config;
+    if (argc > 1 && !loadHeadlessConfig(argv[1], config)) return 1;
+
+    // Lock all current and future memory pages into RAM
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cerr << "Failed to lock memory" << std::endl;
+    }
+
+    // Disable memory trimming
+    if (mallopt(M_TRIM_THRESHOLD, -1) != 1) {
+        std::cerr << "Failed to set M_TRIM_THRESHOLD" << std::endl;
+    }
+
+    // Prevent mmap from being used for memory allocation
+    if (mallopt(M_MMAP_MAX, 0) != 1) {
+        std::cerr << "Failed to set M_MMAP_MAX" << std::endl;
+    }
+
+    std::signal(SIGINT, signal_handler);
+    std::signal(SIGTERM, signal_handler);
+
+    dataHandler handler;
+    EegBridge bridge;
+
+    headlessPipeline pipeline(handler, bridge, config);
+    return pipeline.run(signal_received);
+}
@@ -5,11 +5,13 @@
 #include <csignal>
 #include <chrono>
 #include <fstream>
+#include <cstdlib>
 #include <malloc.h>
 #include <sys/mman.h> // For mlockall
 
 #include "dataHandler/dataHandler.h"
 #include "devices/EEG/eeg_bridge/eeg_bridge.h"
+#include "math/fftPlanCache.h"
 
 #include "UI/mainwindow/mainwindow.h"
 #include <QApplication>
@@ -30,6 +32,7 @@ void signal_handler(int signal) {
 Q_DECLARE_METATYPE(Eigen::MatrixXd)
 Q_DECLARE_METATYPE(Eigen::VectorXi)
 Q_DECLARE_METATYPE(Eigen::VectorXd)
+Q_DECLARE_METATYPE(VectorXi64)
 
 int main(int argc, char *argv[])
 {
@@ -50,16 +53,30 @@ int main(int argc, char *argv[])
     }
 
     dataHandler handler;
+    // The signal viewer copies whole channels of the ring, which the tiled layout keeps contiguous (benchmarks/ring_layout_benchmark.cpp)
+    handler.setRingLayout(RING_LAYOUT_TILED);
+
+    // Measured FFT plans of earlier sessions, EEG_FFTW_PLANNING=estimate|measure|patient (math/fftPlanCache.h)
+    const char *fftw_wisdom = std::getenv("EEG_FFTW_WISDOM");
+    std::string wisdom_file = fftw_wisdom ? fftw_wisdom : "fftw_wisdom";
+    if (const char *planning = std::getenv("EEG_FFTW_PLANNING")) {
+        FFTPlanningEffort effort;
+        if (parseFFTPlanningEffort(planning, effort)) setFFTPlanningEffort(effort);
+        else std::cerr << "Unknown EEG_FFTW_PLANNING " << planning << ", expected estimate, measure or patient" << std::endl;
+    }
+    if (!wisdom_file.empty()) loadFFTWisdom(wisdom_file);
 
     QApplication a(argc, argv);
     qRegisterMetaType<Eigen::MatrixXd>("Eigen::MatrixXd");
     qRegisterMetaType<Eigen::VectorXi>("Eigen::VectorXi");
     qRegisterMetaType<Eigen::VectorXd>("Eigen::VectorXd");
+    qRegisterMetaType<VectorXi64>("VectorXi64");
     
     // Connect application quit signal
     QObject::connect(&a, &QApplication::aboutToQuit, [&]() {
         signal_received = 1;
         QThread::msleep(100);  // Give threads time to clean up
+        if (!wisdom_file.empty()) saveFFTWisdom(wisdom_file);
     });
     
     MainWindow w(handler, signal_received);
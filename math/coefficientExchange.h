@@ -0,0 +1,53 @@
+#ifndef COEFFICIENTEXCHANGE_H
+#define COEFFICIENTEXCHANGE_H
+
+#include <atomic>
+#include <thread>
+#include <utility>
+
+/*
+Hands a new coefficient set from a control thread (GUI, config) to a processing thread without locking the
+processing thread. publish() copies the value into the pending slot, take() swaps the pending slot with the caller's
+active value. For Eigen vectors the swap exchanges the data pointers, so the processing thread never allocates and
+the previous coefficients are released by the next publish().
+
+Only publish() waits: while take() is swapping the two slots, or while another publish() is copying.
+*/
+template <typename T>
+class coefficientExchange {
+public:
+    void publish(const T &value) {
+        int state = state_.load(std::memory_order_relaxed);
+        for (;;) {
+            if (state == EXCHANGE_WRITING || state == EXCHANGE_READING) {
+                std::this_thread::yield();
+                state = state_.load(std::memory_order_relaxed);
+            } else if (state_.compare_exchange_weak(state, EXCHANGE_WRITING, std::memory_order_acquire)) {
+                break;
+            }
+        }
+        pending = value;
+        state_.store(EXCHANGE_READY, std::memory_order_release);
+    }
+
+    // Swaps in the newest published value. Returns false, without touching active, if nothing new is pending.
+    bool take(T &active) {
+        if (state_.load(std::memory_order_relaxed) != EXCHANGE_READY) return false;
+        int expected = EXCHANGE_READY;
+        if (!state_.compare_exchange_strong(expected, EXCHANGE_READING, std::memory_order_acquire)) return false;
+        using std::swap;
+        swap(active, pending);
+        state_.store(EXCHANGE_EMPTY, std::memory_order_release);
+        return true;
+    }
+
+    bool isPending() const { return state_.load(std::memory_order_relaxed) == EXCHANGE_READY; }
+
+private:
+    enum { EXCHANGE_EMPTY, EXCHANGE_WRITING, EXCHANGE_READY, EXCHANGE_READING };
+
+    std::atomic<int> state_{EXCHANGE_EMPTY};
+    T pending;
+};
+
+#endif // COEFFICIENTEXCHANGE_H
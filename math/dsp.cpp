@@ -1,4 +1,5 @@
 #include "dsp.h"
+#include <algorithm>
 
 // Function to compute autocorrelations up to a given lag
 Eigen::VectorXd computeAutocorrelation(const Eigen::VectorXd& data, int maxLag, const std::string& norm) {
@@ -48,29 +49,26 @@ std::tuple<Eigen::VectorXd, double, Eigen::VectorXd> aryule(const Eigen::VectorX
     return std::make_tuple(arParams, sigma2, k);
 }
 
-// Perform FFT using FFTW
+// Perform FFT using FFTW, through the cached plan and the buffers of the calling thread (fftPlanCache.h)
 std::vector<std::complex<double>> performFFT(const std::vector<double>& data) {
     int N = data.size();
     std::vector<std::complex<double>> out(N);
-    fftw_complex *in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    fftw_complex *out_fftw = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
+    if (N == 0) return out;
+    fftWorkspace *workspace = getFFTWorkspace(N, FFT_PLAN_FORWARD);
+    if (!workspace) return out;
+    fftWorkspace &fft = *workspace;
 
     for (int i = 0; i < N; ++i) {
-        in[i][0] = data[i];
-        in[i][1] = 0;
+        fft.in[i][0] = data[i];
+        fft.in[i][1] = 0;
     }
 
-    fftw_plan plan = fftw_plan_dft_1d(N, in, out_fftw, FFTW_FORWARD, FFTW_ESTIMATE);
-    fftw_execute(plan);
-    fftw_destroy_plan(plan);
+    fft.execute();
 
     for (int i = 0; i < N; ++i) {
-        out[i] = std::complex<double>(out_fftw[i][0], out_fftw[i][1]);
+        out[i] = std::complex<double>(fft.out[i][0], fft.out[i][1]);
     }
 
-    fftw_free(in);
-    fftw_free(out_fftw);
-
     return out;
 }
 
@@ -78,25 +76,22 @@ std::vector<std::complex<double>> performFFT(const std::vector<double>& data) {
 std::vector<std::complex<double>> performFFT(const Eigen::VectorXd& data) {
     int N = data.size();
     std::vector<std::complex<double>> out(N);
-    fftw_complex *in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    fftw_complex *out_fftw = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
+    if (N == 0) return out;
+    fftWorkspace *workspace = getFFTWorkspace(N, FFT_PLAN_FORWARD);
+    if (!workspace) return out;
+    fftWorkspace &fft = *workspace;
 
     for (int i = 0; i < N; ++i) {
-        in[i][0] = data(i);
-        in[i][1] = 0;
+        fft.in[i][0] = data(i);
+        fft.in[i][1] = 0;
     }
 
-    fftw_plan plan = fftw_plan_dft_1d(N, in, out_fftw, FFTW_FORWARD, FFTW_ESTIMATE);
-    fftw_execute(plan);
-    fftw_destroy_plan(plan);
+    fft.execute();
 
     for (int i = 0; i < N; ++i) {
-        out[i] = std::complex<double>(out_fftw[i][0], out_fftw[i][1]);
+        out[i] = std::complex<double>(fft.out[i][0], fft.out[i][1]);
     }
 
-    fftw_free(in);
-    fftw_free(out_fftw);
-    
     return out;
 }   
 
@@ -104,72 +99,89 @@ std::vector<std::complex<double>> performFFT(const Eigen::VectorXd& data) {
 std::vector<std::complex<double>> performIFFT(const std::vector<std::complex<double>>& data) {
     int N = data.size();
     std::vector<std::complex<double>> out(N);
-    fftw_complex *in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    fftw_complex *out_fftw = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
+    if (N == 0) return out;
+    fftWorkspace *workspace = getFFTWorkspace(N, FFT_PLAN_BACKWARD);
+    if (!workspace) return out;
+    fftWorkspace &fft = *workspace;
 
     for (int i = 0; i < N; ++i) {
-        in[i][0] = data[i].real();
-        in[i][1] = data[i].imag();
+        fft.in[i][0] = data[i].real();
+        fft.in[i][1] = data[i].imag();
     }
 
-    fftw_plan plan = fftw_plan_dft_1d(N, in, out_fftw, FFTW_BACKWARD, FFTW_ESTIMATE);
-    fftw_execute(plan);
-    fftw_destroy_plan(plan);
+    fft.execute();
 
     for (int i = 0; i < N; ++i) {
-        out[i] = std::complex<double>(out_fftw[i][0] / N, out_fftw[i][1] / N); // Normalize by N
+        out[i] = std::complex<double>(fft.out[i][0] / N, fft.out[i][1] / N); // Normalize by N
     }
 
-    fftw_free(in);
-    fftw_free(out_fftw);
-
     return out;
 }
 
-// Apply the Hilbert transform
-std::vector<std::complex<double>> hilbertTransform(const std::vector<double>& signal) {
-    size_t N = signal.size();
-    auto fft_signal = performFFT(signal);
-
-    // Apply the Hilbert transform in the frequency domain
-    fft_signal[0] = 0; // DC component zeroed
-    for (size_t k = 1; k < N / 2; ++k) {
-        fft_signal[k] *= 2;
+/*
+Analytic signal with the DC and Nyquist components removed, x - mean - Nyquist + i H(x). The real FFT gives the
+positive frequencies X(1) ... X(ceil(N / 2) - 1). The real part is the input minus X(0) and X(N / 2). The imaginary
+part is the real inverse FFT of -i X(k) over the same bins, so the transforms cost about half of a complex FFT and
+IFFT of the signal. The FFTs run in the thread's workspaces and nothing is allocated once they exist.
+*/
+void analyticSignal(const double *signal, int N, std::complex<double> *analytic) {
+    if (N <= 0) return;
+    fftWorkspace *forward_workspace = getFFTWorkspace(N, FFT_PLAN_R2C);
+    fftWorkspace *inverse_workspace = getFFTWorkspace(N, FFT_PLAN_C2R);
+    if (!forward_workspace || !inverse_workspace) {
+        std::fill(analytic, analytic + N, std::complex<double>(0.0, 0.0));
+        return;
+    }
+    fftWorkspace &forward = *forward_workspace;
+    fftWorkspace &inverse = *inverse_workspace;
+
+    std::copy(signal, signal + N, forward.real);
+    forward.execute();
+
+    int bins = N / 2 + 1;
+    inverse.in[0][0] = 0;
+    inverse.in[0][1] = 0;
+    for (int k = 1; k < bins; ++k) {
+        inverse.in[k][0] = forward.out[k][1];
+        inverse.in[k][1] = -forward.out[k][0];
     }
-
     if (N % 2 == 0) {
-        fft_signal[N / 2] = 0; // Nyquist frequency zeroed if needed
+        inverse.in[N / 2][0] = 0;
+        inverse.in[N / 2][1] = 0;
     }
+    inverse.execute();
 
-    for (size_t k = N / 2 + 1; k < N; ++k) {
-        fft_signal[k] = 0; // Zero the negative frequencies
+    double mean = forward.out[0][0] / N;
+    double nyquist = N % 2 == 0 ? forward.out[N / 2][0] / N : 0.0;
+    for (int n = 0; n < N; ++n) {
+        double removed = mean + (n % 2 == 0 ? nyquist : -nyquist);
+        analytic[n] = std::complex<double>(signal[n] - removed, inverse.real[n] / N);
     }
+}
 
-    // Perform inverse FFT
-    return performIFFT(fft_signal);
+// Apply the Hilbert transform
+std::vector<std::complex<double>> hilbertTransform(const std::vector<double>& signal) {
+    std::vector<std::complex<double>> analytic(signal.size());
+    analyticSignal(signal.data(), signal.size(), analytic.data());
+    return analytic;
 }
 
 // Eigen version of the Hilbert transform
 std::vector<std::complex<double>> hilbertTransform(const Eigen::VectorXd& signal) {
-    size_t N = signal.size();
-    auto fft_signal = performFFT(signal);
-
-    // Apply the Hilbert transform in the frequency domain
-    fft_signal[0] = 0; // DC component zeroed
-    for (size_t k = 1; k < N / 2; ++k) {
-        fft_signal[k] *= 2;
-    }
-
-    if (N % 2 == 0) {
-        fft_signal[N / 2] = 0; // Nyquist frequency zeroed if needed
-    }
+    std::vector<std::complex<double>> analytic(signal.size());
+    analyticSignal(signal.data(), signal.size(), analytic.data());
+    return analytic;
+}
 
-    for (size_t k = N / 2 + 1; k < N; ++k) {
-        fft_signal[k] = 0; // Zero the negative frequencies
-    }
+// Hilbert transform into the caller's vector, which is only reallocated if it is smaller than the signal
+void hilbertTransform(const std::vector<double>& signal, std::vector<std::complex<double>>& analytic) {
+    analytic.resize(signal.size());
+    analyticSignal(signal.data(), signal.size(), analytic.data());
+}
 
-    // Perform inverse FFT
-    return performIFFT(fft_signal);
+void hilbertTransform(const Eigen::VectorXd& signal, std::vector<std::complex<double>>& analytic) {
+    analytic.resize(signal.size());
+    analyticSignal(signal.data(), signal.size(), analytic.data());
 }
 
 Eigen::VectorXd hamming(unsigned int N) {
@@ -185,47 +197,41 @@ Eigen::VectorXd hamming(unsigned int N) {
 Eigen::VectorXcd spectrum(const Eigen::VectorXd& x, const Eigen::VectorXd& W) {
     int N = x.size();
     Eigen::VectorXcd Pxx(N);
-
-    fftw_complex *in, *out;
-    fftw_plan p;
-
-    in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    p = fftw_plan_dft_1d(N, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+    if (N == 0) return Pxx;
+    fftWorkspace *workspace = getFFTWorkspace(N, FFT_PLAN_FORWARD);
+    if (!workspace) return Eigen::VectorXcd::Zero(N);
+    fftWorkspace &fft = *workspace;
 
     for (int i = 0; i < N; ++i) {
-        in[i][0] = x(i) * W(i); // Real part
-        in[i][1] = 0;           // Imaginary part
+        fft.in[i][0] = x(i) * W(i); // Real part
+        fft.in[i][1] = 0;           // Imaginary part
     }
 
-    fftw_execute(p);
+    fft.execute();
 
     double wc = W.sum();
     for (int i = 0; i < N; ++i) {
-        Pxx(i) = std::complex<double>(out[i][0], out[i][1]) / wc;
+        Pxx(i) = std::complex<double>(fft.out[i][0], fft.out[i][1]) / wc;
     }
 
-    fftw_destroy_plan(p);
-    fftw_free(in);
-    fftw_free(out);
-
     return Pxx;
 }
 
 
 Eigen::MatrixXcd specgram_cx(const Eigen::VectorXd& x, unsigned int Nfft, unsigned int Noverl) {
     int N = x.size();
-    int D = Nfft - Noverl;
-    int U = std::max(1, static_cast<int>((N - Nfft) / D + 1)); // Calculate number of columns
+    int L = static_cast<int>(Nfft);
+    int D = L - static_cast<int>(Noverl);
+    int U = std::max(1, (N - L) / D + 1); // Calculate number of columns
     Eigen::MatrixXcd Pw(Nfft, U);
     Eigen::VectorXd W = hamming(Nfft);
 
-    for (int k = 0, m = 0; k <= N - Nfft; k += D, ++m) {
-        Eigen::VectorXd xk = x.segment(k, Nfft);
+    for (int k = 0, m = 0; k <= N - L; k += D, ++m) {
+        Eigen::VectorXd xk = x.segment(k, L);
         Pw.col(m) = spectrum(xk, W);
     }
 
-    if (N <= Nfft) {
+    if (N <= L) {
         Eigen::VectorXd W = hamming(N);
         Pw.resize(N, 1);
         Pw.col(0) = spectrum(x, W);
@@ -289,9 +295,7 @@ std::tuple<Eigen::VectorXd, Eigen::VectorXd> computePSD(
 }
 
 // C++ version of the SNR calculation
-double calculateSNR_max(const Eigen::VectorXd& data, int overlap, int nfft, double fs, double target_freq, double bandwidth, Eigen::VectorXd& Pxx_output) {
-    // Eigen::VectorXd psd = pwelch(data.array(), nfft, overlap);
-
+double calculateSNR_max(const Eigen::VectorXd& data, int nfft, double fs, double target_freq, double bandwidth, Eigen::VectorXd& Pxx_output) {
     // Estimate AR coefficients and noise variance
     auto [arParams, noiseVariance, reflectionCoeffs] = aryule(data, 200, "biased", false);
 
@@ -0,0 +1,154 @@
+#include "fftConvolution.h"
+#include <algorithm>
+#include <cmath>
+
+// Cost of one r2c or c2r transform of size N in multiply-adds of the direct form, FFT_CONVOLUTION_COST * N log2 N.
+// FFTW needs about 0.6, the margin keeps borderline cases on the direct form. Check with fft_convolution_benchmark.
+#define FFT_CONVOLUTION_COST 1.0
+
+static int nextPowerOfTwo(int n) {
+    int power = 1;
+    while (power < n) power *= 2;
+    return power;
+}
+
+overlapSaveFilter::~overlapSaveFilter() {
+    release();
+}
+
+void overlapSaveFilter::release() {
+    fftw_free(time);
+    fftw_free(spectrum);
+    fftw_free(response);
+    forward = backward = nullptr;
+    time = nullptr;
+    spectrum = response = nullptr;
+}
+
+double overlapSaveFilter::operationsPerOutput(int taps, int fft_size) {
+    int block_length = fft_size - taps + 1;
+    if (block_length <= 0) return 1e30;
+    // Two transforms and the product of the spectra
+    double block = 2 * FFT_CONVOLUTION_COST * fft_size * std::log2(static_cast<double>(fft_size)) + 2 * fft_size;
+    return block / block_length;
+}
+
+int overlapSaveFilter::chooseFFTSize(int taps) {
+    int best = nextPowerOfTwo(2 * std::max(1, taps));
+    for (int size = best * 2; size <= (1 << 20); size *= 2) {
+        if (operationsPerOutput(taps, size) < operationsPerOutput(taps, best)) best = size;
+    }
+    return best;
+}
+
+bool overlapSaveFilter::reset(const Eigen::VectorXd &coefficients_in, int fft_size_in) {
+    coefficients = coefficients_in;
+    int taps = std::max<int>(1, coefficients.size());
+    int size = fft_size_in > 0 ? std::max(nextPowerOfTwo(fft_size_in), nextPowerOfTwo(2 * taps)) : chooseFFTSize(taps);
+
+    // Plans and buffers are kept while the size stays the same
+    if (size != fft_size || !forward) {
+        release();
+        fft_size = size;
+        int bins = fft_size / 2 + 1;
+        time = static_cast<double *>(fftw_malloc(sizeof(double) * fft_size));
+        spectrum = static_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * bins));
+        response = static_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * bins));
+        forward = getFFTPlan(fft_size, FFT_PLAN_R2C);
+        backward = getFFTPlan(fft_size, FFT_PLAN_C2R);
+        if (!forward || !backward) {
+            release();
+            fft_size = 0;
+            return false;
+        }
+    }
+
+    std::fill(time, time + fft_size, 0.0);
+    std::copy(coefficients.data(), coefficients.data() + coefficients.size(), time);
+    fftw_execute_dft_r2c(forward, time, spectrum);
+    for (int k = 0; k <= fft_size / 2; k++) {
+        response[k][0] = spectrum[k][0] / fft_size;
+        response[k][1] = spectrum[k][1] / fft_size;
+    }
+    return true;
+}
+
+/*
+Overlap-save: a block of fft_size inputs ending at output index s + L - 1 is transformed, multiplied with the response
+and transformed back. The first taps - 1 results wrap around and are discarded, the remaining L are outputs s ... s + L - 1.
+*/
+void overlapSaveFilter::filter(const Eigen::Ref<const Eigen::VectorXd> &input, int first, Eigen::Ref<Eigen::VectorXd> output) {
+    if (!forward) {
+        directFIR(input, coefficients, first, output);
+        return;
+    }
+
+    int n = input.size();
+    int taps = coefficients.size();
+    int block_length = getBlockLength();
+    int count = output.size();
+
+    for (int done = 0; done < count; done += block_length) {
+        int start = first + done - (taps - 1);      // Input index of time[0]
+        int from = std::max(0, -start), to = std::min(fft_size, n - start);
+        std::fill(time, time + fft_size, 0.0);
+        if (from < to) std::copy(input.data() + start + from, input.data() + start + to, time + from);
+
+        fftw_execute_dft_r2c(forward, time, spectrum);
+        for (int k = 0; k <= fft_size / 2; k++) {
+            double re = spectrum[k][0] * response[k][0] - spectrum[k][1] * response[k][1];
+            double im = spectrum[k][0] * response[k][1] + spectrum[k][1] * response[k][0];
+            spectrum[k][0] = re;
+            spectrum[k][1] = im;
+        }
+        fftw_execute_dft_c2r(backward, spectrum, time);
+
+        int outputs = std::min(block_length, count - done);
+        std::copy(time + taps - 1, time + taps - 1 + outputs, output.data() + done);
+    }
+}
+
+void directFIR(const Eigen::Ref<const Eigen::VectorXd> &input, const Eigen::VectorXd &coefficients, int first, Eigen::Ref<Eigen::VectorXd> output) {
+    int n = input.size();
+    int taps = coefficients.size();
+    for (int r = 0; r < output.size(); r++) {
+        int i = first + r;
+        // Taps j with 0 <= i - j < n
+        int j0 = std::max(0, i - n + 1), j1 = std::min(taps - 1, i);
+        int length = j1 - j0 + 1;
+        output(r) = length > 0 ? coefficients.segment(j0, length).dot(input.segment(i - j1, length).reverse()) : 0.0;
+    }
+}
+
+void convolveFIR(const Eigen::Ref<const Eigen::VectorXd> &input, const Eigen::VectorXd &coefficients, int first, Eigen::Ref<Eigen::VectorXd> output) {
+    int taps = coefficients.size();
+    int count = output.size();
+    if (taps < FFT_CONVOLUTION_MIN_TAPS || count < FFT_CONVOLUTION_MIN_OUTPUTS) {
+        directFIR(input, coefficients, first, output);
+        return;
+    }
+
+    // Multiply-adds of the direct form, only the taps that reach into the input count
+    int n = input.size();
+    double direct_operations = 0;
+    for (int i = first; i < first + count; i++) direct_operations += std::max(0, std::min(taps - 1, i) - std::max(0, i - n + 1) + 1);
+
+    // A block longer than the whole range does not pay off
+    int fft_size = std::max(std::min(overlapSaveFilter::chooseFFTSize(taps), nextPowerOfTwo(count + taps - 1)), nextPowerOfTwo(2 * taps));
+    int blocks = (count + fft_size - taps) / (fft_size - taps + 1);
+    double fft_operations = blocks * overlapSaveFilter::operationsPerOutput(taps, fft_size) * (fft_size - taps + 1);
+    if (fft_operations >= direct_operations) {
+        directFIR(input, coefficients, first, output);
+        return;
+    }
+
+    static thread_local overlapSaveFilter filter;
+    const Eigen::VectorXd &cached = filter.getCoefficients();
+    if (filter.getFFTSize() != fft_size || cached.size() != taps || cached != coefficients) {
+        if (!filter.reset(coefficients, fft_size)) {
+            directFIR(input, coefficients, first, output);
+            return;
+        }
+    }
+    filter.filter(input, first, output);
+}
@@ -0,0 +1,63 @@
+#ifndef FFTCONVOLUTION_H
+#define FFTCONVOLUTION_H
+
+#include <Eigen/Dense>
+#include <fftw3.h>
+#include "fftPlanCache.h"
+
+/*
+FIR filtering of a finite signal, y(i) = sum_j h(j) x(i - j) with x = 0 outside of the signal, for any range of output
+indices 0 ... n + taps - 2. Short filters and short ranges are computed directly, long ones by overlap-save FFT
+convolution; convolveFIR picks the cheaper one from an operation count.
+
+overlapSaveFilter keeps the FFT of the coefficients and the buffers between calls, the plans come from the plan cache
+(fftPlanCache.h). An instance is not thread-safe, convolveFIR keeps one per thread for the last coefficients it was given.
+*/
+
+// Below these sizes the direct convolution is always used
+#define FFT_CONVOLUTION_MIN_TAPS 32
+#define FFT_CONVOLUTION_MIN_OUTPUTS 128
+
+class overlapSaveFilter {
+public:
+    overlapSaveFilter() { }
+    ~overlapSaveFilter();
+    overlapSaveFilter(const overlapSaveFilter&) = delete;
+    overlapSaveFilter& operator=(const overlapSaveFilter&) = delete;
+
+    // Transforms the coefficients for blocks of fft_size (a power of two of at least 2 * taps, 0 = chosen from the taps).
+    // Returns false if FFTW could not plan the size, filter then uses the direct form.
+    bool reset(const Eigen::VectorXd &coefficients, int fft_size = 0);
+
+    // Outputs first ... first + output.size() - 1 of the filtered input
+    void filter(const Eigen::Ref<const Eigen::VectorXd> &input, int first, Eigen::Ref<Eigen::VectorXd> output);
+
+    const Eigen::VectorXd &getCoefficients() const { return coefficients; }
+    int getFFTSize() const { return fft_size; }
+    // Outputs per block
+    int getBlockLength() const { return fft_size - coefficients.size() + 1; }
+
+    // FFT size for the taps that minimizes the operations per output
+    static int chooseFFTSize(int taps);
+    // Operations per output of a block of fft_size, comparable to the multiply-adds per output of the direct form
+    static double operationsPerOutput(int taps, int fft_size);
+
+private:
+    void release();
+
+    Eigen::VectorXd coefficients;
+    int fft_size = 0;
+    double *time = nullptr;                 // fft_size samples
+    fftw_complex *spectrum = nullptr;       // fft_size / 2 + 1 bins
+    fftw_complex *response = nullptr;       // FFT of the coefficients, scaled by 1 / fft_size
+    fftw_plan forward = nullptr;            // Owned by the plan cache
+    fftw_plan backward = nullptr;
+};
+
+// Direct convolution of the same range
+void directFIR(const Eigen::Ref<const Eigen::VectorXd> &input, const Eigen::VectorXd &coefficients, int first, Eigen::Ref<Eigen::VectorXd> output);
+
+// Direct or overlap-save, whichever needs fewer operations for the taps and the number of outputs
+void convolveFIR(const Eigen::Ref<const Eigen::VectorXd> &input, const Eigen::VectorXd &coefficients, int first, Eigen::Ref<Eigen::VectorXd> output);
+
+#endif // FFTCONVOLUTION_H
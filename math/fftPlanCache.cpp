@@ -0,0 +1,132 @@
+#include "fftPlanCache.h"
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Guards the FFTW planner, the plan map and the wisdom
+static std::mutex planner_mutex;
+static std::map<std::pair<int, int>, fftw_plan> plans;
+static std::atomic<int> planning_effort{FFT_PLANNING_MEASURE};
+
+static unsigned plannerFlags() {
+    switch (planning_effort.load(std::memory_order_relaxed)) {
+    case FFT_PLANNING_ESTIMATE: return FFTW_ESTIMATE;
+    case FFT_PLANNING_PATIENT: return FFTW_PATIENT;
+    default: return FFTW_MEASURE;
+    }
+}
+
+fftWorkspace::fftWorkspace(int size_in, FFTPlanKind kind_in, fftw_plan plan_in)
+    : size(size_in), kind(kind_in), plan(plan_in)
+{
+    int bins = kind == FFT_PLAN_R2C || kind == FFT_PLAN_C2R ? size / 2 + 1 : size;
+    if (kind == FFT_PLAN_R2C || kind == FFT_PLAN_C2R) real = static_cast<double *>(fftw_malloc(sizeof(double) * size));
+    if (kind != FFT_PLAN_R2C) in = static_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * bins));
+    if (kind != FFT_PLAN_C2R) out = static_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * bins));
+}
+
+fftWorkspace::~fftWorkspace() {
+    fftw_free(real);
+    fftw_free(in);
+    fftw_free(out);
+}
+
+void fftWorkspace::execute() {
+    switch (kind) {
+    case FFT_PLAN_FORWARD:
+    case FFT_PLAN_BACKWARD:
+        fftw_execute_dft(plan, in, out);
+        break;
+    case FFT_PLAN_R2C:
+        fftw_execute_dft_r2c(plan, real, out);
+        break;
+    case FFT_PLAN_C2R:
+        fftw_execute_dft_c2r(plan, in, real);
+        break;
+    }
+}
+
+/*
+Measuring plans overwrite their arrays, so the plans are made on scratch arrays of the cache. fftw_malloc gives the
+workspaces the same alignment, which is what the new-array execute functions require.
+*/
+fftw_plan getFFTPlan(int size, FFTPlanKind kind) {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    auto found = plans.find(std::make_pair(size, static_cast<int>(kind)));
+    if (found != plans.end()) return found->second;
+
+    int bins = kind == FFT_PLAN_R2C || kind == FFT_PLAN_C2R ? size / 2 + 1 : size;
+    double *real = static_cast<double *>(fftw_malloc(sizeof(double) * size));
+    fftw_complex *in = static_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * bins));
+    fftw_complex *out = static_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * bins));
+
+    unsigned flags = plannerFlags();
+    fftw_plan plan = nullptr;
+    switch (kind) {
+    case FFT_PLAN_FORWARD: plan = fftw_plan_dft_1d(size, in, out, FFTW_FORWARD, flags); break;
+    case FFT_PLAN_BACKWARD: plan = fftw_plan_dft_1d(size, in, out, FFTW_BACKWARD, flags); break;
+    case FFT_PLAN_R2C: plan = fftw_plan_dft_r2c_1d(size, real, out, flags); break;
+    case FFT_PLAN_C2R: plan = fftw_plan_dft_c2r_1d(size, in, real, flags); break;
+    }
+
+    fftw_free(real);
+    fftw_free(in);
+    fftw_free(out);
+    if (!plan) {
+        std::cerr << "FFTW failed to plan a transform of size " << size << '\n';
+        return nullptr;
+    }
+    plans.emplace(std::make_pair(size, static_cast<int>(kind)), plan);
+    return plan;
+}
+
+fftWorkspace *getFFTWorkspace(int size, FFTPlanKind kind) {
+    static thread_local std::map<std::pair<int, int>, std::unique_ptr<fftWorkspace>> workspaces;
+    std::pair<int, int> key(size, static_cast<int>(kind));
+    auto found = workspaces.find(key);
+    if (found != workspaces.end()) return found->second.get();
+
+    fftw_plan plan = getFFTPlan(size, kind);
+    if (!plan) return nullptr;
+    fftWorkspace *workspace = new fftWorkspace(size, kind, plan);
+    workspaces.emplace(key, std::unique_ptr<fftWorkspace>(workspace));
+    return workspace;
+}
+
+void setFFTPlanningEffort(FFTPlanningEffort effort) {
+    planning_effort.store(effort, std::memory_order_relaxed);
+}
+
+FFTPlanningEffort getFFTPlanningEffort() {
+    return static_cast<FFTPlanningEffort>(planning_effort.load(std::memory_order_relaxed));
+}
+
+bool parseFFTPlanningEffort(const std::string &name, FFTPlanningEffort &effort) {
+    if (name == "estimate") effort = FFT_PLANNING_ESTIMATE;
+    else if (name == "measure") effort = FFT_PLANNING_MEASURE;
+    else if (name == "patient") effort = FFT_PLANNING_PATIENT;
+    else return false;
+    return true;
+}
+
+bool loadFFTWisdom(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    if (!fftw_import_wisdom_from_filename(filename.c_str())) {
+        std::cout << "No FFTW wisdom loaded from " << filename << ", plans are measured on first use" << '\n';
+        return false;
+    }
+    std::cout << "FFTW wisdom loaded from " << filename << '\n';
+    return true;
+}
+
+bool saveFFTWisdom(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    if (!fftw_export_wisdom_to_filename(filename.c_str())) {
+        std::cerr << "Failed to save FFTW wisdom to " << filename << '\n';
+        return false;
+    }
+    return true;
+}
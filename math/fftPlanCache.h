@@ -0,0 +1,63 @@
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+
+#include <fftw3.h>
+#include <string>
+
+/*
+FFTW plans shared by the whole process and created once per (size, kind). Planning is serialized, because the FFTW
+planner is not thread-safe, while executing a plan on other arrays with the same alignment is. Every thread therefore
+gets its own fftw_malloc'd buffers for a plan (fftWorkspace), and the transforms on the processing threads never
+plan, allocate or lock once the workspace exists.
+
+Plans are created with FFTW_MEASURE by default and with the wisdom loaded by loadFFTWisdom, so the planning cost of
+the measured plans is paid once per machine when the wisdom is saved at exit.
+*/
+
+enum FFTPlanKind {
+    FFT_PLAN_FORWARD = 0,       // Complex to complex, e^(-i...)
+    FFT_PLAN_BACKWARD = 1,      // Complex to complex, e^(+i...), unnormalized
+    FFT_PLAN_R2C = 2,           // Real input, size / 2 + 1 bins
+    FFT_PLAN_C2R = 3            // size / 2 + 1 bins to real, unnormalized, overwrites the input bins
+};
+
+enum FFTPlanningEffort {
+    FFT_PLANNING_ESTIMATE = 0,
+    FFT_PLANNING_MEASURE = 1,
+    FFT_PLANNING_PATIENT = 2
+};
+
+// The calling thread's buffers for one cached plan
+struct fftWorkspace {
+    int size = 0;
+    FFTPlanKind kind = FFT_PLAN_FORWARD;
+    fftw_plan plan = nullptr;       // Owned by the cache
+    double *real = nullptr;         // R2C input, C2R output, size values
+    fftw_complex *in = nullptr;     // FORWARD and BACKWARD input (size bins), C2R input (size / 2 + 1 bins)
+    fftw_complex *out = nullptr;    // FORWARD and BACKWARD output (size bins), R2C output (size / 2 + 1 bins)
+
+    fftWorkspace(int size, FFTPlanKind kind, fftw_plan plan);
+    ~fftWorkspace();
+    fftWorkspace(const fftWorkspace&) = delete;
+    fftWorkspace& operator=(const fftWorkspace&) = delete;
+
+    void execute();
+};
+
+// The plan for the size and kind, planned on the first request. Thread-safe. nullptr if FFTW could not plan it.
+fftw_plan getFFTPlan(int size, FFTPlanKind kind);
+
+// The plan with the calling thread's buffers, kept until the thread exits. nullptr if the plan failed, the next
+// request plans again.
+fftWorkspace *getFFTWorkspace(int size, FFTPlanKind kind);
+
+// Effort of the plans created after the call
+void setFFTPlanningEffort(FFTPlanningEffort effort);
+FFTPlanningEffort getFFTPlanningEffort();
+bool parseFFTPlanningEffort(const std::string &name, FFTPlanningEffort &effort);   // estimate, measure or patient
+
+// FFTW wisdom file. Load before the first plan, save at exit to reuse the measured plans in the next session.
+bool loadFFTWisdom(const std::string &filename);
+bool saveFFTWisdom(const std::string &filename);
+
+#endif // FFTPLANCACHE_H
@@ -0,0 +1,275 @@
+#include "filterDesign.h"
+#include "dsp.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <list>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// Checks the band and rounds the edges to lowpass (low = 0) and highpass (high = fs / 2)
+static bool checkBand(double fs, double &low, double &high) {
+    if (!(fs > 0)) {
+        std::cerr << "Filter design: invalid sampling rate " << fs << '\n';
+        return false;
+    }
+    low = std::max(0.0, low);
+    high = std::min(high, fs / 2);
+    if (!(low < high) || (low == 0 && high == fs / 2)) {
+        std::cerr << "Filter design: invalid band " << low << "-" << high << " Hz at " << fs << " Hz" << '\n';
+        return false;
+    }
+    return true;
+}
+
+// Integral of cos(m * w) over [w1, w2]
+static double cosineIntegral(int m, double w1, double w2) {
+    if (m == 0) return w2 - w1;
+    return (std::sin(m * w2) - std::sin(m * w1)) / m;
+}
+
+/*
+Type I linear-phase FIR with the smallest squared error to the ideal response over the pass and stop bands. With
+L = (taps - 1) / 2 the amplitude response is A(w) = a0 + sum a_k cos(k w), and the error is a quadratic form in a whose
+normal equations have closed-form entries.
+*/
+bool designLSFIR(double fs, double low, double high, int taps, double transition, Eigen::VectorXd& coeffs) {
+    if (!checkBand(fs, low, high)) return false;
+    if (taps < 3) {
+        std::cerr << "Filter design: an LS FIR needs at least 3 taps, got " << taps << '\n';
+        return false;
+    }
+    taps |= 1;
+    int L = (taps - 1) / 2;
+
+    if (!(transition > 0)) transition = std::min(std::max((high - low) / 4, fs / taps), 2 * fs / taps);
+
+    // Bands in radians per sample with the desired amplitude. A transition wider than the room next to the pass
+    // band is narrowed so that a stop band remains.
+    double to_radians = 2 * M_PI / fs;
+    std::vector<std::tuple<double, double, double>> bands;
+    if (low > 0) bands.emplace_back(0, std::max(low - transition, low / 2) * to_radians, 0);
+    bands.emplace_back(low * to_radians, high * to_radians, 1);
+    if (high < fs / 2) bands.emplace_back(std::min(high + transition, (high + fs / 2) / 2) * to_radians, M_PI, 0);
+
+    Eigen::MatrixXd Q = Eigen::MatrixXd::Zero(L + 1, L + 1);
+    Eigen::VectorXd d = Eigen::VectorXd::Zero(L + 1);
+    for (const auto &band : bands) {
+        double w1 = std::get<0>(band), w2 = std::get<1>(band), desired = std::get<2>(band);
+        for (int k = 0; k <= L; k++) {
+            for (int l = k; l <= L; l++) {
+                Q(k, l) += 0.5 * (cosineIntegral(k - l, w1, w2) + cosineIntegral(k + l, w1, w2));
+            }
+            d(k) += desired * cosineIntegral(k, w1, w2);
+        }
+    }
+    Q.triangularView<Eigen::StrictlyLower>() = Q.transpose().triangularView<Eigen::StrictlyLower>();
+
+    Eigen::VectorXd a = Q.ldlt().solve(d);
+    if (!a.allFinite()) {
+        std::cerr << "Filter design: LS FIR normal equations are singular for " << low << "-" << high << " Hz" << '\n';
+        return false;
+    }
+
+    coeffs.resize(taps);
+    coeffs(L) = a(0);
+    for (int k = 1; k <= L; k++) {
+        coeffs(L - k) = a(k) / 2;
+        coeffs(L + k) = a(k) / 2;
+    }
+    return true;
+}
+
+bool designWindowedFIR(double fs, double low, double high, int taps, Eigen::VectorXd& coeffs) {
+    if (!checkBand(fs, low, high)) return false;
+    if (taps < 3) {
+        std::cerr << "Filter design: a windowed FIR needs at least 3 taps, got " << taps << '\n';
+        return false;
+    }
+    taps |= 1;
+    int L = (taps - 1) / 2;
+    double wl = 2 * M_PI * low / fs, wh = 2 * M_PI * high / fs;
+
+    // Ideal band of [wl, wh] shifted to the middle tap
+    Eigen::VectorXd window = hamming(taps);
+    coeffs.resize(taps);
+    for (int n = 0; n < taps; n++) {
+        int m = n - L;
+        double ideal = m == 0 ? (wh - wl) / M_PI : (std::sin(wh * m) - std::sin(wl * m)) / (M_PI * m);
+        coeffs(n) = ideal * window(n);
+    }
+    return true;
+}
+
+/*
+Analog Butterworth prototype transformed to the band (lowpass, highpass or bandpass) at prewarped edges, then mapped
+to the z-plane with the bilinear transform. Conjugate poles form the sections, real poles are paired up, and every
+section takes two of the zeros, which are all at z = 1 or z = -1.
+*/
+bool designButterworth(double fs, double low, double high, int order, Eigen::MatrixXd& sos) {
+    typedef std::complex<double> complex;
+    if (!checkBand(fs, low, high)) return false;
+    if (order < 1) {
+        std::cerr << "Filter design: invalid Butterworth order " << order << '\n';
+        return false;
+    }
+
+    double fs2 = 2 * fs;
+    double wl = fs2 * std::tan(M_PI * low / fs);
+    double wh = high < fs / 2 ? fs2 * std::tan(M_PI * high / fs) : 0;
+
+    std::vector<complex> prototype;
+    for (int k = 0; k < order; k++) prototype.push_back(std::exp(complex(0, M_PI * (2 * k + order + 1) / (2 * order))));
+
+    std::vector<complex> poles;
+    int zeros_at_dc = 0;        // The remaining zeros of the analog filter are at infinity, z = -1
+    double gain = 1;
+    if (low == 0) {
+        for (const complex &p : prototype) poles.push_back(p * wh);
+        gain = std::pow(wh, order);
+    } else if (high >= fs / 2) {
+        complex product = 1;
+        for (const complex &p : prototype) {
+            poles.push_back(wl / p);
+            product *= -p;
+        }
+        zeros_at_dc = order;
+        gain = 1 / product.real();
+    } else {
+        double bw = wh - wl, w0 = std::sqrt(wl * wh);
+        for (const complex &p : prototype) {
+            complex lp = p * bw / 2.0;
+            complex root = std::sqrt(lp * lp - w0 * w0);
+            poles.push_back(lp + root);
+            poles.push_back(lp - root);
+        }
+        zeros_at_dc = order;
+        gain = std::pow(bw, order);
+    }
+
+    // Bilinear transform: s = 0 maps to z = 1 and s = infinity to z = -1
+    complex gain_product = std::pow(complex(fs2), zeros_at_dc);
+    for (complex &p : poles) {
+        gain_product /= fs2 - p;
+        p = (fs2 + p) / (fs2 - p);
+    }
+    gain *= gain_product.real();
+
+    // Zeros alternate between z = 1 and z = -1 so that a bandpass section gets one of each
+    int zero_count = static_cast<int>(poles.size());
+    std::vector<double> zeros;
+    int at_dc = zeros_at_dc, at_nyquist = zero_count - zeros_at_dc;
+    while (at_dc > 0 || at_nyquist > 0) {
+        if (at_dc > 0) { zeros.push_back(1); at_dc--; }
+        if (at_nyquist > 0) { zeros.push_back(-1); at_nyquist--; }
+    }
+
+    std::vector<complex> upper;
+    std::vector<double> real;
+    for (const complex &p : poles) {
+        if (std::abs(p.imag()) < 1e-12 * std::max(1.0, std::abs(p))) real.push_back(p.real());
+        else if (p.imag() > 0) upper.push_back(p);
+    }
+
+    int sections = static_cast<int>(upper.size() + (real.size() + 1) / 2);
+    sos = Eigen::MatrixXd::Zero(sections, 6);
+    size_t next_zero = 0;
+    for (int s = 0; s < sections; s++) {
+        int section_order;
+        if (s < static_cast<int>(upper.size())) {
+            complex p = upper[s];
+            sos.row(s).tail(3) << 1, -2 * p.real(), std::norm(p);
+            section_order = 2;
+        } else {
+            size_t r = 2 * (s - upper.size());
+            if (r + 1 < real.size()) {
+                sos.row(s).tail(3) << 1, -(real[r] + real[r + 1]), real[r] * real[r + 1];
+                section_order = 2;
+            } else {
+                sos.row(s).tail(3) << 1, -real[r], 0;
+                section_order = 1;
+            }
+        }
+        if (section_order == 2) {
+            double z1 = zeros[next_zero], z2 = zeros[next_zero + 1];
+            sos.row(s).head(3) << 1, -(z1 + z2), z1 * z2;
+        } else {
+            sos.row(s).head(3) << 1, -zeros[next_zero], 0;
+        }
+        next_zero += section_order;
+    }
+    sos.row(0).head(3) *= gain;
+    return true;
+}
+
+std::shared_ptr<const filterCoefficients> designFilter(const filterSpec& spec) {
+    typedef std::tuple<int, double, double, double, int, double> designKey;
+    static std::mutex cache_mutex;
+    // Most recently used first
+    static std::list<std::pair<designKey, std::shared_ptr<const filterCoefficients>>> cache;
+
+    designKey key(spec.type, spec.fs, spec.low, spec.high, spec.order, spec.transition);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto found = std::find_if(cache.begin(), cache.end(), [&](const std::pair<designKey, std::shared_ptr<const filterCoefficients>> &entry) {
+        return entry.first == key;
+    });
+    if (found != cache.end()) {
+        cache.splice(cache.begin(), cache, found);
+        return found->second;
+    }
+
+    auto filter = std::make_shared<filterCoefficients>();
+    filter->spec = spec;
+    bool designed = false;
+    switch (spec.type) {
+    case FILTER_DESIGN_LS_FIR:
+        designed = designLSFIR(spec.fs, spec.low, spec.high, spec.order, spec.transition, filter->b);
+        break;
+    case FILTER_DESIGN_WINDOWED_FIR:
+        designed = designWindowedFIR(spec.fs, spec.low, spec.high, spec.order, filter->b);
+        break;
+    case FILTER_DESIGN_BUTTERWORTH:
+        designed = designButterworth(spec.fs, spec.low, spec.high, spec.order, filter->sos);
+        break;
+    }
+    if (!designed) return nullptr;
+
+    cache.emplace_front(key, filter);
+    if (cache.size() > FILTER_DESIGN_CACHE_SIZE) cache.pop_back();
+    return filter;
+}
+
+void applySOSFilter(const Eigen::MatrixXd& sos, const Eigen::Ref<const Eigen::VectorXd>& input, Eigen::Ref<Eigen::VectorXd> output) {
+    output = input;
+    for (int s = 0; s < sos.rows(); s++) {
+        double b0 = sos(s, 0), b1 = sos(s, 1), b2 = sos(s, 2), a1 = sos(s, 4), a2 = sos(s, 5);
+        double z1 = 0, z2 = 0;
+        for (int i = 0; i < output.size(); i++) {
+            double x = output(i);
+            double y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            output(i) = y;
+        }
+    }
+}
+
+double filterGain(const filterCoefficients& filter, double frequency) {
+    typedef std::complex<double> complex;
+    double w = 2 * M_PI * frequency / filter.spec.fs;
+    complex z1 = std::exp(complex(0, -w));
+
+    if (filter.spec.type != FILTER_DESIGN_BUTTERWORTH) {
+        complex response = 0, power = 1;
+        for (int n = 0; n < filter.b.size(); n++, power *= z1) response += filter.b(n) * power;
+        return std::abs(response);
+    }
+
+    complex response = 1, z2 = z1 * z1;
+    for (int s = 0; s < filter.sos.rows(); s++) {
+        response *= (filter.sos(s, 0) + filter.sos(s, 1) * z1 + filter.sos(s, 2) * z2) /
+                    (filter.sos(s, 3) + filter.sos(s, 4) * z1 + filter.sos(s, 5) * z2);
+    }
+    return std::abs(response);
+}
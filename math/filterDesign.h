@@ -0,0 +1,66 @@
+#ifndef FILTERDESIGN_H
+#define FILTERDESIGN_H
+
+#include <Eigen/Dense>
+#include <memory>
+#include <iostream>
+
+/*
+Filter coefficients designed at run time for the sampling rate and band of the session.
+
+The band is given in Hz: a low edge of 0 makes a lowpass and a high edge at or above fs / 2 a highpass.
+    FILTER_DESIGN_LS_FIR        least-squares linear-phase FIR (as firls), pass band [low, high] and stop bands that start
+                                transition Hz outside of it. order is the tap count, even counts are rounded up.
+    FILTER_DESIGN_WINDOWED_FIR  Hamming-windowed sinc FIR with the same band edges, order taps
+    FILTER_DESIGN_BUTTERWORTH   Butterworth IIR of the given order as biquad sections (bilinear transform, prewarped
+                                edges). A bandpass of order N has N sections.
+*/
+enum FilterDesignType {
+    FILTER_DESIGN_LS_FIR = 0,
+    FILTER_DESIGN_WINDOWED_FIR = 1,
+    FILTER_DESIGN_BUTTERWORTH = 2
+};
+
+struct filterSpec {
+    FilterDesignType type = FILTER_DESIGN_LS_FIR;
+    double fs = 0;
+    double low = 0;
+    double high = 0;
+    int order = 0;
+    double transition = 0;      // LS FIR only, 0 = a quarter of the pass band, limited to [fs / order, 2 * fs / order]
+};
+
+struct filterCoefficients {
+    filterSpec spec;
+    Eigen::VectorXd b;          // FIR taps, b0 applies to the newest sample
+    Eigen::MatrixXd sos;        // Butterworth sections, one row b0 b1 b2 a0 a1 a2 per section, a0 = 1
+};
+
+inline std::ostream& operator<<(std::ostream& os, const filterSpec& spec) {
+    const char *names[] = {"LS FIR", "windowed FIR", "Butterworth"};
+    os << names[spec.type] << " " << spec.low << "-" << spec.high << " Hz, order " << spec.order << " at " << spec.fs << " Hz";
+    return os;
+}
+
+// Designs the filter. Returns false and prints the reason if the specification is invalid.
+bool designLSFIR(double fs, double low, double high, int taps, double transition, Eigen::VectorXd& coeffs);
+bool designWindowedFIR(double fs, double low, double high, int taps, Eigen::VectorXd& coeffs);
+bool designButterworth(double fs, double low, double high, int order, Eigen::MatrixXd& sos);
+
+// Designs kept by designFilter
+#define FILTER_DESIGN_CACHE_SIZE 16
+
+/*
+Designs through a process-wide cache keyed by the whole specification, so switching back and forth between bands or
+restarting a pipeline does not repeat the design. The cache keeps the FILTER_DESIGN_CACHE_SIZE most recently used
+designs. Thread-safe. Returns nullptr if the specification is invalid.
+*/
+std::shared_ptr<const filterCoefficients> designFilter(const filterSpec& spec);
+
+// Filters input with the biquad sections (transposed direct form II, zero initial state). input and output may alias.
+void applySOSFilter(const Eigen::MatrixXd& sos, const Eigen::Ref<const Eigen::VectorXd>& input, Eigen::Ref<Eigen::VectorXd> output);
+
+// Magnitude response at frequency Hz
+double filterGain(const filterCoefficients& filter, double frequency);
+
+#endif // FILTERDESIGN_H
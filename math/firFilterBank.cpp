@@ -0,0 +1,152 @@
+#include "firFilterBank.h"
+#include <algorithm>
+#include <iostream>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+void firFilterBank::reset(const Eigen::VectorXd &coefficients, int channels, int max_taps) {
+    channel_count = std::max(0, channels);
+    padded_channels = (channel_count + FIR_LANES - 1) / FIR_LANES * FIR_LANES;
+    tap_count = coefficients.size();
+    max_tap_count = std::max<int>(tap_count, max_taps);
+    span = std::max(1, max_tap_count - 1 + FIR_MAX_BLOCK);
+
+    // A set still pending from before the reset would replace the new coefficients
+    Eigen::VectorXd stale;
+    coefficient_exchange.take(stale);
+    reversed_coefficients = coefficients.reverse();
+    history = Eigen::MatrixXd::Zero(FIR_LANES, padded_channels / FIR_LANES * 2 * span);
+    block_output = Eigen::MatrixXd::Zero(padded_channels, FIR_MAX_BLOCK);
+    newest = span - 1;
+}
+
+void firFilterBank::clearHistory() {
+    history.setZero();
+    newest = span - 1;
+}
+
+bool firFilterBank::setCoefficients(const Eigen::VectorXd &coefficients) {
+    if (coefficients.size() == 0 || coefficients.size() > max_tap_count) {
+        std::cerr << "FIR filter bank: " << coefficients.size() << " taps do not fit the reserved " << max_tap_count << '\n';
+        return false;
+    }
+    coefficient_exchange.publish(coefficients.reverse());
+    return true;
+}
+
+void firFilterBank::takeCoefficients() {
+    if (coefficient_exchange.take(reversed_coefficients)) tap_count = reversed_coefficients.size();
+}
+
+void firFilterBank::pushColumns(const Eigen::Ref<const Eigen::MatrixXd> &columns) {
+    for (int i = 0; i < columns.cols(); i++) {
+        newest = newest + 1 == span ? 0 : newest + 1;
+        for (int channel = 0; channel < channel_count; channel++) {
+            double *group = history.data() + static_cast<size_t>(channel / FIR_LANES) * 2 * span * FIR_LANES;
+            group[newest * FIR_LANES + channel % FIR_LANES] = columns(channel, i);
+            group[(newest + span) * FIR_LANES + channel % FIR_LANES] = columns(channel, i);
+        }
+    }
+}
+
+/*
+Outputs of count consecutive samples. Output r is the dot product of the coefficients with the history columns
+first + r ... first + r + taps - 1 of every group, group_size apart. The vector kernel keeps eight channels of four outputs in eight accumulators, so
+every broadcast coefficient feeds eight independent FMAs.
+*/
+static void filterColumns(const double *history, size_t group_size, int first, const double *coefficients, int taps, int count,
+                          int channels, double *output, int output_stride) {
+    const int stride = FIR_LANES;
+    for (int group = 0; group < channels; group += FIR_LANES) {
+        const double *group_history = history + group / FIR_LANES * group_size;
+        int r = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+        for (; r + 4 <= count; r += 4) {
+            __m256d acc00 = _mm256_setzero_pd(), acc01 = _mm256_setzero_pd();
+            __m256d acc10 = _mm256_setzero_pd(), acc11 = _mm256_setzero_pd();
+            __m256d acc20 = _mm256_setzero_pd(), acc21 = _mm256_setzero_pd();
+            __m256d acc30 = _mm256_setzero_pd(), acc31 = _mm256_setzero_pd();
+            const double *column = group_history + static_cast<size_t>(first + r) * stride;
+            for (int k = 0; k < taps; k++, column += stride) {
+                __m256d c = _mm256_broadcast_sd(coefficients + k);
+                acc00 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column), acc00);
+                acc01 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column + 4), acc01);
+                acc10 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column + stride), acc10);
+                acc11 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column + stride + 4), acc11);
+                acc20 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column + 2 * stride), acc20);
+                acc21 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column + 2 * stride + 4), acc21);
+                acc30 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column + 3 * stride), acc30);
+                acc31 = _mm256_fmadd_pd(c, _mm256_loadu_pd(column + 3 * stride + 4), acc31);
+            }
+            double *out = output + static_cast<size_t>(r) * output_stride + group;
+            _mm256_storeu_pd(out, acc00);
+            _mm256_storeu_pd(out + 4, acc01);
+            _mm256_storeu_pd(out + output_stride, acc10);
+            _mm256_storeu_pd(out + output_stride + 4, acc11);
+            _mm256_storeu_pd(out + 2 * output_stride, acc20);
+            _mm256_storeu_pd(out + 2 * output_stride + 4, acc21);
+            _mm256_storeu_pd(out + 3 * output_stride, acc30);
+            _mm256_storeu_pd(out + 3 * output_stride + 4, acc31);
+        }
+
+        // Single outputs split the taps over two accumulator pairs
+        for (; r < count; r++) {
+            __m256d even0 = _mm256_setzero_pd(), even1 = _mm256_setzero_pd();
+            __m256d odd0 = _mm256_setzero_pd(), odd1 = _mm256_setzero_pd();
+            const double *column = group_history + static_cast<size_t>(first + r) * stride;
+            int k = 0;
+            for (; k + 2 <= taps; k += 2, column += 2 * stride) {
+                __m256d c0 = _mm256_broadcast_sd(coefficients + k);
+                __m256d c1 = _mm256_broadcast_sd(coefficients + k + 1);
+                even0 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(column), even0);
+                even1 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(column + 4), even1);
+                odd0 = _mm256_fmadd_pd(c1, _mm256_loadu_pd(column + stride), odd0);
+                odd1 = _mm256_fmadd_pd(c1, _mm256_loadu_pd(column + stride + 4), odd1);
+            }
+            if (k < taps) {
+                __m256d c0 = _mm256_broadcast_sd(coefficients + k);
+                even0 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(column), even0);
+                even1 = _mm256_fmadd_pd(c0, _mm256_loadu_pd(column + 4), even1);
+            }
+            double *out = output + static_cast<size_t>(r) * output_stride + group;
+            _mm256_storeu_pd(out, _mm256_add_pd(even0, odd0));
+            _mm256_storeu_pd(out + 4, _mm256_add_pd(even1, odd1));
+        }
+#endif
+
+        for (; r < count; r++) {
+            double *out = output + static_cast<size_t>(r) * output_stride + group;
+            for (int lane = 0; lane < FIR_LANES; lane++) out[lane] = 0;
+            const double *column = group_history + static_cast<size_t>(first + r) * stride;
+            for (int k = 0; k < taps; k++, column += stride) {
+                for (int lane = 0; lane < FIR_LANES; lane++) out[lane] += coefficients[k] * column[lane];
+            }
+        }
+    }
+}
+
+void firFilterBank::filterNewest(int count, Eigen::Ref<Eigen::MatrixXd> output) {
+    // Window of the oldest of the count samples, see the class comment
+    int first = newest + span - (count - 1) - tap_count + 1;
+    filterColumns(history.data(), static_cast<size_t>(2) * span * FIR_LANES, first, reversed_coefficients.data(), tap_count, count, padded_channels,
+                  block_output.data(), padded_channels);
+    output = block_output.topLeftCorner(channel_count, count);
+}
+
+void firFilterBank::processSample(const Eigen::Ref<const Eigen::VectorXd> &input, Eigen::Ref<Eigen::VectorXd> output) {
+    takeCoefficients();
+    pushColumns(input);
+    filterNewest(1, output);
+}
+
+void firFilterBank::processBlock(Eigen::Ref<Eigen::MatrixXd> samples) {
+    takeCoefficients();
+    for (int start = 0; start < samples.cols(); start += FIR_MAX_BLOCK) {
+        int count = std::min<int>(FIR_MAX_BLOCK, samples.cols() - start);
+        pushColumns(samples.middleCols(start, count));
+        filterNewest(count, samples.middleCols(start, count));
+    }
+}
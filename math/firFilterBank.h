@@ -0,0 +1,68 @@
+#ifndef FIRFILTERBANK_H
+#define FIRFILTERBANK_H
+
+#include <Eigen/Dense>
+#include "coefficientExchange.h"
+
+/*
+The same FIR filter applied to every channel of a stream, sample by sample or a packet at a time.
+
+The channels are filtered in groups of FIR_LANES. The history of a group is time-major (FIR_LANES x 2 * span): a
+column holds one time point of the group, so one coefficient is broadcast and multiplied with FIR_LANES channels in
+SIMD lanes, and the window of a group is contiguous in memory. Every sample is written to two columns, q and q + span,
+so the newest span samples are always contiguous at columns q + 1 ... q + span and nothing is shifted. With
+span = taps - 1 + FIR_MAX_BLOCK the windows of all samples of a block are in that range, and the block kernel computes
+four consecutive outputs per pass over the coefficients.
+
+The span is sized for max_taps, so setCoefficients can retune the filter from another thread while it runs: the new
+coefficients are swapped in at the start of the next processSample or processBlock, filter the history already
+collected, and nothing is reallocated on the processing thread.
+*/
+
+// Channels per SIMD group (two AVX registers of doubles). The channel count is padded to a multiple of it.
+#define FIR_LANES 8
+// Samples per call of the block kernel, longer blocks are filtered in parts
+#define FIR_MAX_BLOCK 64
+
+class firFilterBank {
+public:
+    firFilterBank() { }
+
+    // Sets the coefficients (b0 applies to the newest sample) and clears the history. max_taps reserves history
+    // for longer coefficient sets given later to setCoefficients.
+    void reset(const Eigen::VectorXd &coefficients, int channels, int max_taps = 0);
+    void clearHistory();
+
+    // Replaces the coefficients from any thread, taken into use by the next processing call. Returns false if
+    // the set is empty or longer than the reserved taps.
+    bool setCoefficients(const Eigen::VectorXd &coefficients);
+
+    int getChannelCount() const { return channel_count; }
+    int getTapCount() const { return tap_count; }
+    int getMaxTapCount() const { return max_tap_count; }
+
+    // One sample of every channel
+    void processSample(const Eigen::Ref<const Eigen::VectorXd> &input, Eigen::Ref<Eigen::VectorXd> output);
+    // channels x samples block, filtered in place
+    void processBlock(Eigen::Ref<Eigen::MatrixXd> samples);
+
+private:
+    void takeCoefficients();
+    void pushColumns(const Eigen::Ref<const Eigen::MatrixXd> &columns);
+    // Outputs of the count newest samples to the columns of output
+    void filterNewest(int count, Eigen::Ref<Eigen::MatrixXd> output);
+
+    int channel_count = 0;
+    int padded_channels = 0;
+    int tap_count = 0;
+    int max_tap_count = 0;
+    int span = 0;
+    int newest = 0;                         // Column of the newest sample in the lower half
+
+    Eigen::VectorXd reversed_coefficients;  // Oldest first, in the order of the window columns
+    coefficientExchange<Eigen::VectorXd> coefficient_exchange;      // Reversed sets from setCoefficients
+    Eigen::MatrixXd history;                // FIR_LANES x 2 * span per channel group, the groups after each other
+    Eigen::MatrixXd block_output;           // padded_channels x FIR_MAX_BLOCK
+};
+
+#endif // FIRFILTERBANK_H
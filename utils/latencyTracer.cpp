@@ -0,0 +1,132 @@
+#include "latencyTracer.h"
+#include <cstdio>
+#include <algorithm>
+#include <iomanip>
+
+const char *traceStageName(int stage) {
+    switch (stage) {
+        case TRACE_RECV: return "recv";
+        case TRACE_DECODE: return "decode";
+        case TRACE_ADD_DATA: return "addData";
+        case TRACE_PREPROCESSING: return "preprocessing";
+        case TRACE_PHASE_ESTIMATE: return "phase_estimate";
+        case TRACE_INSERT_TRIGGER: return "insert_trigger";
+        case TRACE_SEND_TRIGGER: return "send_trigger";
+        default: return "unknown";
+    }
+}
+
+void latencyHistogram::reset() {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) counts[i].store(0, std::memory_order_relaxed);
+    total_count.store(0, std::memory_order_relaxed);
+    total_sum.store(0, std::memory_order_relaxed);
+    max_value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t latencyHistogram::bucketLowerBound(int index) {
+    if (index < 2 * LATENCY_SUB_BUCKETS) return static_cast<uint64_t>(index);
+    int shift = index / LATENCY_SUB_BUCKETS - 1;
+    uint64_t sub_bucket = index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+    return sub_bucket << shift;
+}
+
+double latencyHistogram::mean() const {
+    uint64_t n = count();
+    return n > 0 ? static_cast<double>(total_sum.load(std::memory_order_relaxed)) / n : 0;
+}
+
+uint64_t latencyHistogram::percentile(double fraction) const {
+    // The buckets are read one by one while they may still be updated, the total is taken from the same pass
+    uint64_t snapshot[LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        snapshot[i] = counts[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+    if (total == 0) return 0;
+
+    uint64_t target = static_cast<uint64_t>(fraction * total + 0.5);
+    if (target < 1) target = 1;
+    if (target > total) target = total;
+
+    uint64_t cumulative = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        cumulative += snapshot[i];
+        if (cumulative >= target) return std::min(bucketUpperBound(i), maximum());
+    }
+    return maximum();
+}
+
+latency_summary latencyHistogram::summary() const {
+    latency_summary result;
+    result.count = count();
+    if (result.count == 0) return result;
+
+    result.mean_us = mean() / 1000.0;
+    result.p50_us = percentile(0.5) / 1000.0;
+    result.p90_us = percentile(0.9) / 1000.0;
+    result.p99_us = percentile(0.99) / 1000.0;
+    result.p999_us = percentile(0.999) / 1000.0;
+    result.max_us = maximum() / 1000.0;
+    return result;
+}
+
+int64_t latencyTracer::arrivalTime(int SeqNo) const {
+    const batch_slot &slot = batches[static_cast<uint32_t>(SeqNo) % TRACE_BATCH_CAPACITY];
+    if (slot.seq_num.load(std::memory_order_acquire) != SeqNo) return 0;
+    int64_t arrival_ns = slot.arrival_ns.load(std::memory_order_relaxed);
+
+    // The slot was reused for a newer packet while it was read
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq_num.load(std::memory_order_relaxed) != SeqNo) return 0;
+    return arrival_ns;
+}
+
+void latencyTracer::reset() {
+    for (int i = 0; i < TRACE_STAGE_COUNT; i++) histograms[i].reset();
+    for (int i = 0; i < TRACE_BATCH_CAPACITY; i++) {
+        batches[i].seq_num.store(-1, std::memory_order_relaxed);
+        batches[i].arrival_ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+void latencyTracer::printSummary(std::ostream &os) const {
+    std::streamsize precision = os.precision();
+    os << "Latency from packet arrival (us):\n"
+       << std::left << std::setw(16) << "stage" << std::right
+       << std::setw(10) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+       << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max" << '\n';
+
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+        latency_summary s = summary(stage);
+        if (s.count == 0) continue;
+        os << std::left << std::setw(16) << traceStageName(stage) << std::right << std::fixed << std::setprecision(1)
+           << std::setw(10) << s.count << std::setw(10) << s.mean_us << std::setw(10) << s.p50_us << std::setw(10) << s.p90_us
+           << std::setw(10) << s.p99_us << std::setw(10) << s.p999_us << std::setw(10) << s.max_us << '\n';
+    }
+    os << std::defaultfloat << std::setprecision(precision);
+}
+
+bool latencyTracer::writeHistogramsCSV(const std::string &filename) const {
+    FILE *file = fopen(filename.c_str(), "w");
+    if (!file) {
+        std::cerr << "Failed to open " << filename << '\n';
+        return false;
+    }
+
+    fprintf(file, "stage,lower_ns,upper_ns,count\n");
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            uint64_t n = histograms[stage].bucketCount(i);
+            if (n == 0) continue;
+            fprintf(file, "%s,%llu,%llu,%llu\n", traceStageName(stage),
+                    static_cast<unsigned long long>(latencyHistogram::bucketLowerBound(i)),
+                    static_cast<unsigned long long>(latencyHistogram::bucketUpperBound(i)),
+                    static_cast<unsigned long long>(n));
+        }
+    }
+
+    fclose(file);
+    std::cout << "Latency histograms written to " << filename << '\n';
+    return true;
+}
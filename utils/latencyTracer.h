@@ -0,0 +1,157 @@
+#ifndef LATENCYTRACER_H
+#define LATENCYTRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <iostream>
+#include <time.h>
+
+/*
+Latency tracing from the kernel arrival of a sample packet to the trigger output. Every stage records the time elapsed
+since the arrival of the packet it is working on into a log-linear histogram (HDR style: 32 linear sub-buckets per
+power of two, about 3 % relative precision). Recording is lock-free and wait-free, so the receive thread and the
+workers can record concurrently while another thread reads percentiles.
+
+The packets are identified by their sequence number. The bridge registers the arrival time of each sample packet with
+beginBatch, the later stages only pass the sequence number of the newest packet they used.
+*/
+
+enum TraceStage {
+    TRACE_RECV,                 // recvmmsg returned the packet
+    TRACE_DECODE,               // Samples decoded
+    TRACE_ADD_DATA,             // Samples published to the ring
+    TRACE_PREPROCESSING,        // Preprocessing window ready
+    TRACE_PHASE_ESTIMATE,       // Phase estimate ready
+    TRACE_INSERT_TRIGGER,       // Trigger target inserted
+    TRACE_SEND_TRIGGER,         // Pulse sent to the stimulator
+    TRACE_STAGE_COUNT
+};
+
+const char *traceStageName(int stage);
+
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_EXPONENT 40                 // Values above 2^40 ns (18 min) go to the last bucket
+#define LATENCY_BUCKETS ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+struct latency_summary {
+    uint64_t count = 0;
+    double mean_us = 0;
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+};
+
+// Log-linear histogram of nanosecond values
+class latencyHistogram {
+public:
+    latencyHistogram() { reset(); }
+
+    void record(int64_t value_ns) {
+        uint64_t value = value_ns > 0 ? static_cast<uint64_t>(value_ns) : 0;
+        counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        total_count.fetch_add(1, std::memory_order_relaxed);
+        total_sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t current_max = max_value.load(std::memory_order_relaxed);
+        while (value > current_max && !max_value.compare_exchange_weak(current_max, value, std::memory_order_relaxed)) {}
+    }
+
+    void reset();
+
+    uint64_t count() const { return total_count.load(std::memory_order_relaxed); }
+    uint64_t maximum() const { return max_value.load(std::memory_order_relaxed); }
+    double mean() const;
+    // Value below which the given fraction of the recorded values fall (upper edge of the bucket)
+    uint64_t percentile(double fraction) const;
+    latency_summary summary() const;
+
+    uint64_t bucketCount(int index) const { return counts[index].load(std::memory_order_relaxed); }
+    static uint64_t bucketLowerBound(int index);
+    static uint64_t bucketUpperBound(int index) { return index + 1 < LATENCY_BUCKETS ? bucketLowerBound(index + 1) - 1 : UINT64_MAX; }
+
+    static int bucketIndex(uint64_t value) {
+        if (value < 2 * LATENCY_SUB_BUCKETS) return static_cast<int>(value);
+        int msb = 63 - __builtin_clzll(value);
+        if (msb > LATENCY_MAX_EXPONENT) return LATENCY_BUCKETS - 1;
+        int shift = msb - LATENCY_SUB_BUCKET_BITS;
+        return (shift + 1) * LATENCY_SUB_BUCKETS + static_cast<int>(value >> shift) - LATENCY_SUB_BUCKETS;
+    }
+
+private:
+    std::atomic<uint64_t> counts[LATENCY_BUCKETS];
+    std::atomic<uint64_t> total_count;
+    std::atomic<uint64_t> total_sum;
+    std::atomic<uint64_t> max_value;
+};
+
+// Number of packets whose arrival times are kept for the later stages
+#define TRACE_BATCH_CAPACITY 8192
+
+class latencyTracer {
+public:
+    latencyTracer() { reset(); }
+
+    void setEnabled(bool state) { enabled.store(state, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    static int64_t now() {
+        struct timespec time;
+        clock_gettime(CLOCK_REALTIME, &time);
+        return static_cast<int64_t>(time.tv_sec) * 1000000000LL + time.tv_nsec;
+    }
+
+    // Registers the arrival time (ns, CLOCK_REALTIME) of a sample packet. Called by the acquisition thread only.
+    void beginBatch(int SeqNo, int64_t arrival_ns) {
+        if (!isEnabled() || arrival_ns <= 0) return;
+        batch_slot &slot = batches[static_cast<uint32_t>(SeqNo) % TRACE_BATCH_CAPACITY];
+        slot.seq_num.store(-1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.arrival_ns.store(arrival_ns, std::memory_order_relaxed);
+        slot.seq_num.store(SeqNo, std::memory_order_release);
+    }
+
+    // Records a stage of a packet whose arrival time is known
+    void record(TraceStage stage, int64_t arrival_ns) {
+        if (!isEnabled() || arrival_ns <= 0) return;
+        histograms[stage].record(now() - arrival_ns);
+    }
+    void record(TraceStage stage, int64_t arrival_ns, int64_t now_ns) {
+        if (!isEnabled() || arrival_ns <= 0) return;
+        histograms[stage].record(now_ns - arrival_ns);
+    }
+
+    // Records a stage of a registered packet. Packets that are no longer in the batch ring are skipped.
+    void stamp(TraceStage stage, int SeqNo) {
+        if (!isEnabled()) return;
+        int64_t arrival_ns = arrivalTime(SeqNo);
+        if (arrival_ns > 0) histograms[stage].record(now() - arrival_ns);
+    }
+
+    int64_t arrivalTime(int SeqNo) const;
+
+    const latencyHistogram &histogram(int stage) const { return histograms[stage]; }
+    latency_summary summary(int stage) const { return histograms[stage].summary(); }
+
+    void reset();
+
+    // Percentile table of the stages with samples
+    void printSummary(std::ostream &os) const;
+    // Non-empty buckets of every stage: stage, lower bound (ns), upper bound (ns), count
+    bool writeHistogramsCSV(const std::string &filename) const;
+
+private:
+    struct batch_slot {
+        std::atomic<int64_t> seq_num;
+        std::atomic<int64_t> arrival_ns;
+    };
+
+    std::atomic<bool> enabled{true};
+    latencyHistogram histograms[TRACE_STAGE_COUNT];
+    batch_slot batches[TRACE_BATCH_CAPACITY];
+};
+
+#endif // LATENCYTRACER_H
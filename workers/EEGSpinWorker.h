@@ -2,7 +2,9 @@
 #define WORKER_H
 
 #include <QObject>
+#include <QDebug>
 #include <iostream>
+#include <cstdlib>
 #include <pthread.h>
 #include <sched.h>
 